@@ -0,0 +1,301 @@
+// Microbenchmarks for the Facility and Message hot paths: ns/op and heap allocations/op.
+//
+//   ./booking_bench [--millis <per benchmark>] [--filter <substring>]
+//                   [--save <file>] [--compare <file> [--tolerance <percent>]]
+//
+// Facility benchmarks sweep one dimension at a time around 10 open hours a day, 5 open days and
+// half the slots booked. --save writes the results; --compare reads a saved run and exits 1 if a
+// benchmark got slower by more than --tolerance percent (default 25) or allocates more.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <vector>
+#include "Facility.h"
+#include "Logger.h"
+#include "Message.h"
+#include "TextWriter.h"
+#include "Util.h"
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+// Every heap allocation on this thread is counted
+namespace {
+thread_local uint64_t allocations = 0;
+}
+
+uint64_t benchSink = 0;  // results are folded in here so the work is not optimized away
+
+void *operator new(size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Result {
+    double nsPerOp;
+    double allocationsPerOp;
+};
+
+std::chrono::milliseconds budget{100};
+string filter;
+vector<pair<string, Result>> results;
+
+// Runs `batch` (which does `opsPerBatch` operations) until the budget is spent
+template <typename Batch>
+void measure(const string &name, uint64_t opsPerBatch, Batch &&batch) {
+    if (!filter.empty() && name.find(filter) == string::npos) return;
+    batch();  // warm up
+    uint64_t ops = 0;
+    uint64_t allocationsBefore = allocations;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    do {
+        batch();
+        ops += opsPerBatch;
+        elapsed = Clock::now() - start;
+    } while (elapsed < budget);
+    Result result{std::chrono::duration<double, std::nano>(elapsed).count() / ops,
+                  static_cast<double>(allocations - allocationsBefore) / ops};
+    results.emplace_back(name, result);
+    cout << left << setw(44) << name << right << fixed << setprecision(1) << setw(12)
+         << result.nsPerOp << setprecision(2) << setw(12) << result.allocationsPerOp << "\n";
+}
+
+struct Shape {
+    int hours;       // open from 08:00, in 30-minute slots
+    int days;        // open from Monday
+    double density;  // share of the slots booked
+
+    string label() const {
+        return "h" + to_string(hours) + " d" + to_string(days) + " " +
+               to_string(static_cast<int>(density * 100)) + "%";
+    }
+};
+
+TimeOfDay slotStart(int slot) { return TimeOfDay::ofSlot(Facility::OPENING.slot() + slot); }
+
+Facility::TimeSlot slotAt(int day, int slot) {
+    return Facility::TimeSlot(static_cast<Util::Day>(day), slotStart(slot), slotStart(slot + 1));
+}
+
+// Slot 0 of each day is kept booked and slot 1 free, for modifyBooking to move between
+Facility makeFacility(const Shape &shape, FastRandom &random, uint32_t &movable) {
+    Facility facility("Bench");
+    vector<Facility::TimeSlot> slots;
+    for (int day = 0; day < shape.days; ++day) {
+        for (int slot = 0; slot < shape.hours * 2; ++slot) slots.push_back(slotAt(day, slot));
+    }
+    facility.addAvailability(std::move(slots));
+
+    uint32_t bookingId;
+    for (int day = 0; day < shape.days; ++day) {
+        for (int slot = 2; slot < shape.hours * 2; ++slot) {
+            if (random.nextDouble() < shape.density) {
+                facility.bookSlot(slotAt(day, slot), bookingId);
+            }
+        }
+    }
+    facility.bookSlot(slotAt(0, 0), movable);
+    return facility;
+}
+
+void facilityBenchmarks(const Shape &shape) {
+    FastRandom random(1);
+    uint32_t movable;
+    Facility facility = makeFacility(shape, random, movable);
+    const int slotsPerDay = shape.hours * 2;
+    const string label = " " + shape.label();
+
+    // Random probes over the open days, a mix of free and booked
+    vector<Facility::TimeSlot> probes;
+    for (int i = 0; i < 256; ++i) {
+        int day = static_cast<int>(random.next() % shape.days);
+        probes.push_back(slotAt(day, static_cast<int>(random.next() % slotsPerDay)));
+    }
+    measure("isAvailable" + label, probes.size(), [&]() {
+        for (const auto &probe : probes) benchSink += facility.isAvailable(probe);
+    });
+
+    // Book the free probes, then cancel them, so the density stays where it was
+    vector<Facility::TimeSlot> freeSlots;
+    for (const auto &probe : probes) {
+        if (facility.isAvailable(probe) &&
+            find(freeSlots.begin(), freeSlots.end(), probe) == freeSlots.end()) {
+            freeSlots.push_back(probe);
+        }
+    }
+    if (freeSlots.size() > 16) freeSlots.erase(freeSlots.begin() + 16, freeSlots.end());
+    vector<uint32_t> booked(freeSlots.size());
+    if (!freeSlots.empty()) {
+        measure("bookSlot+cancelBooking" + label, freeSlots.size(), [&]() {
+            for (size_t i = 0; i < freeSlots.size(); ++i) {
+                facility.bookSlot(freeSlots[i], booked[i]);
+            }
+            for (uint32_t id : booked) benchSink += facility.cancelBooking(id).has_value();
+        });
+    }
+
+    measure("modifyBooking" + label, 2, [&]() {
+        benchSink += facility.modifyBooking(movable, 30) == Facility::ChangeResult::Done;
+        benchSink += facility.modifyBooking(movable, -30) == Facility::ChangeResult::Done;
+    });
+
+    measure("getAvailability" + label, shape.days, [&]() {
+        for (int day = 0; day < shape.days; ++day) {
+            benchSink += facility.getAvailability(static_cast<Util::Day>(day)).size();
+        }
+    });
+
+    TextBuffer<MAX_TEXT_REPLY> text;
+    measure("formatAvailability" + label, shape.days, [&]() {
+        for (int day = 0; day < shape.days; ++day) {
+            text.clear();
+            facility.formatAvailability(static_cast<Util::Day>(day), text);
+            benchSink += text.size();
+        }
+    });
+}
+
+void messageBenchmarks() {
+    RequestMessage request;
+    request.requestId = 42;
+    request.operation = Operation::CHANGE;
+    request.facilityName = "Tennis Court";
+    request.day = Util::Day::Wednesday;
+    request.startTime = 900;
+    request.endTime = 1000;
+    request.bookingId = 1001;
+    request.offsetMinutes = 30;
+    vector<uint8_t> requestData = request.marshal();
+
+    measure("RequestMessage::marshal", 1, [&]() { benchSink += request.marshal().size(); });
+    uint8_t datagram[1024];
+    measure("RequestMessage::marshal into buffer", 1,
+            [&]() { benchSink += request.marshal(datagram, sizeof(datagram)); });
+    measure("RequestMessage::unmarshal", 1,
+            [&]() { benchSink += RequestMessage::unmarshal(requestData).requestId; });
+
+    ResponseMessage response;
+    response.requestId = 42;
+    response.status = 0;
+    response.message = "Booking confirmed for Tennis Court on Wednesday 9:00 to 10:00. "
+                       "Booking ID: 1001";
+    measure("ResponseMessage::marshal short", 1,
+            [&]() { benchSink += response.marshal().size(); });
+    string reply;
+    measure("ResponseMessage::marshal short into string", 1, [&]() {
+        response.marshal(reply);
+        benchSink += reply.size();
+    });
+
+    OpResult booked = OpResult::success(Operation::BOOK, 1001,
+                                        Facility::TimeSlot::fromHHMM(Util::Day::Wednesday, 900,
+                                                                     1000));
+    measure("OpResult::toText", 1, [&]() { benchSink += booked.toText("Tennis Court").size(); });
+    TextBuffer<MAX_TEXT_REPLY> text;
+    uint8_t replyData[MAX_TEXT_REPLY + TextReply::Wire::minSize];
+    measure("OpResult::formatText + TextReply::marshal", 1, [&]() {
+        text.clear();
+        booked.formatText("Tennis Court", text);
+        TextReply textReply;
+        textReply.requestId = 42;
+        textReply.message = text.view();
+        benchSink += textReply.marshal(replyData, sizeof(replyData));
+    });
+
+    // About what a QUERY for a 10-hour day returns
+    FastRandom random(1);
+    uint32_t movable;
+    Facility facility = makeFacility({10, 5, 0.5}, random, movable);
+    response.message = facility.getAvailability(Util::Day::Monday);
+    measure("ResponseMessage::marshal " + to_string(response.message.size()) + "B", 1,
+            [&]() { benchSink += response.marshal().size(); });
+}
+
+map<string, Result> load(const string &path) {
+    map<string, Result> saved;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        // name<TAB>ns/op<TAB>allocations/op
+        size_t first = line.find('\t'), second = line.rfind('\t');
+        if (first == string::npos || first == second) continue;
+        saved[line.substr(0, first)] = {stod(line.substr(first + 1, second - first - 1)),
+                                        stod(line.substr(second + 1))};
+    }
+    return saved;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    string savePath, comparePath;
+    double tolerance = 25;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--millis" && i + 1 < argc) {
+            budget = std::chrono::milliseconds(stoi(argv[++i]));
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--save" && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            comparePath = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = stod(argv[++i]);
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--millis <per benchmark>] [--filter <substring>] [--save <file>]"
+                    " [--compare <file> [--tolerance <percent>]]"
+                 << endl;
+            return 1;
+        }
+    }
+
+    Logger::instance().setLevel(LogLevel::Warn);  // rejected bookings log at Debug
+    cout << left << setw(44) << "benchmark" << right << setw(12) << "ns/op" << setw(12)
+         << "allocs/op" << "\n";
+    for (const Shape &shape : {Shape{4, 5, 0.5}, Shape{10, 5, 0.5}, Shape{16, 5, 0.5},
+                               Shape{10, 1, 0.5}, Shape{10, 7, 0.5}, Shape{10, 5, 0.0},
+                               Shape{10, 5, 0.9}}) {
+        facilityBenchmarks(shape);
+    }
+    messageBenchmarks();
+
+    if (!savePath.empty()) {
+        ofstream out(savePath);
+        for (const auto &[name, result] : results) {
+            out << name << '\t' << result.nsPerOp << '\t' << result.allocationsPerOp << '\n';
+        }
+    }
+
+    int regressions = 0;
+    if (!comparePath.empty()) {
+        auto baseline = load(comparePath);
+        cout << "\nAgainst " << comparePath << " (tolerance " << tolerance << "%)\n";
+        for (const auto &[name, result] : results) {
+            auto it = baseline.find(name);
+            if (it == baseline.end()) continue;
+            double change = 100.0 * (result.nsPerOp - it->second.nsPerOp) / it->second.nsPerOp;
+            bool slower = change > tolerance;
+            bool allocatesMore = result.allocationsPerOp > it->second.allocationsPerOp + 0.01;
+            cout << left << setw(44) << name << right << showpos << setprecision(1) << setw(11)
+                 << change << "%" << noshowpos
+                 << (slower ? "  SLOWER" : "") << (allocatesMore ? "  MORE ALLOCATIONS" : "")
+                 << "\n";
+            regressions += slower || allocatesMore;
+        }
+        cout << regressions << " regression(s)\n";
+    }
+    return regressions > 0 ? 1 : 0;
+}
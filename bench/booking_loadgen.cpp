@@ -0,0 +1,363 @@
+// Open-loop load generator: a fixed request rate from many sockets, with latency percentiles.
+//
+//   ./booking_loadgen [--server host:port] [--rate <requests/s>] [--duration <s>]
+//                     [--threads <n>] [--sockets <per thread>] [--timeout <ms>] [--seed <n>]
+//                     [--mix query=50,book=20,change=10,extend=5,cancel=10,monitor=5]
+//
+// Requests go out on schedule whether or not earlier ones were answered, and latency is measured
+// from the scheduled send time, so a server that stalls shows up in the tail instead of slowing
+// the load down. A request without a reply within --timeout counts as lost. The facilities are
+// the ones a server started without --catalog has.
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Message.h"
+#include "Stats.h"
+#include "Util.h"
+
+using namespace std;
+using namespace boost::asio;
+using boost::asio::ip::udp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const vector<string> FACILITIES = {"MeetingRoom",  "Gym",        "Swimming Pool",
+                                   "Tennis Court", "Study Room", "Fitness Center"};
+const int SLOTS_PER_DAY = 20;  // 30-minute slots from 08:00 to 18:00, Monday to Friday
+const uint32_t MONITOR_SECONDS = 2;
+
+struct Options {
+    string server = "127.0.0.1:2222";
+    double rate = 2000;
+    int durationSeconds = 5;
+    int threads = 2;
+    int socketsPerThread = 4;
+    std::chrono::milliseconds timeout{500};
+    uint64_t seed = 1;
+    array<double, ServerStats::OPERATIONS> mix{};  // weight per Operation value
+};
+
+// "query=50,book=20,..." into weights indexed by Operation value
+bool parseMix(const string &text, array<double, ServerStats::OPERATIONS> &mix) {
+    mix.fill(0);
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = min(text.find(',', start), text.size());
+        string entry = text.substr(start, end - start);
+        start = end + 1;
+        size_t equals = entry.find('=');
+        if (equals == string::npos) return false;
+        string name = entry.substr(0, equals);
+        for (auto &c : name) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        size_t op = 1;
+        while (op < ServerStats::OPERATIONS && name != ServerStats::operationName(op)) ++op;
+        if (op == ServerStats::OPERATIONS || op > static_cast<size_t>(Operation::CANCEL)) {
+            return false;
+        }
+        mix[op] = stod(entry.substr(equals + 1));
+    }
+    return true;
+}
+
+struct Results {
+    array<LatencyHistogram, ServerStats::OPERATIONS> latency;  // answered within the timeout
+    LatencyHistogram all;
+    uint64_t sent = 0;
+    uint64_t answered = 0;
+    uint64_t lost = 0;    // no reply, or one after the timeout
+    uint64_t failed = 0;  // answered with an error status
+    uint64_t notifications = 0;
+
+    void merge(const Results &other) {
+        for (size_t op = 0; op < latency.size(); ++op) latency[op].merge(other.latency[op]);
+        all.merge(other.all);
+        sent += other.sent;
+        answered += other.answered;
+        lost += other.lost;
+        failed += other.failed;
+        notifications += other.notifications;
+    }
+};
+
+// One thread: its own io_context, sockets and schedule
+class Worker {
+  public:
+    Worker(const Options &options, const udp::endpoint &server, uint64_t seed,
+           Clock::time_point start)
+        : options_(options),
+          server_(server),
+          random_(seed),
+          timer_(context_),
+          interval_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+              options.threads / options.rate))),
+          nextSend_(start),
+          stopAt_(start + std::chrono::seconds(options.durationSeconds)) {
+        double total = 0;
+        for (size_t op = 0; op < options.mix.size(); ++op) {
+            total += options.mix[op];
+            cumulative_[op] = total;
+        }
+        for (int i = 0; i < options.socketsPerThread; ++i) {
+            connections_.push_back(make_unique<Connection>(context_));
+            receive(*connections_.back());
+        }
+    }
+
+    void run() {
+        schedule();
+        context_.run();
+    }
+
+    const Results &results() const { return results_; }
+
+  private:
+    struct Booking {
+        size_t facility;
+        uint32_t id;
+    };
+    struct Outstanding {
+        Clock::time_point scheduled;
+        Operation operation;
+        size_t facility;
+    };
+    struct Connection {
+        explicit Connection(io_context &context) : socket(context, udp::endpoint(udp::v4(), 0)) {}
+        udp::socket socket;
+        array<uint8_t, 1024> buffer{};
+        udp::endpoint sender;
+        uint32_t nextRequestId = 1;
+        unordered_map<uint32_t, Outstanding> outstanding;
+        vector<Booking> bookings;  // confirmed on this socket and not yet cancelled
+    };
+
+    const Options &options_;
+    udp::endpoint server_;
+    io_context context_;
+    FastRandom random_;
+    steady_timer timer_;
+    Clock::duration interval_;
+    Clock::time_point nextSend_;
+    Clock::time_point stopAt_;
+    array<double, ServerStats::OPERATIONS> cumulative_{};
+    vector<unique_ptr<Connection>> connections_;
+    size_t nextConnection_ = 0;
+    Results results_;
+
+    void schedule() {
+        if (nextSend_ >= stopAt_) {
+            // Give the last requests their timeout, then whatever is left is lost
+            timer_.expires_at(stopAt_ + options_.timeout);
+            timer_.async_wait([this](const boost::system::error_code &) {
+                for (auto &connection : connections_) {
+                    results_.lost += connection->outstanding.size();
+                    connection->socket.close();
+                }
+            });
+            return;
+        }
+        timer_.expires_at(nextSend_);
+        timer_.async_wait([this](const boost::system::error_code &ec) {
+            if (ec) return;
+            // Catch up on every send that came due, however late the timer fired
+            auto now = Clock::now();
+            while (nextSend_ <= now && nextSend_ < stopAt_) {
+                Connection &connection = *connections_[nextConnection_];
+                nextConnection_ = (nextConnection_ + 1) % connections_.size();
+                send(connection, nextSend_);
+                nextSend_ += interval_;
+            }
+            schedule();
+        });
+    }
+
+    Operation pickOperation() {
+        double draw = random_.nextDouble() * cumulative_.back();
+        size_t op = 1;
+        while (op + 1 < cumulative_.size() && cumulative_[op] <= draw) ++op;
+        return static_cast<Operation>(op);
+    }
+
+    void send(Connection &connection, Clock::time_point scheduled) {
+        RequestMessage request;
+        request.requestId = connection.nextRequestId++;
+        request.operation = pickOperation();
+        size_t facility = random_.next() % FACILITIES.size();
+        request.day = static_cast<Util::Day>(random_.next() % 5);
+        int slot = static_cast<int>(random_.next() % SLOTS_PER_DAY);
+        request.startTime = static_cast<uint16_t>(Util::toHHMM(8 * 60 + slot * 30));
+        request.endTime = static_cast<uint16_t>(Util::toHHMM(8 * 60 + slot * 30 + 30));
+
+        bool needsBooking = request.operation == Operation::CHANGE ||
+                            request.operation == Operation::EXTEND ||
+                            request.operation == Operation::CANCEL;
+        if (needsBooking && connection.bookings.empty()) {
+            request.operation = Operation::BOOK;  // nothing to work on yet
+        } else if (needsBooking) {
+            size_t index = random_.next() % connection.bookings.size();
+            Booking booking = connection.bookings[index];
+            facility = booking.facility;
+            request.bookingId = booking.id;
+            if (request.operation == Operation::CANCEL) {
+                connection.bookings[index] = connection.bookings.back();
+                connection.bookings.pop_back();
+            } else {
+                request.offsetMinutes =
+                    request.operation == Operation::EXTEND ? 30 : (random_.next() & 1 ? 30 : -30);
+            }
+        } else if (request.operation == Operation::MONITOR) {
+            request.monitorInterval = MONITOR_SECONDS;
+        }
+        request.facilityName = FACILITIES[facility];
+
+        connection.socket.send_to(buffer(request.marshal()), server_);
+        connection.outstanding[request.requestId] = {scheduled, request.operation, facility};
+        ++results_.sent;
+    }
+
+    void receive(Connection &connection) {
+        connection.socket.async_receive_from(
+            buffer(connection.buffer), connection.sender,
+            [this, &connection](const boost::system::error_code &ec, size_t bytes) {
+                if (ec) return;  // closed at the end of the run
+                handleReply(connection, bytes);
+                receive(connection);
+            });
+    }
+
+    void handleReply(Connection &connection, size_t bytes) {
+        auto now = Clock::now();
+        ResponseMessage response;
+        try {
+            response = ResponseMessage::unmarshal(vector<uint8_t>(
+                connection.buffer.begin(), connection.buffer.begin() + bytes));
+        } catch (const exception &) {
+            ++results_.notifications;  // binary monitor deltas do not parse as replies
+            return;
+        }
+        auto it = connection.outstanding.find(response.requestId);
+        if (it == connection.outstanding.end()) {
+            ++results_.notifications;
+            return;
+        }
+        Outstanding request = it->second;
+        connection.outstanding.erase(it);
+
+        auto latency = now - request.scheduled;
+        if (latency > options_.timeout) {
+            ++results_.lost;
+            return;
+        }
+        auto nanos = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        results_.latency[static_cast<size_t>(request.operation)].record(nanos);
+        results_.all.record(nanos);
+        ++results_.answered;
+        if (response.status == 1) ++results_.failed;
+
+        if (request.operation == Operation::BOOK && response.status == 0) {
+            const string marker = "Booking ID: ";
+            size_t at = response.message.find(marker);
+            if (at != string::npos) {
+                connection.bookings.push_back(
+                    {request.facility,
+                     static_cast<uint32_t>(stoul(response.message.substr(at + marker.size())))});
+            }
+        }
+    }
+};
+
+void printLine(const string &label, const LatencyHistogram &h) {
+    auto us = [](uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+    cout << left << setw(8) << label << right << setw(9) << h.count() << setw(10)
+         << us(h.percentile(50)) << setw(10) << us(h.percentile(99)) << setw(10)
+         << us(h.percentile(99.9)) << setw(10) << us(h.max()) << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    Options options;
+    parseMix("query=50,book=20,change=10,extend=5,cancel=10,monitor=5", options.mix);
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--server" && i + 1 < argc) {
+            options.server = argv[++i];
+        } else if (arg == "--rate" && i + 1 < argc) {
+            options.rate = stod(argv[++i]);
+        } else if (arg == "--duration" && i + 1 < argc) {
+            options.durationSeconds = stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = max(1, stoi(argv[++i]));
+        } else if (arg == "--sockets" && i + 1 < argc) {
+            options.socketsPerThread = max(1, stoi(argv[++i]));
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            options.timeout = std::chrono::milliseconds(stoi(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = stoull(argv[++i]);
+        } else if (arg == "--mix" && i + 1 < argc && parseMix(argv[i + 1], options.mix)) {
+            ++i;
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--server host:port] [--rate <requests/s>] [--duration <s>]"
+                    " [--threads <n>] [--sockets <per thread>] [--timeout <ms>] [--seed <n>]"
+                    " [--mix query=50,book=20,change=10,extend=5,cancel=10,monitor=5]"
+                 << endl;
+            return 1;
+        }
+    }
+
+    size_t colon = options.server.rfind(':');
+    if (colon == string::npos || options.rate <= 0) {
+        cerr << "Expected --server host:port and a positive --rate" << endl;
+        return 1;
+    }
+    io_context resolverContext;
+    udp::resolver resolver(resolverContext);
+    udp::endpoint server = *resolver
+                                .resolve(udp::v4(), options.server.substr(0, colon),
+                                         options.server.substr(colon + 1))
+                                .begin();
+
+    // Start slightly in the future so every worker is ready before its first send; the workers'
+    // schedules are staggered so together they send evenly
+    auto start = Clock::now() + std::chrono::milliseconds(50);
+    auto stagger = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1 / options.rate));
+    vector<unique_ptr<Worker>> workers;
+    for (int t = 0; t < options.threads; ++t) {
+        workers.push_back(
+            make_unique<Worker>(options, server, options.seed + t, start + t * stagger));
+    }
+    vector<thread> threads;
+    for (auto &worker : workers) threads.emplace_back([&worker]() { worker->run(); });
+    for (auto &thread : threads) thread.join();
+
+    Results total;
+    for (const auto &worker : workers) total.merge(worker->results());
+
+    cout << fixed << setprecision(1);
+    cout << "Offered " << options.rate << " requests/s for " << options.durationSeconds
+         << " s from " << options.threads << " thread(s) x " << options.socketsPerThread
+         << " socket(s) to " << server << "\n";
+    cout << "Sent " << total.sent << ", answered " << total.answered << ", lost " << total.lost
+         << " (" << (total.sent ? 100.0 * total.lost / total.sent : 0.0) << "%), failed "
+         << total.failed << ", notifications " << total.notifications << "\n";
+    cout << "Throughput " << total.answered / static_cast<double>(options.durationSeconds)
+         << " replies/s\n";
+    cout << left << setw(8) << "us" << right << setw(9) << "count" << setw(10) << "p50"
+         << setw(10) << "p99" << setw(10) << "p99.9" << setw(10) << "max" << "\n";
+    printLine("ALL", total.all);
+    for (size_t op = 1; op < ServerStats::OPERATIONS; ++op) {
+        if (total.latency[op].count() > 0) {
+            printLine(ServerStats::operationName(op), total.latency[op]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+// Simulation run: many clients against one server in virtual time, no sockets or timers.
+//
+//   ./booking_sim [--clients <n>] [--requests <n>] [--facilities <n>] [--in <policy>]
+//                 [--out <policy>] [--retry <ms>] [--seed <n>] [--at-least-once]
+//
+// --in and --out take the same LinkPolicy strings as the server's --net-in and --net-out, e.g.
+// "drop=0.1,dup=0.05,delay=2,jitter=1". The same arguments always give the same run. Prints the
+// counts, the server's own CPU cost per datagram and the consistency checks (see Simulation.h);
+// exits 1 if a check fails.
+#include <iostream>
+#include <string>
+#include "Logger.h"
+#include "Simulation.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    SimulationConfig config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "--clients" && i + 1 < argc) {
+                config.clients = stoul(argv[++i]);
+            } else if (arg == "--requests" && i + 1 < argc) {
+                config.requests = stoull(argv[++i]);
+            } else if (arg == "--facilities" && i + 1 < argc) {
+                config.facilities = stoul(argv[++i]);
+            } else if (arg == "--in" && i + 1 < argc) {
+                config.toServer = LinkPolicy::parse(argv[++i]);
+            } else if (arg == "--out" && i + 1 < argc) {
+                config.toClients = LinkPolicy::parse(argv[++i]);
+            } else if (arg == "--retry" && i + 1 < argc) {
+                config.retryTimeout = std::chrono::milliseconds(stoi(argv[++i]));
+            } else if (arg == "--seed" && i + 1 < argc) {
+                config.seed = stoull(argv[++i]);
+            } else if (arg == "--at-least-once") {
+                config.atLeastOnce = true;
+            } else {
+                cerr << "Unknown argument " << arg << endl;
+                return 1;
+            }
+        }
+        if (config.clients == 0 || config.facilities == 0) {
+            throw runtime_error("--clients and --facilities must be at least 1");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    Logger::instance().setLevel(LogLevel::Warn);
+    cout << config.clients << " clients, " << config.requests << " requests, "
+         << config.facilities << " facilities, seed " << config.seed << ", "
+         << (config.atLeastOnce ? "at-least-once" : "at-most-once") << "\n";
+    SimulationReport report = Simulation::run(config);
+    cout << report.format();
+    return report.consistent() ? 0 : 1;
+}
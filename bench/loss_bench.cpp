@@ -0,0 +1,159 @@
+// Loss benchmark: at-most-once vs at-least-once throughput through the network emulator.
+//
+//   ./loss_bench [operations] [seed]
+//
+// One server per run on localhost, with the same seeded loss applied to requests and replies,
+// so two runs with the same arguments see the same faults. The client retransmits after a
+// timeout until the reply for its request id arrives, like the Java client does.
+#include <boost/asio.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <regex>
+#include <thread>
+#include <vector>
+#include "Logger.h"
+#include "NetworkEmulator.h"
+#include "UdpServer.h"
+
+using namespace std;
+using namespace boost::asio;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const auto RETRY_TIMEOUT = std::chrono::milliseconds(20);
+
+unordered_map<string, Facility> benchFacilities() {
+    unordered_map<string, Facility> facilities;
+    facilities.emplace("Bench", Facility("Bench"));
+    for (int slot = Facility::OPENING.slot(); slot < Facility::CLOSING.slot(); ++slot) {
+        facilities.at("Bench").addAvailability(Facility::TimeSlot(
+            Util::Day::Monday, TimeOfDay::ofSlot(slot), TimeOfDay::ofSlot(slot + 1)));
+    }
+    return facilities;
+}
+
+class RetryingClient {
+  public:
+    explicit RetryingClient(const udp::endpoint &server)
+        : socket_(context_, udp::endpoint(udp::v4(), 0)), server_(server) {}
+
+    // Retransmits until the matching reply arrives; stale and duplicated replies are skipped
+    ResponseMessage call(const RequestMessage &request) {
+        vector<uint8_t> data = request.marshal();
+        ++calls_;
+        for (;;) {
+            socket_.send_to(buffer(data), server_);
+            ++transmissions_;
+            auto deadline = Clock::now() + RETRY_TIMEOUT;
+            while (auto reply = receiveUntil(deadline)) {
+                if (reply->requestId == request.requestId) return *reply;
+            }
+        }
+    }
+
+    uint64_t calls() const { return calls_; }
+    uint64_t transmissions() const { return transmissions_; }
+
+  private:
+    io_context context_;
+    udp::socket socket_;
+    udp::endpoint server_;
+    array<uint8_t, 1024> buffer_{};
+    uint64_t calls_ = 0;
+    uint64_t transmissions_ = 0;
+
+    optional<ResponseMessage> receiveUntil(Clock::time_point deadline) {
+        size_t received = 0;
+        udp::endpoint sender;
+        socket_.async_receive_from(buffer(buffer_), sender,
+                                   [&](const boost::system::error_code &ec, size_t bytes) {
+                                       if (!ec) received = bytes;
+                                   });
+        context_.restart();
+        context_.run_until(deadline);
+        if (!context_.stopped()) {
+            socket_.cancel();  // timed out; let the cancelled handler run
+            context_.restart();
+            context_.run();
+        }
+        if (received == 0) return nullopt;
+        return ResponseMessage::unmarshal(
+            vector<uint8_t>(buffer_.begin(), buffer_.begin() + received));
+    }
+};
+
+struct RunResult {
+    double opsPerSecond;  // completed request/reply exchanges
+    double transmissionsPerOp;
+    int lostBookings;  // BOOK replies without an ID: a retry that hit the first attempt's booking,
+                       // which then stays booked, so later BOOKs fail too (and skip the CANCEL)
+};
+
+// Closed-loop BOOK/CANCEL pairs
+RunResult run(int operations, bool atLeastOnce, const LinkPolicy &policy, uint64_t seed) {
+    io_context serverContext;
+    UDPServer server(serverContext, 9410, benchFacilities(), atLeastOnce);
+    server.emulateNetwork(policy, policy, seed);
+    thread serverThread([&]() { serverContext.run(); });
+
+    RetryingClient client(udp::endpoint(ip::make_address("127.0.0.1"), 9410));
+    regex bookingIdPattern(R"(Booking ID:\s*(\d+))");
+    RequestMessage request;
+    request.facilityName = "Bench";
+    request.day = Util::Day::Monday;
+    request.startTime = 800;
+    request.endTime = 830;
+
+    int lostBookings = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < operations / 2; ++i) {
+        request.requestId = 2 * i;
+        request.operation = Operation::BOOK;
+        request.bookingId.reset();
+        ResponseMessage booked = client.call(request);
+
+        smatch match;
+        if (!regex_search(booked.message, match, bookingIdPattern)) {
+            ++lostBookings;
+            continue;
+        }
+        request.requestId = 2 * i + 1;
+        request.operation = Operation::CANCEL;
+        request.bookingId = stoul(match[1]);
+        client.call(request);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    serverContext.stop();
+    serverThread.join();
+    double calls = static_cast<double>(client.calls());
+    return {calls / seconds, static_cast<double>(client.transmissions()) / calls, lostBookings};
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int operations = argc > 1 ? stoi(argv[1]) : 2000;
+    uint64_t seed = argc > 2 ? stoull(argv[2]) : 1;
+
+    Logger::instance().setLevel(LogLevel::Warn);
+    cout << fixed << setprecision(2);
+    cout << operations << " closed-loop BOOK/CANCEL requests, seed " << seed << ", retry after "
+         << RETRY_TIMEOUT.count() << " ms\n"
+         << "loss   semantics       ops/s  sends/op  lost bookings\n";
+    for (double loss : {0.0, 0.01, 0.05, 0.1}) {
+        LinkPolicy policy;
+        policy.dropRate = loss;
+        for (bool atLeastOnce : {false, true}) {
+            RunResult result = run(operations, atLeastOnce, policy, seed);
+            cout << setprecision(0) << setw(3) << loss * 100 << "%   " << left << setw(13)
+                 << (atLeastOnce ? "at-least-once" : "at-most-once") << right << setw(8)
+                 << result.opsPerSecond << setprecision(2) << setw(10)
+                 << result.transmissionsPerOp << setw(15) << result.lostBookings << "\n";
+        }
+    }
+    return 0;
+}
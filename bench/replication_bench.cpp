@@ -0,0 +1,177 @@
+// Replication benchmark: primary throughput with and without a backup, and replication lag.
+//
+//   ./replication_bench [operations]
+//
+// Everything runs in one process on localhost, each server on its own event-loop thread.
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <thread>
+#include <vector>
+#include "Logger.h"
+#include "Replication.h"
+#include "UdpServer.h"
+
+using namespace std;
+using namespace boost::asio;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+unordered_map<string, Facility> benchFacilities() {
+    unordered_map<string, Facility> facilities;
+    facilities.emplace("Bench", Facility("Bench"));
+    for (int slot = Facility::OPENING.slot(); slot < Facility::CLOSING.slot(); ++slot) {
+        facilities.at("Bench").addAvailability(Facility::TimeSlot(
+            Util::Day::Monday, TimeOfDay::ofSlot(slot), TimeOfDay::ofSlot(slot + 1)));
+    }
+    return facilities;
+}
+
+ResponseMessage roundTrip(udp::socket &socket, const RequestMessage &request,
+                          const udp::endpoint &server) {
+    array<uint8_t, 1024> buffer{};
+    udp::endpoint sender;
+    socket.send_to(boost::asio::buffer(request.marshal()), server);
+    size_t len = socket.receive_from(boost::asio::buffer(buffer), sender);
+    return ResponseMessage::unmarshal(vector<uint8_t>(buffer.begin(), buffer.begin() + len));
+}
+
+// Closed-loop BOOK/CANCEL pairs against a primary; returns operations per second
+double primaryThroughput(int operations, bool withBackup) {
+    io_context primaryContext, backupContext;
+    UDPServer primary(primaryContext, 9400, benchFacilities(), false);
+    unique_ptr<UDPServer> backup;
+    if (withBackup) {
+        backup = make_unique<UDPServer>(backupContext, 9401, benchFacilities(), false);
+        backup->runAsBackup(9402, std::chrono::seconds(10));
+        primary.replicateTo({udp::endpoint(ip::make_address("127.0.0.1"), 9402)});
+    }
+    thread primaryThread([&]() { primaryContext.run(); });
+    thread backupThread([&]() { backupContext.run(); });
+
+    io_context clientContext;
+    udp::socket socket(clientContext, udp::endpoint(udp::v4(), 0));
+    udp::endpoint server(ip::make_address("127.0.0.1"), 9400);
+    regex bookingIdPattern(R"(Booking ID:\s*(\d+))");
+
+    RequestMessage request;
+    request.facilityName = "Bench";
+    request.day = Util::Day::Monday;
+    request.startTime = 800;
+    request.endTime = 830;
+
+    auto start = Clock::now();
+    for (int i = 0; i < operations / 2; ++i) {
+        request.requestId = 2 * i;
+        request.operation = Operation::BOOK;
+        request.bookingId.reset();
+        ResponseMessage booked = roundTrip(socket, request, server);
+
+        smatch match;
+        if (!regex_search(booked.message, match, bookingIdPattern)) {
+            throw runtime_error("Unexpected reply: " + booked.message);
+        }
+        request.requestId = 2 * i + 1;
+        request.operation = Operation::CANCEL;
+        request.bookingId = stoul(match[1]);
+        roundTrip(socket, request, server);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    primaryContext.stop();
+    backupContext.stop();
+    primaryThread.join();
+    backupThread.join();
+    return (operations / 2 * 2) / seconds;
+}
+
+struct LagResult {
+    double p50Us, p99Us, maxUs;
+};
+
+// Primary and backup replicators alone, fed in bursts; lag is replicate() to apply
+LagResult replicationLag(int records, int burst) {
+    io_context primaryContext, backupContext;
+    vector<atomic<int64_t>> sentAt(records + 1);
+    vector<double> lagUs;
+    lagUs.reserve(records);
+    atomic<int> applied{0};
+
+    ReplicationBackup backup(
+        backupContext, 9403, 0,
+        [&](const WalRecord &record) {
+            auto now = Clock::now().time_since_epoch().count();
+            lagUs.push_back((now - sentAt[record.lsn].load()) / 1000.0);
+            ++applied;
+        },
+        []() {}, std::chrono::seconds(10));
+    ReplicationPrimary primary(primaryContext,
+                               {udp::endpoint(ip::make_address("127.0.0.1"), 9403)}, 0, nullptr);
+
+    WalRecord record;
+    record.operation = Operation::BOOK;
+    record.facilityName = "Bench";
+    record.startTime = 800;
+    record.endTime = 830;
+
+    steady_timer pacer(primaryContext);
+    uint64_t next = 1;
+    function<void()> sendBurst = [&]() {
+        for (int i = 0; i < burst && next <= static_cast<uint64_t>(records); ++i, ++next) {
+            record.lsn = next;
+            record.bookingId = static_cast<uint32_t>(next);
+            sentAt[next] = Clock::now().time_since_epoch().count();
+            primary.replicate(record);
+        }
+        if (next <= static_cast<uint64_t>(records)) {
+            pacer.expires_after(std::chrono::milliseconds(1));
+            pacer.async_wait([&](const boost::system::error_code &ec) {
+                if (!ec) sendBurst();
+            });
+        }
+    };
+    post(primaryContext, sendBurst);
+
+    thread primaryThread([&]() { primaryContext.run(); });
+    thread backupThread([&]() { backupContext.run(); });
+    while (applied < records) this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    post(primaryContext, [&]() { primary.stop(); });
+    post(backupContext, [&]() { backup.stop(); });
+    primaryThread.join();
+    backupThread.join();
+
+    sort(lagUs.begin(), lagUs.end());
+    return {lagUs[lagUs.size() / 2], lagUs[lagUs.size() * 99 / 100], lagUs.back()};
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int operations = argc > 1 ? stoi(argv[1]) : 4000;
+
+    // The servers log per request; keep that out of the measurement
+    Logger::instance().setLevel(LogLevel::Warn);
+    double standalone = primaryThroughput(operations, false);
+    double replicated = primaryThroughput(operations, true);
+    LagResult idle = replicationLag(operations, 1);
+    LagResult loaded = replicationLag(operations, 64);
+
+    cout << fixed << setprecision(1);
+    cout << "Primary throughput (" << operations << " closed-loop BOOK/CANCEL requests)\n"
+         << "  standalone:      " << standalone << " ops/s\n"
+         << "  with one backup: " << replicated << " ops/s ("
+         << 100.0 * (standalone - replicated) / standalone << "% overhead)\n";
+    cout << "Replication lag, replicate() to applied on the backup (" << operations
+         << " records)\n"
+         << "  1 record/ms:   p50 " << idle.p50Us << " us, p99 " << idle.p99Us << " us, max "
+         << idle.maxUs << " us\n"
+         << "  64 records/ms: p50 " << loaded.p50Us << " us, p99 " << loaded.p99Us
+         << " us, max " << loaded.maxUs << " us\n";
+    return 0;
+}
@@ -0,0 +1,333 @@
+// Trace replay: re-sends a captured trace (booking_system_server --capture) against a server and
+// checks that every reply matches the captured one.
+//
+//   ./trace_replay <trace> [--server host:port] [--speed <factor> | --max [--window <n>]]
+//                  [--timeout <ms>]
+//
+// Each client in the trace gets its own socket. --speed 1 (the default) keeps the captured
+// timing, 2 replays twice as fast. --max sends in captured order as fast as the server answers,
+// with up to --window requests in flight. The server processes one request at a time in arrival
+// order, so both modes keep each client's order and, as far as the socket allows, the order
+// between clients. Start the server from the state the captured one had (same facilities, no WAL)
+// and the replies come out byte for byte the same; STATS replies are not compared. Compact
+// (version 2) requests are matched to their replies through the client's HELLO in the trace.
+// Version 4 session tokens differ from run to run: the replayed requests carry the token the
+// replayed HELLO got, and HELLO replies with a token are not compared.
+// Exits 1 if a reply differs or is missing.
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <vector>
+#include "Message.h"
+#include "Stats.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace boost::asio;
+using boost::asio::ip::udp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const size_t MAX_REPORTED_DIFFERENCES = 5;
+const auto SWEEP_INTERVAL = std::chrono::milliseconds(10);
+
+using Key = pair<size_t, uint32_t>;  // client index, request ID
+
+uint32_t requestIdOf(const vector<uint8_t> &datagram) {
+    if (datagram.size() < 4) return 0;
+    return (uint32_t{datagram[0]} << 24) | (uint32_t{datagram[1]} << 16) |
+           (uint32_t{datagram[2]} << 8) | datagram[3];
+}
+
+struct Request {
+    uint64_t timestampUs;
+    size_t client;
+    uint32_t requestId;
+    vector<uint8_t> datagram;
+    uint64_t sessionToken;  // the captured one, 0 if the request carries none
+};
+
+optional<uint64_t> sessionTokenOf(const vector<uint8_t> &helloReply) {
+    try {
+        return HelloReply::unmarshal(ResponseMessage::unmarshal(helloReply).message).sessionToken;
+    } catch (const exception &) {
+        return nullopt;
+    }
+}
+
+class Replay {
+  public:
+    Replay(const string &tracePath, const udp::endpoint &server, double speed, size_t window,
+           std::chrono::milliseconds timeout)
+        : server_(server), speed_(speed), window_(window), timeout_(timeout), timer_(context_) {
+        TraceReader reader(tracePath);
+        map<udp::endpoint, size_t> clientIndex;
+        map<size_t, uint32_t> helloIds;  // per client, for compact requests
+        map<uint64_t, uint32_t> tokenHelloIds;  // per session, for those that carry a token
+        TraceRecord record;
+        while (reader.next(record)) {
+            auto [it, added] = clientIndex.emplace(record.client, clientIndex.size());
+            if (added) clients_.push_back(make_unique<Client>(context_));
+            Key key{it->second, requestIdOf(record.datagram)};
+            if (record.kind == TraceRecord::Kind::Request) {
+                Operation operation = static_cast<Operation>(
+                    record.datagram.size() > 4 ? record.datagram[4] : 0);
+                uint64_t sessionToken = 0;
+                if (CompactRequest::matches(record.datagram)) {
+                    CompactRequest compact = CompactRequest::unmarshal(record.datagram);
+                    sessionToken = compact.sessionToken;
+                    key.second = (sessionToken != 0 ? tokenHelloIds[sessionToken]
+                                                    : helloIds[it->second]) +
+                                 compact.requestIdDelta;
+                    operation = compact.operation;
+                } else if (operation == Operation::HELLO) {
+                    helloIds[it->second] = key.second;
+                    helloKeys_.insert(key);
+                }
+                if (operation == Operation::STATS) notCompared_.insert(key);
+                requests_.push_back({record.timestampUs, it->second, key.second,
+                                     std::move(record.datagram), sessionToken});
+            } else {
+                if (helloKeys_.count(key)) {
+                    if (auto token = sessionTokenOf(record.datagram)) {
+                        tokenHelloIds[*token] = key.second;
+                        notCompared_.insert(key);
+                    }
+                }
+                expected_.emplace(key, std::move(record.datagram));  // keeps the first reply
+            }
+        }
+        for (size_t i = 0; i < clients_.size(); ++i) receive(i);
+    }
+
+    int run() {
+        cout << "Replaying " << requests_.size() << " requests from " << clients_.size()
+             << " client(s) to " << server_ << ", ";
+        if (speed_ > 0) {
+            cout << speed_ << "x the captured speed\n";
+        } else {
+            cout << "as fast as possible, window " << window_ << "\n";
+        }
+        started_ = Clock::now();
+        pump();
+        context_.run();
+        return report();
+    }
+
+  private:
+    struct Client {
+        explicit Client(io_context &context) : socket(context, udp::endpoint(udp::v4(), 0)) {}
+        udp::socket socket;
+        array<uint8_t, 1024> buffer{};
+        udp::endpoint sender;
+    };
+
+    io_context context_;
+    udp::endpoint server_;
+    double speed_;  // 0 = as fast as possible
+    size_t window_;
+    std::chrono::milliseconds timeout_;
+    steady_timer timer_;
+    vector<unique_ptr<Client>> clients_;
+    vector<Request> requests_;
+    map<Key, vector<uint8_t>> expected_;  // first captured reply per request
+    map<Key, vector<uint8_t>> actual_;    // first replayed reply per request
+    set<Key> notCompared_;
+    set<Key> helloKeys_;
+    map<uint64_t, uint64_t> sessionTokens_;  // captured token -> replayed one
+    map<Key, Clock::time_point> outstanding_;  // sent, no reply yet
+    size_t next_ = 0;
+    Clock::time_point started_;
+    Clock::time_point finished_;
+    LatencyHistogram latency_;
+    uint64_t timedOut_ = 0;
+    uint64_t unmatched_ = 0;  // notifications and replies to retries
+
+    Clock::time_point dueAt(const Request &request) const {
+        std::chrono::duration<double, std::micro> offset(request.timestampUs / speed_);
+        return started_ + std::chrono::duration_cast<Clock::duration>(offset);
+    }
+
+    void send(const Request &request) {
+        auto token = sessionTokens_.find(request.sessionToken);
+        if (request.sessionToken != 0 && token != sessionTokens_.end()) {
+            vector<uint8_t> datagram = request.datagram;
+            for (int i = 0; i < 8; ++i) {  // after the magic and version bytes
+                datagram[2 + i] = static_cast<uint8_t>(token->second >> (56 - 8 * i));
+            }
+            clients_[request.client]->socket.send_to(buffer(datagram), server_);
+        } else {
+            clients_[request.client]->socket.send_to(buffer(request.datagram), server_);
+        }
+        outstanding_[{request.client, request.requestId}] = Clock::now();
+    }
+
+    // Sends whatever may go out now, then waits for the next due time, a reply or the sweep
+    void pump() {
+        auto now = Clock::now();
+        while (next_ < requests_.size()) {
+            const Request &request = requests_[next_];
+            if (speed_ > 0 ? dueAt(request) > now : outstanding_.size() >= window_) break;
+            send(request);
+            ++next_;
+        }
+        if (next_ == requests_.size() && outstanding_.empty()) {
+            finish();
+            return;
+        }
+        auto wakeAt = now + SWEEP_INTERVAL;
+        if (speed_ > 0 && next_ < requests_.size()) wakeAt = min(wakeAt, dueAt(requests_[next_]));
+        timer_.expires_at(wakeAt);
+        timer_.async_wait([this](const boost::system::error_code &ec) {
+            if (ec) return;
+            expireOutstanding();
+            pump();
+        });
+    }
+
+    void expireOutstanding() {
+        auto now = Clock::now();
+        for (auto it = outstanding_.begin(); it != outstanding_.end();) {
+            if (now - it->second > timeout_) {
+                ++timedOut_;
+                it = outstanding_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void finish() {
+        finished_ = Clock::now();
+        timer_.cancel();
+        for (auto &client : clients_) client->socket.close();
+    }
+
+    void receive(size_t index) {
+        Client &client = *clients_[index];
+        client.socket.async_receive_from(
+            buffer(client.buffer), client.sender,
+            [this, index](const boost::system::error_code &ec, size_t bytes) {
+                if (ec) return;  // closed when the replay is done
+                Client &client = *clients_[index];
+                vector<uint8_t> reply(client.buffer.begin(), client.buffer.begin() + bytes);
+                Key key{index, requestIdOf(reply)};
+                auto it = outstanding_.find(key);
+                if (it == outstanding_.end()) {
+                    ++unmatched_;
+                } else {
+                    latency_.record(static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                             it->second)
+                            .count()));
+                    outstanding_.erase(it);
+                    auto captured = expected_.find(key);
+                    if (helloKeys_.count(key) && captured != expected_.end()) {
+                        auto before = sessionTokenOf(captured->second);
+                        auto replayed = sessionTokenOf(reply);
+                        if (before && replayed) sessionTokens_[*before] = *replayed;
+                    }
+                    actual_.emplace(key, std::move(reply));
+                    if (speed_ == 0) pump();
+                }
+                receive(index);
+            });
+    }
+
+    static string describe(const vector<uint8_t> &reply) {
+        try {
+            ResponseMessage response = ResponseMessage::unmarshal(reply);
+            return "status " + to_string(response.status) + ": " +
+                   response.message.substr(0, response.message.find('\n'));
+        } catch (const exception &) {
+            return to_string(reply.size()) + " undecodable bytes";
+        }
+    }
+
+    int report() {
+        size_t same = 0, different = 0, missing = 0, notCaptured = 0;
+        for (const auto &[key, reply] : expected_) {
+            if (notCompared_.count(key)) continue;
+            auto it = actual_.find(key);
+            if (it == actual_.end()) {
+                ++missing;
+            } else if (it->second == reply) {
+                ++same;
+            } else if (++different <= MAX_REPORTED_DIFFERENCES) {
+                cout << "  client " << key.first << " request " << key.second << "\n"
+                     << "    captured " << describe(reply) << "\n"
+                     << "    replayed " << describe(it->second) << "\n";
+            }
+        }
+        for (const auto &[key, reply] : actual_) notCaptured += expected_.count(key) == 0;
+
+        double seconds = std::chrono::duration<double>(finished_ - started_).count();
+        auto us = [](uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+        cout << fixed << setprecision(1);
+        cout << "Sent " << requests_.size() << " in " << seconds << " s ("
+             << requests_.size() / seconds << " requests/s), " << timedOut_
+             << " without a reply, " << unmatched_ << " other datagrams\n";
+        cout << "Latency us: p50 " << us(latency_.percentile(50)) << ", p99 "
+             << us(latency_.percentile(99)) << ", p99.9 " << us(latency_.percentile(99.9))
+             << ", max " << us(latency_.max()) << "\n";
+        cout << "Replies: " << same << " identical, " << different << " different, " << missing
+             << " missing, " << notCaptured << " not in the capture\n";
+        return different > 0 || missing > 0 ? 1 : 0;
+    }
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0]
+             << " <trace> [--server host:port] [--speed <factor> | --max [--window <n>]]"
+                " [--timeout <ms>]"
+             << endl;
+        return 1;
+    }
+    string tracePath = argv[1];
+    string serverAddress = "127.0.0.1:2222";
+    double speed = 1;
+    size_t window = 32;
+    std::chrono::milliseconds timeout{1000};
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--server" && i + 1 < argc) {
+            serverAddress = argv[++i];
+        } else if (arg == "--speed" && i + 1 < argc) {
+            speed = stod(argv[++i]);
+        } else if (arg == "--max") {
+            speed = 0;
+        } else if (arg == "--window" && i + 1 < argc) {
+            window = max(1, stoi(argv[++i]));
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            timeout = std::chrono::milliseconds(stoi(argv[++i]));
+        } else {
+            cerr << "Unknown argument " << arg << endl;
+            return 1;
+        }
+    }
+
+    try {
+        size_t colon = serverAddress.rfind(':');
+        if (colon == string::npos) throw runtime_error("Expected host:port for --server");
+        io_context resolverContext;
+        udp::resolver resolver(resolverContext);
+        udp::endpoint server = *resolver
+                                    .resolve(udp::v4(), serverAddress.substr(0, colon),
+                                             serverAddress.substr(colon + 1))
+                                    .begin();
+        return Replay(tracePath, server, max(speed, 0.0), window, timeout).run();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef BOOKING_CLIENT_H
+#define BOOKING_CLIENT_H
+
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Message.h"
+#include "TimerWheel.h"
+#include "Util.h"
+
+using boost::asio::ip::udp;
+
+/*
+Asynchronous client for the booking server, for services that embed it.
+
+One socket carries any number of outstanding requests and replies are matched to them by request
+ID, so nobody needs a thread per request. An unanswered request is sent again when its timeout
+runs out, up to maxAttempts times. The timeout follows the measured round trip (smoothed RTT plus
+four times its mean deviation, as in RFC 6298), doubles with every retransmission of the request
+and is scaled by a random jitter, so clients that lost the same burst do not retry in step. Round
+trips of retransmitted requests are not sampled, since the reply may answer either copy.
+
+Datagrams with request ID 0 are monitor notifications (text updates and DeltaMessages) and go to
+the notification handler. So does the booking a WAITLIST request gets later: it arrives under the
+ID of that request, which was already answered; a repeat of the answer itself is not passed on.
+Handlers run on the thread running the io_context; request() may be called from any thread.
+Requests go out in the version 1 format, one client per socket, with IDs counting up from 1.
+*/
+class BookingClient {
+  public:
+    struct Options {
+        std::chrono::milliseconds initialTimeout{200};  // until the first round trip is measured
+        std::chrono::milliseconds minTimeout{10};
+        std::chrono::milliseconds maxTimeout{3000};
+        unsigned maxAttempts = 6;
+        double jitter = 0.2;  // each timeout is scaled by a factor in [1 - jitter, 1 + jitter]
+        uint64_t seed = 0;    // for the jitter; 0 picks one at random
+    };
+
+    struct Counters {
+        uint64_t sent = 0;           // first transmissions
+        uint64_t retransmitted = 0;  // further ones
+        uint64_t answered = 0;
+        uint64_t timedOut = 0;       // gave up after maxAttempts
+        uint64_t notifications = 0;  // waitlist bookings included
+        uint64_t unmatched = 0;  // replies to requests already answered or given up on
+    };
+
+    // `error` is boost::asio::error::timed_out when every attempt went unanswered, and
+    // operation_aborted when the client was closed first
+    using ReplyHandler =
+        std::function<void(const boost::system::error_code &error, const ResponseMessage &reply)>;
+    using NotificationHandler = std::function<void(const ResponseMessage &notification)>;
+
+    BookingClient(boost::asio::io_context &io_context, const udp::endpoint &server);
+    BookingClient(boost::asio::io_context &io_context, const udp::endpoint &server,
+                  Options options);
+    ~BookingClient();
+
+    // Sends `request` under the next request ID, which replaces its own
+    void request(RequestMessage request, ReplyHandler onReply);
+    // Set before the first MONITOR or WAITLIST request
+    void onNotification(NotificationHandler handler) { onNotification_ = std::move(handler); }
+    // Fails every outstanding request; call on the io_context's thread or once it has stopped
+    void close();
+
+    // Read on the io_context's thread
+    std::chrono::microseconds timeout() const { return std::chrono::microseconds(timeoutUs_); }
+    const Counters &counters() const { return counters_; }
+    udp::endpoint localEndpoint() const { return socket_.local_endpoint(); }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        std::shared_ptr<const std::string> datagram;  // shared with the send in flight
+        ReplyHandler onReply;
+        Clock::time_point sentAt;
+        unsigned attempts;
+        Clock::time_point waitUntil;  // WAITLIST: until a booking may still be pushed for it
+    };
+    struct Waiting {
+        Clock::time_point until;
+        std::string answer;  // a copy of this is a retransmission's reply, not the booking
+    };
+    struct Retransmit {
+        uint32_t requestId;
+        unsigned attempt;  // the transmission this guards; later ones have their own
+    };
+
+    boost::asio::io_context &io_context_;
+    udp::socket socket_;
+    udp::endpoint server_;
+    Options options_;
+    FastRandom random_;
+    TimerWheel<Retransmit> retransmits_;
+    std::unordered_map<uint32_t, Pending> pending_;  // by request ID
+    std::unordered_map<uint32_t, Waiting> waiting_;  // answered WAITLIST requests, by request ID
+    uint32_t nextRequestId_ = 1;
+    NotificationHandler onNotification_;
+    Counters counters_;
+
+    // RFC 6298 estimator, in microseconds; srttUs_ is 0 until the first sample
+    int64_t srttUs_ = 0;
+    int64_t rttvarUs_ = 0;
+    int64_t timeoutUs_;
+
+    std::array<uint8_t, 1024> buffer_{};
+    udp::endpoint sender_;
+    bool closed_ = false;
+
+    static constexpr std::chrono::milliseconds WHEEL_TICK{5};
+    static constexpr size_t WHEEL_SLOTS = 1024;
+
+    void start(RequestMessage &request, ReplyHandler &onReply);
+    void transmit(uint32_t requestId, Pending &pending);
+    void retransmit(std::vector<Retransmit> &due);
+    void receive();
+    void handleReply(const ResponseMessage &reply);
+    void sampleRoundTrip(Clock::duration rtt);
+    std::chrono::milliseconds backoff(unsigned attempt);
+};
+
+#endif  // BOOKING_CLIENT_H
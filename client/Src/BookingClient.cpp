@@ -0,0 +1,163 @@
+#include "BookingClient.h"
+#include <algorithm>
+#include <random>
+
+BookingClient::BookingClient(boost::asio::io_context &io_context, const udp::endpoint &server)
+    : BookingClient(io_context, server, Options()) {}
+
+BookingClient::BookingClient(boost::asio::io_context &io_context, const udp::endpoint &server,
+                             Options options)
+    : io_context_(io_context),
+      socket_(io_context, udp::endpoint(udp::v4(), 0)),
+      server_(server),
+      options_(options),
+      random_(options.seed != 0 ? options.seed
+                                : uint64_t{std::random_device{}()} << 32 | std::random_device{}()),
+      retransmits_(io_context, WHEEL_TICK, WHEEL_SLOTS,
+                   [this](std::vector<Retransmit> &due) { retransmit(due); }),
+      timeoutUs_(std::chrono::microseconds(options.initialTimeout).count()) {
+    receive();
+}
+
+BookingClient::~BookingClient() { close(); }
+
+void BookingClient::request(RequestMessage request, ReplyHandler onReply) {
+    boost::asio::post(io_context_, [this, request = std::move(request),
+                                    onReply = std::move(onReply)]() mutable {
+        start(request, onReply);
+    });
+}
+
+void BookingClient::close() {
+    if (closed_) return;
+    closed_ = true;
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    retransmits_.stop();
+
+    auto pending = std::move(pending_);
+    pending_.clear();
+    ResponseMessage none{};
+    for (auto &[requestId, request] : pending) {
+        request.onReply(boost::asio::error::operation_aborted, none);
+    }
+}
+
+void BookingClient::start(RequestMessage &request, ReplyHandler &onReply) {
+    if (closed_) {
+        onReply(boost::asio::error::operation_aborted, ResponseMessage{});
+        return;
+    }
+    request.requestId = nextRequestId_++;
+    auto datagram = std::make_shared<std::string>();
+    request.marshal(*datagram);
+
+    Pending &pending = pending_[request.requestId];
+    pending.datagram = std::move(datagram);
+    pending.onReply = std::move(onReply);
+    pending.attempts = 0;
+    if (request.operation == Operation::WAITLIST) {
+        pending.waitUntil =
+            Clock::now() + std::chrono::seconds(request.monitorInterval.value_or(0));
+    }
+    ++counters_.sent;
+    transmit(request.requestId, pending);
+}
+
+void BookingClient::transmit(uint32_t requestId, Pending &pending) {
+    ++pending.attempts;
+    pending.sentAt = Clock::now();
+    socket_.async_send_to(boost::asio::buffer(*pending.datagram), server_,
+                          [datagram = pending.datagram](const boost::system::error_code &,
+                                                        size_t) {});  // a lost send is a timeout
+    retransmits_.schedule({requestId, pending.attempts}, backoff(pending.attempts));
+}
+
+// Timers are not cancelled when the reply comes; one that finds its request answered, or sent
+// again since, does nothing
+void BookingClient::retransmit(std::vector<Retransmit> &due) {
+    for (const auto &[requestId, attempt] : due) {
+        auto it = pending_.find(requestId);
+        if (it == pending_.end() || it->second.attempts != attempt) continue;
+        if (attempt < options_.maxAttempts) {
+            ++counters_.retransmitted;
+            transmit(requestId, it->second);
+            continue;
+        }
+        ReplyHandler onReply = std::move(it->second.onReply);
+        pending_.erase(it);
+        ++counters_.timedOut;
+        onReply(boost::asio::error::timed_out, ResponseMessage{});
+    }
+}
+
+void BookingClient::receive() {
+    socket_.async_receive_from(
+        boost::asio::buffer(buffer_), sender_,
+        [this](const boost::system::error_code &ec, size_t bytes) {
+            if (ec == boost::asio::error::operation_aborted || closed_) return;
+            if (!ec && sender_ == server_) {
+                try {
+                    handleReply(ResponseMessage::unmarshal(buffer_.data(), bytes));
+                } catch (const std::exception &) {
+                    // not a reply from this server's protocol; ignore it like any stray datagram
+                }
+            }
+            receive();
+        });
+}
+
+void BookingClient::handleReply(const ResponseMessage &reply) {
+    if (reply.requestId == 0) {
+        ++counters_.notifications;
+        if (onNotification_) onNotification_(reply);
+        return;
+    }
+    auto it = pending_.find(reply.requestId);
+    if (it == pending_.end()) {
+        auto waiting = waiting_.find(reply.requestId);
+        if (waiting != waiting_.end() && reply.message != waiting->second.answer) {
+            waiting_.erase(waiting);
+            ++counters_.notifications;
+            if (onNotification_) onNotification_(reply);
+            return;
+        }
+        ++counters_.unmatched;
+        return;
+    }
+    if (it->second.attempts == 1) sampleRoundTrip(Clock::now() - it->second.sentAt);
+    if (it->second.waitUntil != Clock::time_point{}) {
+        auto now = Clock::now();
+        std::erase_if(waiting_, [now](const auto &entry) { return entry.second.until <= now; });
+        waiting_[reply.requestId] = {it->second.waitUntil, reply.message};
+    }
+    ReplyHandler onReply = std::move(it->second.onReply);
+    pending_.erase(it);
+    ++counters_.answered;
+    onReply({}, reply);
+}
+
+void BookingClient::sampleRoundTrip(Clock::duration rtt) {
+    int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+    if (srttUs_ == 0) {
+        srttUs_ = std::max<int64_t>(sample, 1);
+        rttvarUs_ = sample / 2;
+    } else {
+        rttvarUs_ += (std::abs(srttUs_ - sample) - rttvarUs_) / 4;
+        srttUs_ += (sample - srttUs_) / 8;
+    }
+    timeoutUs_ = std::clamp<int64_t>(srttUs_ + 4 * rttvarUs_,
+                                     std::chrono::microseconds(options_.minTimeout).count(),
+                                     std::chrono::microseconds(options_.maxTimeout).count());
+}
+
+// The timeout for the `attempt`th transmission: doubled for each one before it, then jittered
+std::chrono::milliseconds BookingClient::backoff(unsigned attempt) {
+    int64_t maxUs = std::chrono::microseconds(options_.maxTimeout).count();
+    int64_t us = timeoutUs_;
+    for (unsigned i = 1; i < attempt && us < maxUs; ++i) us *= 2;
+    us = std::min(us, maxUs);
+    double factor = 1 + options_.jitter * (2 * random_.nextDouble() - 1);
+    return std::chrono::milliseconds(
+        std::max<int64_t>(1, static_cast<int64_t>(static_cast<double>(us) * factor / 1000)));
+}
@@ -5,29 +5,39 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include "TextWriter.h"
 #include "Util.h"
 #include <unordered_map>
 #include <optional>
 #include <sstream>
+#include <array>
+#include <atomic>
+#include <memory>
 
 class Facility {
   public:
     struct TimeSlot {
         Util::Day day;
-        uint16_t startTime;  // HHMM
-        uint16_t endTime;    // HHMM
+        TimeOfDay startTime;
+        TimeOfDay endTime;
 
-        TimeSlot(Util::Day d, uint16_t start, uint16_t end)
+        constexpr TimeSlot(Util::Day d, TimeOfDay start, TimeOfDay end)
             : day(d), startTime(start), endTime(end) {}
+        // From the HHMM times of a request, WAL record or snapshot
+        static constexpr TimeSlot fromHHMM(Util::Day d, int start, int end) {
+            return TimeSlot(d, TimeOfDay::fromHHMM(start), TimeOfDay::fromHHMM(end));
+        }
 
+        // "Tuesday 8:00 to 9:30"
+        void format(TextWriter &out) const {
+            out << Util::dayName(day) << ' ' << startTime.hour() << ':';
+            out.padded(startTime.minute(), 2) << " to " << endTime.hour() << ':';
+            out.padded(endTime.minute(), 2);
+        }
         std::string toString() const {
-            auto start = Util::parseTime(startTime);
-            auto end = Util::parseTime(endTime);
-
-            return Util::dayToString(day) + " " + std::to_string(start.first) + ":" +
-                   (start.second < 10 ? "0" : "") + std::to_string(start.second) + " to " +
-                   std::to_string(end.first) + ":" + (end.second < 10 ? "0" : "") +
-                   std::to_string(end.second);
+            TextBuffer<32> text;
+            format(text);
+            return text.str();
         }
 
         bool operator==(const TimeSlot &other) const {
@@ -44,23 +54,101 @@ class Facility {
     std::string getName() const;
 
     void addAvailability(const TimeSlot &slot);
+    void addAvailability(std::vector<TimeSlot> slots);  // one sort for the batch, none if in order
     bool isAvailable(const TimeSlot &slot) const;
+
+    // Bookings and changes stay within opening hours
+    static constexpr TimeOfDay OPENING = TimeOfDay(8 * 60);
+    static constexpr TimeOfDay CLOSING = TimeOfDay(18 * 60);
+
+    // Half-hour slot masks: bit i covers the half hour starting i * 30 minutes after midnight
+    static constexpr int SLOTS_PER_DAY = 48;
+    static constexpr uint64_t slotMask(TimeOfDay startTime, TimeOfDay endTime) {
+        int first = startTime.slot();
+        int last = (endTime + (TimeOfDay::MINUTES_PER_SLOT - 1)).slot();  // rounded up
+        if (last > SLOTS_PER_DAY) last = SLOTS_PER_DAY;
+        if (first >= last) return 0;
+        uint64_t upTo = (uint64_t{1} << last) - 1;
+        return upTo & ~((uint64_t{1} << first) - 1);
+    }
+
+    // Immutable published view of one day. A mutation prepares its result privately and then
+    // publishes a new DayState in one atomic store, so readers on any thread get a consistent
+    // version without a mutex and never see a change half applied.
+    struct DayState {
+        uint32_t version;        // bumped by every mutation of that day
+        uint64_t availableMask;  // same bit layout as slotMask
+    };
+    std::shared_ptr<const DayState> snapshot(Util::Day day) const;
+    uint64_t getAvailabilityMask(Util::Day day) const;
+    uint64_t getOpeningMask(Util::Day day) const;  // free or booked; writer side
+    uint32_t getDayVersion(Util::Day day) const;
     std::string getAvailability(Util::Day day) const;
+    void formatAvailability(Util::Day day, TextWriter &out) const;
     bool bookSlot(const TimeSlot &slot, uint32_t &bookingId);
-    bool modifyBooking(uint32_t bookingId, int offsetMinutes, std::string &errorMessage);
-    bool extendBooking(uint32_t bookingId, int extensionMinutes, std::string &errorMessage);
+    enum class ChangeResult : uint8_t { Done, InvalidBooking, InvalidRange, Unavailable };
+    ChangeResult modifyBooking(uint32_t bookingId, int offsetMinutes);
+    ChangeResult extendBooking(uint32_t bookingId, int extensionMinutes);
     std::optional<TimeSlot> cancelBooking(uint32_t bookingId);
+
+    // Replay an outcome decided earlier (WAL recovery) under its original booking ID
+    bool applyBooking(uint32_t bookingId, const TimeSlot &slot);
+    bool applyBookingChange(uint32_t bookingId, const TimeSlot &newSlot);
+
+    // Snapshot support: raw state export and bulk restore (slots already sorted, no re-sort)
+    const std::vector<TimeSlot> &getAvailableSlots() const;
+    const std::unordered_map<uint32_t, BookingInfo> &getBookings() const;
+    void restoreState(std::vector<TimeSlot> sortedSlots,
+                      std::unordered_map<uint32_t, BookingInfo> restoredBookings,
+                      const std::array<uint32_t, 7> &versions);
+    static uint32_t getNextBookingId();
+    static void reserveBookingIds(uint32_t next);  // never hand out IDs below `next`
+
     void displayAvailability(Util::Day day) const;
     void displayAllSlots(Util::Day day) const;
 
   private:
+    // atomic<shared_ptr> that is copied and moved along with its facility
+    class PublishedDay {
+      public:
+        PublishedDay() = default;
+        PublishedDay(const PublishedDay &other) : state(other.load()) {}
+        PublishedDay &operator=(const PublishedDay &other) {
+            store(other.load());
+            return *this;
+        }
+        std::shared_ptr<const DayState> load() const {
+            return state.load(std::memory_order_acquire);
+        }
+        void store(std::shared_ptr<const DayState> next) {
+            state.store(std::move(next), std::memory_order_release);
+        }
+
+      private:
+        std::atomic<std::shared_ptr<const DayState>> state;
+    };
+
+    // Writer-side state, touched only by the thread that mutates the facility
     std::string name;
     std::vector<TimeSlot> availableSlots;
     std::unordered_map<uint32_t, BookingInfo> bookings;  // Map of booking ID to booking info
+    std::array<uint32_t, 7> dayVersions{};
+    std::array<PublishedDay, 7> published;
 
-    uint32_t generateBookingId();  // Private method to generate unique booking IDs
+    void publish(Util::Day day);  // after availableSlots / dayVersions changed for that day
+    void publishAll();
+    uint64_t computeAvailabilityMask(Util::Day day) const;
+
+    static uint32_t nextBookingId;  // shared by all facilities
+    uint32_t generateBookingId();   // Private method to generate unique booking IDs
+    bool claimSlots(const TimeSlot &slot);  // remove the slots covering `slot` if all are free
+    void releaseSlots(const TimeSlot &slot);
     void sortAvailableSlots();
+    static bool isAvailableIn(const std::vector<TimeSlot> &slots, const TimeSlot &requested);
+    static bool slotBefore(const TimeSlot &a, const TimeSlot &b);
     std::vector<TimeSlot> splitIntoThirtyMinSlots(const TimeSlot &slot) const;
 };
 
+static_assert(Facility::slotMask(Facility::OPENING, Facility::OPENING + 45) == uint64_t{3} << 16);
+
 #endif
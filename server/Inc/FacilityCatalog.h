@@ -0,0 +1,39 @@
+#ifndef FACILITY_CATALOG_H
+#define FACILITY_CATALOG_H
+
+#include <string>
+#include <unordered_map>
+#include "Facility.h"
+
+/*
+Facility catalog file: one facility per line, '#' starts a comment.
+
+    <name>|<days> <HHMM>-<HHMM>[,<days> <HHMM>-<HHMM>...]
+    Tennis Court|Mon-Fri 0800-1800,Sat 1000-1400
+
+Days are Mon..Sun, either one day or an inclusive range. Opening hours are cut into the 30-minute
+slots the booking code works with, so they must start and end on a half hour, and lie within the
+Facility::OPENING..CLOSING day that queries and bookings are checked against.
+
+The file is streamed in batches of lines. Each facility's slots are generated in order and handed
+to the facility in one go, so nothing is re-sorted per slot; with more than one thread, the
+facilities of a batch are built in parallel and then moved into the map.
+*/
+class FacilityCatalog {
+  public:
+    // Facility name -> its opening-hours text, used to tell which facilities a reload changed
+    using Definition = std::unordered_map<std::string, std::string>;
+
+    static std::unordered_map<std::string, Facility> load(const std::string &path,
+                                                          unsigned threads = 1,
+                                                          Definition *definition = nullptr);
+
+    // Builds one facility from a catalog line; throws std::invalid_argument if it is malformed
+    static Facility parseLine(const std::string &line);
+    static std::string hoursOf(const std::string &line);  // the normalised text after '|'
+
+  private:
+    static constexpr size_t BATCH_LINES = 4096;
+};
+
+#endif  // FACILITY_CATALOG_H
@@ -0,0 +1,243 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/asio/ip/udp.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "SpscQueue.h"
+
+/*
+Asynchronous leveled logger.
+
+Every thread that logs gets its own SPSC ring of fixed-size binary records: a timestamp, the
+level, a pointer to the format string and the arguments packed as tagged values. Logging is a copy
+into that ring and never a system call; a background thread drains the rings, formats the lines and
+writes them out, so a request never waits on the terminal or a file. When a ring is full the record
+is dropped and counted instead of blocking.
+
+Format strings use "{}" for each argument and must be string literals (only the pointer is stored).
+Arguments may be numbers, bools, chars, strings and UDP endpoints; anything else does not compile.
+Numbers, chars and endpoints always fit; strings share what is left, in order. One that does not
+fit is cut short and ends in "…" (or is just "…"); later arguments still fill their own "{}".
+Debug and Info go to stdout, Warn and Error to stderr.
+*/
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error, Off };
+
+struct LogRecord {
+    static constexpr size_t ARG_BYTES = 232;
+
+    int64_t timestampUs = 0;  // system_clock, microseconds since the epoch
+    const char *format = nullptr;
+    LogLevel level = LogLevel::Info;
+    uint8_t size = 0;  // bytes of `args` in use
+    uint8_t args[ARG_BYTES];
+};
+
+class Logger {
+  public:
+    enum class ArgType : uint8_t { Int, Uint, Double, Bool, Char, String, Endpoint, Truncated };
+
+    static Logger &instance();
+    ~Logger();
+
+    void setLevel(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed) && level != LogLevel::Off;
+    }
+    static bool parseLevel(const std::string &text, LogLevel &level);
+
+    template <typename... Args>
+    void write(LogLevel level, const char *format, const Args &...args) {
+        if (!enabled(level)) return;
+        LogRecord record;
+        record.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+        record.format = format;
+        record.level = level;
+        constexpr size_t reserved = (size_t{0} + ... + minPackedSize<Args>());
+        static_assert(reserved <= LogRecord::ARG_BYTES, "log arguments do not fit in a record");
+        [[maybe_unused]] size_t reserve = reserved;  // kept back for the arguments still to come
+        (pack(record, args, reserve -= minPackedSize<Args>()), ...);
+
+        Ring &ring = localRing();
+        if (!ring.records.tryPush(std::move(record))) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Blocks until everything logged before the call has been written out
+    void flush();
+
+  private:
+    static constexpr size_t RING_CAPACITY = 1024;
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(5);
+
+    struct Ring {
+        SpscQueue<LogRecord> records{RING_CAPACITY};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> retired{false};  // owning thread has exited
+        uint64_t reportedDropped = 0;      // writer thread only
+    };
+
+    // Registers the calling thread's ring on first use and retires it when the thread exits
+    struct RingHandle {
+        explicit RingHandle(Logger &logger);
+        ~RingHandle();
+        std::shared_ptr<Ring> ring;
+    };
+
+    Logger();
+    Ring &localRing();
+    void run();
+    bool drain(std::string &out, std::string &err);
+    static void format(const LogRecord &record, std::string &line);
+
+    struct PackedEndpoint {
+        std::array<unsigned char, 16> address;  // an IPv4 address uses the first 4
+        uint16_t port;
+        bool v6;
+    };
+
+    static constexpr std::string_view ELLIPSIS = "\u2026";
+
+    // Bytes an argument is sure to get: all of them, except for a string, which gets its tag
+    template <typename T>
+    static constexpr size_t minPackedSize() {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool> || std::is_same_v<U, char>) {
+            return 1 + sizeof(U);
+        } else if constexpr (std::is_arithmetic_v<U> || std::is_enum_v<U>) {
+            return 1 + 8;
+        } else if constexpr (std::is_same_v<U, boost::asio::ip::udp::endpoint>) {
+            return 1 + sizeof(PackedEndpoint);
+        } else {
+            return 1;
+        }
+    }
+
+    // `reserve` bytes stay free for the arguments after this one
+    template <typename T>
+    static void packBytes(LogRecord &record, ArgType type, const T &value, size_t reserve) {
+        if (record.size + 1 + sizeof(T) + reserve > LogRecord::ARG_BYTES) {
+            record.args[record.size++] = static_cast<uint8_t>(ArgType::Truncated);
+            return;
+        }
+        record.args[record.size++] = static_cast<uint8_t>(type);
+        std::memcpy(record.args + record.size, &value, sizeof(T));
+        record.size += sizeof(T);
+    }
+
+    // Up to 255 bytes; a longer or ill-fitting string keeps what fits and ends in ELLIPSIS
+    static void packString(LogRecord &record, std::string_view text, size_t reserve) {
+        size_t room = LogRecord::ARG_BYTES - record.size - reserve;  // at least the tag
+        size_t length = text.size();
+        bool cut = length > 255 || 2 + length > room;
+        if (cut) {
+            if (room < 2 + ELLIPSIS.size()) {
+                record.args[record.size++] = static_cast<uint8_t>(ArgType::Truncated);
+                return;
+            }
+            length = std::min<size_t>(room - 2, 255) - ELLIPSIS.size();
+        }
+        record.args[record.size++] = static_cast<uint8_t>(ArgType::String);
+        record.args[record.size++] = static_cast<uint8_t>(length + (cut ? ELLIPSIS.size() : 0));
+        std::memcpy(record.args + record.size, text.data(), length);
+        record.size += length;
+        if (cut) {
+            std::memcpy(record.args + record.size, ELLIPSIS.data(), ELLIPSIS.size());
+            record.size += ELLIPSIS.size();
+        }
+    }
+
+    // Address bytes and port; the writer thread turns them back into text
+    static void packEndpoint(LogRecord &record, const boost::asio::ip::udp::endpoint &endpoint,
+                             size_t reserve) {
+        PackedEndpoint packed{};
+        const auto &address = endpoint.address();
+        if (address.is_v4()) {
+            auto bytes = address.to_v4().to_bytes();
+            std::copy(bytes.begin(), bytes.end(), packed.address.begin());
+        } else {
+            packed.address = address.to_v6().to_bytes();
+            packed.v6 = true;
+        }
+        packed.port = endpoint.port();
+        packBytes(record, ArgType::Endpoint, packed, reserve);
+    }
+
+    template <typename T>
+    static void pack(LogRecord &record, const T &value, size_t reserve) {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+            packBytes(record, ArgType::Bool, value, reserve);
+        } else if constexpr (std::is_same_v<U, char>) {
+            packBytes(record, ArgType::Char, value, reserve);
+        } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+            packBytes(record, ArgType::Int, static_cast<int64_t>(value), reserve);
+        } else if constexpr (std::is_integral_v<U>) {
+            packBytes(record, ArgType::Uint, static_cast<uint64_t>(value), reserve);
+        } else if constexpr (std::is_enum_v<U>) {
+            packBytes(record, ArgType::Int, static_cast<int64_t>(value), reserve);
+        } else if constexpr (std::is_floating_point_v<U>) {
+            packBytes(record, ArgType::Double, static_cast<double>(value), reserve);
+        } else if constexpr (std::is_convertible_v<const U &, std::string_view>) {
+            packString(record, value, reserve);
+        } else if constexpr (std::is_same_v<U, boost::asio::ip::udp::endpoint>) {
+            packEndpoint(record, value, reserve);
+        } else {
+            static_assert(sizeof(U) == 0, "no log packer for this argument type");
+        }
+    }
+
+    std::atomic<LogLevel> level_{LogLevel::Info};
+
+    std::mutex ringsMutex_;  // guards rings_; taken once per thread, not per record
+    std::vector<std::shared_ptr<Ring>> rings_;
+
+    std::mutex flushMutex_;
+    std::condition_variable flushed_;
+    uint64_t flushRequested_ = 0;  // guarded by flushMutex_
+    uint64_t flushCompleted_ = 0;  // guarded by flushMutex_
+
+    std::atomic<bool> running_{true};
+    std::thread writer_;
+};
+
+namespace Log {
+
+template <typename... Args>
+void debug(const char *format, const Args &...args) {
+    Logger::instance().write(LogLevel::Debug, format, args...);
+}
+
+template <typename... Args>
+void info(const char *format, const Args &...args) {
+    Logger::instance().write(LogLevel::Info, format, args...);
+}
+
+template <typename... Args>
+void warn(const char *format, const Args &...args) {
+    Logger::instance().write(LogLevel::Warn, format, args...);
+}
+
+template <typename... Args>
+void error(const char *format, const Args &...args) {
+    Logger::instance().write(LogLevel::Error, format, args...);
+}
+
+}  // namespace Log
+
+#endif  // LOGGER_H
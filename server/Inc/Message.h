@@ -1,22 +1,14 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <cstdint>
-#include <cstring>
-#include <stdexcept>
-
-// Platform-specific headers
-#ifdef _WIN32
-#include <winsock2.h>
-#else
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#endif
 
+#include "Facility.h"
+#include "TextWriter.h"
 #include "Util.h"
+#include "WireCodec.h"
 #include <optional>
 #include <boost/asio.hpp>
 
@@ -26,9 +18,22 @@ enum class Operation : uint8_t {
     CHANGE = 3,
     MONITOR = 4,
     EXTEND = 5,
-    CANCEL = 6
+    CANCEL = 6,
+    RESYNC = 7,
+    STATS = 8,
+    HELLO = 9,
+    WAITLIST = 10,
+
+    // WAL and replication only, so a catalog reload reaches the log and the replicas; a client
+    // sending one is told the operation is invalid
+    CATALOG_HOURS = 0x80,   // one opening segment of the facility's next hours
+    CATALOG_APPLY = 0x81,   // the facility now has the segments logged since its last APPLY
+    CATALOG_REMOVE = 0x82,  // the facility is closed, with its bookings and waiters
 };
 
+// MONITOR flags (optional trailing byte after the interval)
+constexpr uint8_t MONITOR_FLAG_DELTA = 0x01;  // send binary DeltaMessages instead of text updates
+
 /*
 Example of Requests:
 Query:
@@ -43,7 +48,7 @@ Change (Modify):
 
 Monitor:
 [RequestID][OpCode=4][FacilityNameLength][FacilityName][Day=0(Monday)][StartTime=1000][EndTime=1400]
-[extraMessage=300 (300s monitor interval)]
+[extraMessage=300 (300s monitor interval)][optional MonitorFlags=1 (binary deltas)]
 
 Extend:
 [RequestID][OpCode=5][FacilityNameLength][FacilityName][Day=0(Monday)][StartTime=1000][EndTime=1200]
@@ -52,9 +57,51 @@ Extend:
 Cancel:
 [RequestID][OpCode=6][FacilityNameLength][FacilityName][Day=0(Monday)][StartTime=1000][EndTime=1200]
 [extraMessage=1000 (Booking ID=1000)]
+
+Resync (full availability of one day after a gap in delta versions):
+[RequestID][OpCode=7][FacilityNameLength][FacilityName][Day=0(Monday)][StartTime=0][EndTime=0]
+[extraMessage=12 (last version seen)]
+
+Stats (latency histograms, counters and facility utilization as text):
+[RequestID][OpCode=8][FacilityNameLength=0][Day=0][StartTime=0][EndTime=0]
+
+Hello (protocol negotiation, answered with a HelloReply; servers before it answer with an error):
+[RequestID][OpCode=9][FacilityNameLength=0][Day=0][StartTime=0][EndTime=0]
+[extraMessage=2 (highest protocol version the client speaks)]
+
+Waitlist (book the range as soon as it is free; answered at once if it already is):
+[RequestID][OpCode=10][FacilityNameLength][FacilityName][Day=0(Monday)][StartTime=900][EndTime=1100]
+[extraMessage=600 (wait up to 600s)][optional Priority=0 (higher goes first)]
+*/
+
+// Protocol versions; the format above is version 1 and what clients that never say HELLO get
+constexpr uint8_t PROTOCOL_LEGACY = 1;
+constexpr uint8_t PROTOCOL_COMPACT = 2;          // compact requests (CompactRequest)
+constexpr uint8_t PROTOCOL_BINARY_RESULTS = 3;  // ... and OpResult replies instead of sentences
+constexpr uint8_t PROTOCOL_SESSION_TOKENS = 4;  // ... and a session token in every compact request
+
+/*
+Who sent a request, as far as the duplicate filter is concerned: the session token of a request
+that carries one, otherwise the client's IPv4 address and port packed into the low 48 bits.
+Session tokens always have the top bit set, so the two never meet.
 */
+constexpr uint64_t SESSION_TOKEN_BIT = uint64_t{1} << 63;
 
-struct RequestMessage {
+struct RequestKey {
+    uint64_t client;
+    uint32_t requestId;
+
+    bool operator==(const RequestKey &other) const = default;
+
+    struct Hash {
+        size_t operator()(const RequestKey &key) const {
+            return std::hash<uint64_t>()(key.client ^
+                                         (uint64_t{key.requestId} * 0x9E3779B97F4A7C15));
+        }
+    };
+};
+
+struct RequestMessage : WireMessage<RequestMessage> {
     uint32_t requestId;
     boost::asio::ip::udp::endpoint clientEndpoint;
     Operation operation;
@@ -65,187 +112,230 @@ struct RequestMessage {
 
     std::optional<uint32_t> bookingId;        // Cancel & Modify
     std::optional<int> offsetMinutes;         // Modify only
-    std::optional<uint32_t> monitorInterval;  // Monitor only
-
-    // Generate a unique key combining request ID and client address
-    std::string getUniqueRequestKey() const {
-        return std::to_string(requestId) + "-" + clientEndpoint.address().to_string() + ":" +
-               std::to_string(clientEndpoint.port());
+    std::optional<uint32_t> monitorInterval;  // Monitor; Waitlist: how long to wait
+    std::optional<uint8_t> monitorFlags;      // Monitor; Waitlist: the priority
+    std::optional<uint32_t> sinceVersion;     // Resync only
+    std::optional<uint8_t> protocolVersion;   // Hello only
+    uint64_t sessionToken = 0;  // from a version 4 compact request; not in this format
+
+    // The duplicate filter's key; the server only listens on IPv4
+    RequestKey getUniqueRequestKey() const {
+        if (sessionToken != 0) return {sessionToken, requestId};
+        return {uint64_t{clientEndpoint.address().to_v4().to_uint()} << 16 | clientEndpoint.port(),
+                requestId};
     }
 
-    // Marshal: Convert RequestMessage to byte array
-    std::vector<uint8_t> marshal() const {
-        std::vector<uint8_t> buffer;
-
-        // Request ID
-        uint32_t netRequestId = htonl(requestId);
-        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netRequestId),
-                      reinterpret_cast<const uint8_t*>(&netRequestId) + sizeof(netRequestId));
-
-        // Operation
-        buffer.push_back(static_cast<uint8_t>(operation));
-
-        // Facility Name
-        uint16_t nameLength = htons(static_cast<uint16_t>(facilityName.size()));
-        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&nameLength),
-                      reinterpret_cast<const uint8_t*>(&nameLength) + sizeof(nameLength));
-        buffer.insert(buffer.end(), facilityName.begin(), facilityName.end());
-
-        // Day
-        buffer.push_back(static_cast<uint8_t>(day));
-
-        // Start and End Times
-        uint16_t netStart = htons(startTime);
-        uint16_t netEnd = htons(endTime);
-        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netStart),
-                      reinterpret_cast<const uint8_t*>(&netStart) + sizeof(netStart));
-        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netEnd),
-                      reinterpret_cast<const uint8_t*>(&netEnd) + sizeof(netEnd));
-
-        // Operation-specific extra fields
-        switch (operation) {
+    // Wire layout: the header, then the extras of the operation (see above)
+    static constexpr const char *WIRE_NAME = "RequestMessage";
+    using WireHeader = WireLayout<
+        WireField<&RequestMessage::requestId>, WireField<&RequestMessage::operation>,
+        WireField<&RequestMessage::facilityName>, WireField<&RequestMessage::day, uint8_t>,
+        WireField<&RequestMessage::startTime>, WireField<&RequestMessage::endTime>>;
+    using WireBookingId = WireLayout<WireOptional<WireField<&RequestMessage::bookingId>>>;
+    using WireBookingChange = WireLayout<WireOptional<WireField<&RequestMessage::bookingId>,
+                                                      WireField<&RequestMessage::offsetMinutes>>>;
+    using WireMonitor = WireLayout<WireOptional<WireField<&RequestMessage::monitorInterval>>,
+                                   WireOptional<WireField<&RequestMessage::monitorFlags>>>;
+    using WireResync = WireLayout<WireOptional<WireField<&RequestMessage::sinceVersion>>>;
+    using WireHello = WireLayout<WireOptional<WireField<&RequestMessage::protocolVersion>>>;
+
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(WireHeader{});
+        switch (operation) {  // already decoded when unmarshalling
             case Operation::CANCEL:
-                if (bookingId.has_value()) {
-                    uint32_t netId = htonl(bookingId.value());
-                    buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netId),
-                                  reinterpret_cast<const uint8_t*>(&netId) + sizeof(netId));
-                }
-                break;
-
-            case Operation::EXTEND:
-                if (bookingId.has_value() && offsetMinutes.has_value()) {
-                    uint32_t netId = htonl(bookingId.value());
-                    int32_t netOffset = htonl(offsetMinutes.value());
-                    buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netId),
-                                  reinterpret_cast<const uint8_t*>(&netId) + sizeof(netId));
-                    buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netOffset),
-                                  reinterpret_cast<const uint8_t*>(&netOffset) + sizeof(netOffset));
-                }
+                visit(WireBookingId{});
                 break;
-
             case Operation::CHANGE:
-                if (bookingId.has_value() && offsetMinutes.has_value()) {
-                    uint32_t netId = htonl(bookingId.value());
-                    int32_t netOffset = htonl(offsetMinutes.value());
-                    buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netId),
-                                  reinterpret_cast<const uint8_t*>(&netId) + sizeof(netId));
-                    buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netOffset),
-                                  reinterpret_cast<const uint8_t*>(&netOffset) + sizeof(netOffset));
-                }
+            case Operation::EXTEND:
+                visit(WireBookingChange{});
                 break;
-
             case Operation::MONITOR:
-                if (monitorInterval.has_value()) {
-                    uint32_t netInterval = htonl(monitorInterval.value());
-                    buffer.insert(
-                        buffer.end(), reinterpret_cast<const uint8_t*>(&netInterval),
-                        reinterpret_cast<const uint8_t*>(&netInterval) + sizeof(netInterval));
-                }
+            case Operation::WAITLIST:
+                visit(WireMonitor{});
+                break;
+            case Operation::RESYNC:
+                visit(WireResync{});
+                break;
+            case Operation::HELLO:
+                visit(WireHello{});
                 break;
-
             default:
                 break;
         }
-
-        return buffer;
     }
+};
 
-    // Unmarshal: Convert byte array to RequestMessage
-    static RequestMessage unmarshal(const std::vector<uint8_t>& buffer) {
-        if (buffer.size() < 15) {
-            throw std::runtime_error("Buffer too small to unmarshal RequestMessage.");
-        }
-
-        RequestMessage msg;
-        size_t offset = 0;
-
-        // Request ID
-        uint32_t netRequestId;
-        std::memcpy(&netRequestId, buffer.data() + offset, sizeof(netRequestId));
-        msg.requestId = ntohl(netRequestId);
-        offset += sizeof(netRequestId);
+static_assert(RequestMessage::WireHeader::minSize == 12, "header with an empty facility name");
 
-        // Operation
-        msg.operation = static_cast<Operation>(buffer[offset++]);
+/*
+Hello reply, carried as the message of a Status=0 response:
+[Version][FacilityCount(2)][for each: [NameLength(2)][Name]][SessionToken(8), version 4 only]
 
-        // Facility Name
-        uint16_t nameLength;
-        std::memcpy(&nameLength, buffer.data() + offset, sizeof(nameLength));
-        nameLength = ntohs(nameLength);
-        offset += sizeof(nameLength);
+Version is the one both sides speak. From version 2 on, facility i of the list has ID i + 1 in
+compact requests (0 is no facility); IDs never change while the server runs, a facility added by
+a catalog reload gets the next one, and a new HELLO fetches the longer list.
 
-        if (offset + nameLength > buffer.size()) {
-            throw std::runtime_error("Buffer overflow while reading facility name.");
+From version 4 on the session has a random token, which the client puts in every compact request.
+The server finds the session, the duplicate filter entries and the monitor subscriptions of a
+request by its token, so they stay with a client whose address or port changes. The token is
+only as secret as the path between the two; it is not authentication.
+*/
+struct HelloReply : WireMessage<HelloReply> {
+    uint8_t version = PROTOCOL_LEGACY;
+    std::vector<std::string> facilities;
+    std::optional<uint64_t> sessionToken;
+
+    // 0 if the server did not list it; such requests have to go in the version 1 format
+    uint32_t facilityId(const std::string &name) const {
+        for (size_t i = 0; i < facilities.size(); ++i) {
+            if (facilities[i] == name) return static_cast<uint32_t>(i + 1);
         }
+        return 0;
+    }
+
+    static constexpr const char *WIRE_NAME = "HelloReply";
+    using Wire = WireLayout<WireField<&HelloReply::version>, WireField<&HelloReply::facilities>,
+                            WireOptional<WireField<&HelloReply::sessionToken>>>;
 
-        msg.facilityName.assign(buffer.begin() + offset, buffer.begin() + offset + nameLength);
-        offset += nameLength;
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(Wire{});
+    }
+};
 
-        // Day
-        msg.day = static_cast<Util::Day>(buffer[offset++]);
+/*
+Compact request, for clients whose HELLO was answered with version 2 or later. V is a varint:
+[Magic=0xFE][Version=2][RequestIdDelta(V)][OpCode][FacilityId(V)][Day][StartMinute(V)]
+[DurationMinutes(V, signed)][extras as in version 1, each a varint, MonitorFlags a byte]
+
+Version 4 sessions put their token after the version byte:
+[Magic=0xFE][Version=4][SessionToken(8)][RequestIdDelta(V)]... as above
+
+RequestIdDelta is the request ID minus the ID of the client's HELLO (modulo 2^32), so a client
+counting up from its HELLO spends one byte on the first 127 requests. Times are minutes after
+midnight. The server tells the two formats apart by the magic, which means version 1 request IDs
+must stay below 0xFE000000 (the Java client counts up from 1). Without a token the session is the
+one last seen at the sender's address. A compact request without a session (never said HELLO, an
+unknown token, or the server restarted) is refused with STATUS_HELLO_REQUIRED and request ID 0.
+*/
+constexpr uint8_t COMPACT_MAGIC = 0xFE;
+
+struct CompactRequest : WireMessage<CompactRequest> {
+    uint8_t magic = COMPACT_MAGIC;
+    uint8_t version = PROTOCOL_COMPACT;
+    uint64_t sessionToken = 0;  // version 4
+    uint32_t requestIdDelta = 0;
+    Operation operation = Operation::QUERY;
+    uint32_t facilityId = 0;
+    Util::Day day = Util::Day::Monday;
+    uint16_t startMinute = 0;
+    int16_t durationMinutes = 0;
+
+    std::optional<uint32_t> bookingId;
+    std::optional<int> offsetMinutes;
+    std::optional<uint32_t> monitorInterval;
+    std::optional<uint8_t> monitorFlags;
+    std::optional<uint32_t> sinceVersion;
+
+    static bool matches(const std::vector<uint8_t> &datagram) {
+        return !datagram.empty() && datagram[0] == COMPACT_MAGIC;
+    }
 
-        // Start & End Times
-        std::memcpy(&msg.startTime, buffer.data() + offset, sizeof(msg.startTime));
-        msg.startTime = ntohs(msg.startTime);
-        offset += sizeof(msg.startTime);
+    // `sessionToken` as in the HelloReply, 0 to leave it out
+    static CompactRequest fromRequest(const RequestMessage &request, uint32_t helloRequestId,
+                                      uint32_t facilityId, uint64_t sessionToken = 0) {
+        CompactRequest compact;
+        if (sessionToken != 0) {
+            compact.version = PROTOCOL_SESSION_TOKENS;
+            compact.sessionToken = sessionToken;
+        }
+        compact.requestIdDelta = request.requestId - helloRequestId;
+        compact.operation = request.operation;
+        compact.facilityId = facilityId;
+        compact.day = request.day;
+        compact.startMinute = static_cast<uint16_t>(Util::toMinutes(request.startTime));
+        compact.durationMinutes =
+            static_cast<int16_t>(Util::toMinutes(request.endTime) - compact.startMinute);
+        compact.bookingId = request.bookingId;
+        compact.offsetMinutes = request.offsetMinutes;
+        compact.monitorInterval = request.monitorInterval;
+        compact.monitorFlags = request.monitorFlags;
+        compact.sinceVersion = request.sinceVersion;
+        return compact;
+    }
 
-        std::memcpy(&msg.endTime, buffer.data() + offset, sizeof(msg.endTime));
-        msg.endTime = ntohs(msg.endTime);
-        offset += sizeof(msg.endTime);
+    // `facilities` as listed in the HelloReply
+    RequestMessage toRequest(uint32_t helloRequestId,
+                             const std::vector<std::string> &facilities) const {
+        if (version != PROTOCOL_COMPACT && version != PROTOCOL_SESSION_TOKENS) {
+            throw std::runtime_error("Unsupported protocol version " + std::to_string(version) +
+                                     ".");
+        }
+        if (facilityId > facilities.size()) {
+            throw std::runtime_error("Unknown facility ID " + std::to_string(facilityId) + ".");
+        }
+        RequestMessage request;
+        request.requestId = helloRequestId + requestIdDelta;
+        request.operation = operation;
+        request.facilityName = facilityId == 0 ? std::string() : facilities[facilityId - 1];
+        request.day = day;
+        request.startTime = static_cast<uint16_t>(Util::toHHMM(startMinute));
+        request.endTime = static_cast<uint16_t>(Util::toHHMM(startMinute + durationMinutes));
+        request.bookingId = bookingId;
+        request.offsetMinutes = offsetMinutes;
+        request.monitorInterval = monitorInterval;
+        request.monitorFlags = monitorFlags;
+        request.sinceVersion = sinceVersion;
+        request.sessionToken = sessionToken;
+        return request;
+    }
 
-        // Extract operation-specific extras
-        switch (msg.operation) {
+    static constexpr const char *WIRE_NAME = "CompactRequest";
+    using WirePreamble =
+        WireLayout<WireField<&CompactRequest::magic>, WireField<&CompactRequest::version>>;
+    using WireSession = WireLayout<WireField<&CompactRequest::sessionToken>>;
+    using WireHeader = WireLayout<
+        WireField<&CompactRequest::requestIdDelta, WireVarint<uint32_t>>,
+        WireField<&CompactRequest::operation>,
+        WireField<&CompactRequest::facilityId, WireVarint<uint32_t>>,
+        WireField<&CompactRequest::day, uint8_t>,
+        WireField<&CompactRequest::startMinute, WireVarint<uint16_t>>,
+        WireField<&CompactRequest::durationMinutes, WireVarint<int16_t>>>;
+    using WireBookingId =
+        WireLayout<WireOptional<WireField<&CompactRequest::bookingId, WireVarint<uint32_t>>>>;
+    using WireBookingChange =
+        WireLayout<WireOptional<WireField<&CompactRequest::bookingId, WireVarint<uint32_t>>,
+                                WireField<&CompactRequest::offsetMinutes, WireVarint<int>>>>;
+    using WireMonitor = WireLayout<
+        WireOptional<WireField<&CompactRequest::monitorInterval, WireVarint<uint32_t>>>,
+        WireOptional<WireField<&CompactRequest::monitorFlags>>>;
+    using WireResync =
+        WireLayout<WireOptional<WireField<&CompactRequest::sinceVersion, WireVarint<uint32_t>>>>;
+
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(WirePreamble{});
+        if (version >= PROTOCOL_SESSION_TOKENS) visit(WireSession{});  // decoded by now, too
+        visit(WireHeader{});
+        switch (operation) {
             case Operation::CANCEL:
-                if (offset + sizeof(uint32_t) <= buffer.size()) {
-                    uint32_t netBookingId;
-                    std::memcpy(&netBookingId, buffer.data() + offset, sizeof(netBookingId));
-                    msg.bookingId = ntohl(netBookingId);
-                    offset += sizeof(netBookingId);
-                }
+                visit(WireBookingId{});
                 break;
-
             case Operation::CHANGE:
-                if (offset + sizeof(uint32_t) + sizeof(int32_t) <= buffer.size()) {
-                    uint32_t netBookingId;
-                    int32_t netOffset;
-                    std::memcpy(&netBookingId, buffer.data() + offset, sizeof(netBookingId));
-                    offset += sizeof(netBookingId);
-                    std::memcpy(&netOffset, buffer.data() + offset, sizeof(netOffset));
-                    offset += sizeof(netOffset);
-
-                    msg.bookingId = ntohl(netBookingId);
-                    msg.offsetMinutes = ntohl(netOffset);
-                }
-                break;
-
             case Operation::EXTEND:
-                if (offset + sizeof(uint32_t) + sizeof(int32_t) <= buffer.size()) {
-                    uint32_t netBookingId;
-                    int32_t netOffset;
-                    std::memcpy(&netBookingId, buffer.data() + offset, sizeof(netBookingId));
-                    offset += sizeof(netBookingId);
-                    std::memcpy(&netOffset, buffer.data() + offset, sizeof(netOffset));
-                    offset += sizeof(netOffset);
-
-                    msg.bookingId = ntohl(netBookingId);
-                    msg.offsetMinutes = ntohl(netOffset);
-                }
+                visit(WireBookingChange{});
                 break;
-
             case Operation::MONITOR:
-                if (offset + sizeof(uint32_t) <= buffer.size()) {
-                    uint32_t netInterval;
-                    std::memcpy(&netInterval, buffer.data() + offset, sizeof(netInterval));
-                    msg.monitorInterval = ntohl(netInterval);
-                    offset += sizeof(netInterval);
-                }
+            case Operation::WAITLIST:
+                visit(WireMonitor{});
+                break;
+            case Operation::RESYNC:
+                visit(WireResync{});
                 break;
-
             default:
                 break;
         }
-
-        return msg;
     }
 };
 
@@ -253,67 +343,247 @@ struct RequestMessage {
 Example of respone:
 Success: [RequestID][Status=0][MsgLen=30][Booking confirmed: ID 12345]
 Error: [RequestID][Status=1][MsgLen=20][Error: Slot not available]
+Delta: [RequestID][Status=2][MsgLen=24][DeltaMessage bytes]
 */
 
-struct ResponseMessage {
+constexpr uint8_t STATUS_DELTA = 2;           // message holds a marshalled DeltaMessage
+constexpr uint8_t STATUS_HELLO_REQUIRED = 3;  // compact request without a session; say HELLO
+
+struct ResponseMessage : WireMessage<ResponseMessage> {
     uint32_t requestId;
-    uint8_t status;       // 0 = success, 1 = error
+    uint8_t status;       // 0 = success, 1 = error, 2 = binary delta
     std::string message;  // Human-readable message
 
-    // Marshal: Convert ResponseMessage to byte array
-    std::vector<uint8_t> marshal() const {
-        std::vector<uint8_t> buffer;
-        uint32_t netRequestId = htonl(requestId);
+    static constexpr const char *WIRE_NAME = "ResponseMessage";
+    using Wire = WireLayout<WireField<&ResponseMessage::requestId>,
+                            WireField<&ResponseMessage::status>,
+                            WireField<&ResponseMessage::message>>;
 
-        // Write Request ID
-        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&netRequestId),
-                      reinterpret_cast<const uint8_t*>(&netRequestId) + sizeof(netRequestId));
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(Wire{});
+    }
+};
 
-        // Write Status
-        buffer.push_back(status);
+static_assert(ResponseMessage::Wire::minSize == 7, "reply with an empty message");
 
-        // Write Message Length
-        uint16_t messageLength = htons(static_cast<uint16_t>(message.size()));
-        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&messageLength),
-                      reinterpret_cast<const uint8_t*>(&messageLength) + sizeof(messageLength));
+// The bytes of a ResponseMessage whose text stays where it was formatted, usually a TextBuffer,
+// instead of being copied into a string first. Send-only.
+struct TextReply : WireMessage<TextReply> {
+    uint32_t requestId = 0;
+    uint8_t status = 0;
+    std::string_view message;
 
-        // Write Message Content
-        buffer.insert(buffer.end(), message.begin(), message.end());
+    static constexpr const char *WIRE_NAME = "ResponseMessage";
+    using Wire = WireLayout<WireField<&TextReply::requestId>, WireField<&TextReply::status>,
+                            WireField<&TextReply::message>>;
 
-        return buffer;
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(Wire{});
     }
+};
 
-    // Unmarshal: Convert byte array to ResponseMessage
-    static ResponseMessage unmarshal(const std::vector<uint8_t>& buffer) {
-        if (buffer.size() < 7) {  // Minimum size check
-            throw std::runtime_error("Buffer too small to unmarshal ResponseMessage.");
+/*
+Operation result, the message of a Status=4 response to clients whose HELLO settled on version 3
+or later. V is a varint:
+[OpCode][ResultCode][BookingId(V)][Day][StartTime(V)][EndTime(V)]
+
+BookingId and the slot are those of the booking that was made, moved, extended or canceled (for
+MONITOR, the watched range), all zero on failure. Such clients get a QUERY answered with the
+day's DeltaMessage (Status=2) rather than a list, and STATS, RESYNC and errors nobody anticipated
+as before. formatText() gives the sentence a version 1 client gets for the same outcome.
+
+A WAITLIST request is answered as a BOOK if the range was free, otherwise as a WAITLIST with
+BookingId 0 once it is in line. The booking made for it later is pushed under the request ID of
+that WAITLIST request (and to where its session is by then), as a WAITLIST result or its sentence.
+*/
+constexpr uint8_t STATUS_RESULT = 4;
+
+enum class ResultCode : uint8_t {
+    OK = 0,
+    SLOT_UNAVAILABLE = 1,    // the slot, or the part a change or extension adds, is not free;
+                             // for WAITLIST, the day's line is full
+    INVALID_BOOKING = 2,     // no booking with that ID at the facility
+    INVALID_TIME_RANGE = 3,  // the changed or extended booking would leave 08:00 to 18:00;
+                             // for WAITLIST, the range is not within the facility's hours
+    FACILITY_NOT_FOUND = 4,
+    MISSING_FIELD = 5,  // booking ID, offset or monitor interval left out of the request
+};
+
+struct OpResult : WireMessage<OpResult> {
+    Operation operation = Operation::BOOK;
+    ResultCode code = ResultCode::OK;
+    uint32_t bookingId = 0;
+    Util::Day day = Util::Day::Monday;
+    uint16_t startTime = 0;  // HHMM
+    uint16_t endTime = 0;    // HHMM
+
+    static OpResult success(Operation operation, uint32_t bookingId,
+                            const Facility::TimeSlot &slot) {
+        OpResult result;
+        result.operation = operation;
+        result.bookingId = bookingId;
+        result.day = slot.day;
+        result.startTime = slot.startTime.toHHMM();
+        result.endTime = slot.endTime.toHHMM();
+        return result;
+    }
+
+    static OpResult failure(Operation operation, ResultCode code) {
+        OpResult result;
+        result.operation = operation;
+        result.code = code;
+        return result;
+    }
+
+    // The Status a version 1 reply carries; a taken slot and an unknown booking to cancel never
+    // counted as errors there
+    uint8_t textStatus() const {
+        bool answered = code == ResultCode::OK ||
+                        (code == ResultCode::SLOT_UNAVAILABLE && operation == Operation::BOOK) ||
+                        (code == ResultCode::INVALID_BOOKING && operation == Operation::CANCEL);
+        return answered ? 0 : 1;
+    }
+
+    // `facility` as named in the request
+    void formatText(std::string_view facility, TextWriter &out) const {
+        bool change = operation == Operation::CHANGE;
+        switch (code) {
+            case ResultCode::OK:
+                switch (operation) {
+                    case Operation::BOOK:
+                        out << "Booking confirmed for " << facility << " on ";
+                        slot().format(out);
+                        out << ". Booking ID: " << bookingId;
+                        return;
+                    case Operation::CHANGE:
+                    case Operation::EXTEND:
+                        out << "Booking with ID " << bookingId
+                            << (change ? " modified" : " extended") << " successfully to ";
+                        slot().format(out);
+                        out << '.';
+                        return;
+                    case Operation::CANCEL:
+                        out << "Booking with ID " << bookingId << " canceled successfully.";
+                        return;
+                    case Operation::WAITLIST:
+                        if (bookingId == 0) {
+                            out << "Added to the waitlist for " << facility << " on ";
+                            slot().format(out);
+                            out << '.';
+                            return;
+                        }
+                        out << "Booking confirmed for " << facility << " on ";
+                        slot().format(out);
+                        out << " from the waitlist. Booking ID: " << bookingId;
+                        return;
+                    default:
+                        out << "Done.";
+                        return;
+                }
+            case ResultCode::SLOT_UNAVAILABLE:
+                if (operation == Operation::BOOK) {
+                    out << "Slot not available.";
+                } else if (operation == Operation::WAITLIST) {
+                    out << "The waitlist for that day is full.";
+                } else {
+                    out << (change ? "Failed to modify booking: Requested new time slot is "
+                                     "unavailable."
+                                   : "Failed to extend booking: Extension time slot is not "
+                                     "available.");
+                }
+                return;
+            case ResultCode::INVALID_BOOKING:
+                out << (operation == Operation::CANCEL ? "Invalid booking ID."
+                                                       : "Booking ID not found.");
+                return;
+            case ResultCode::INVALID_TIME_RANGE:
+                if (operation == Operation::WAITLIST) {
+                    out << "Invalid time range for the waitlist: it must be within the "
+                           "facility's opening hours.";
+                    return;
+                }
+                out << (change ? "Failed to modify booking: Invalid time range after applying "
+                                 "offset."
+                               : "Failed to extend booking: Extension goes beyond allowed time "
+                                 "range or is non-positive.");
+                return;
+            case ResultCode::FACILITY_NOT_FOUND:
+                out << "Facility '" << facility << "' not found!";
+                return;
+            case ResultCode::MISSING_FIELD:
+                switch (operation) {
+                    case Operation::CHANGE:
+                        out << "Booking ID and offset are required for modification.";
+                        return;
+                    case Operation::EXTEND:
+                        out << "Booking ID and extension duration required.";
+                        return;
+                    case Operation::CANCEL:
+                        out << "Booking ID required for cancellation.";
+                        return;
+                    case Operation::WAITLIST:
+                        out << "Waiting time is required.";
+                        return;
+                    default:
+                        out << "Monitor interval is required.";
+                        return;
+                }
         }
+        out << "Unknown result " << static_cast<int>(code) << '.';
+    }
+    std::string toText(std::string_view facility) const {
+        TextBuffer<MAX_TEXT_REPLY> text;
+        formatText(facility, text);
+        return text.str();
+    }
 
-        ResponseMessage msg;
-        size_t offset = 0;
+    static constexpr const char *WIRE_NAME = "OpResult";
+    using Wire = WireLayout<WireField<&OpResult::operation>, WireField<&OpResult::code>,
+                            WireField<&OpResult::bookingId, WireVarint<uint32_t>>,
+                            WireField<&OpResult::day, uint8_t>,
+                            WireField<&OpResult::startTime, WireVarint<uint16_t>>,
+                            WireField<&OpResult::endTime, WireVarint<uint16_t>>>;
 
-        // Read Request ID
-        uint32_t netRequestId;
-        std::memcpy(&netRequestId, buffer.data() + offset, sizeof(netRequestId));
-        msg.requestId = ntohl(netRequestId);
-        offset += sizeof(netRequestId);
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(Wire{});
+    }
 
-        // Read Status
-        msg.status = buffer[offset++];
+  private:
+    Facility::TimeSlot slot() const {
+        return Facility::TimeSlot::fromHHMM(day, startTime, endTime);
+    }
+};
 
-        // Read Message Length
-        uint16_t messageLength;
-        std::memcpy(&messageLength, buffer.data() + offset, sizeof(messageLength));
-        messageLength = ntohs(messageLength);
-        offset += sizeof(messageLength);
+/*
+Binary availability delta, carried as the message of a Status=2 response:
+[FacilityNameLength][FacilityName][Day][Version][FirstSlot][SlotCount][Bits(8 bytes)]
 
-        // Read Message Content
-        if (offset + messageLength > buffer.size()) {
-            throw std::runtime_error("Buffer overflow while reading response message.");
-        }
+Version counts the mutations of one (facility, day), so a watcher that sees it jump by more than one
+has missed an update and can RESYNC. Slot i is the half hour starting i * 30 minutes after midnight;
+bit k of Bits is the availability of slot FirstSlot + k. A RESYNC reply uses the same layout and
+covers the whole day.
+*/
 
-        msg.message.assign(buffer.begin() + offset, buffer.begin() + offset + messageLength);
-        return msg;
+struct DeltaMessage : WireMessage<DeltaMessage> {
+    std::string facilityName;
+    Util::Day day;
+    uint32_t version;
+    uint8_t firstSlot;
+    uint8_t slotCount;
+    uint64_t bits;
+
+    static constexpr const char *WIRE_NAME = "DeltaMessage";
+    using Wire = WireLayout<WireField<&DeltaMessage::facilityName>,
+                            WireField<&DeltaMessage::day, uint8_t>,
+                            WireField<&DeltaMessage::version>, WireField<&DeltaMessage::firstSlot>,
+                            WireField<&DeltaMessage::slotCount>, WireField<&DeltaMessage::bits>>;
+
+    template <typename Visit>
+    void visitWire(Visit &&visit) const {
+        visit(Wire{});
     }
 };
 
@@ -0,0 +1,79 @@
+#ifndef NETWORK_EMULATOR_H
+#define NETWORK_EMULATOR_H
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "Util.h"
+
+/*
+Network fault injection for the client-facing socket.
+
+Each direction has a LinkPolicy. A datagram handed to transmit() is dropped, delayed, held back
+behind later ones, queued behind a bandwidth cap or delivered twice, as the policy says. Every
+decision comes from one seeded FastRandom, so the same seed and the same traffic give the same
+faults. Delayed deliveries run as timers on the owning io_context; everything else runs inline.
+With the default (empty) policy transmit() just calls deliver.
+
+The generator belongs to the emulator rather than to the calling thread. A thread-local one, as
+first asked for, would make the faults depend on which threads draw and in what order they start;
+one generator per emulator gives the same faults for a seed however the work is scheduled, and the
+simulation and the client keep their own for the same reason.
+
+Owned by the request thread, like the socket it sits in front of.
+*/
+struct LinkPolicy {
+    double dropRate = 0;                              // datagram is lost
+    double duplicateRate = 0;                         // datagram is delivered twice
+    std::chrono::microseconds delay{0};               // fixed one-way latency
+    std::chrono::microseconds jitter{0};              // plus a uniform 0..jitter
+    double reorderRate = 0;                           // held back, so later ones overtake it
+    std::chrono::microseconds reorderHold{5000};      // how long it is held back
+    uint64_t bandwidth = 0;                           // bytes per second, 0 = unlimited
+    std::chrono::microseconds maxQueueDelay{200000};  // tail drop once the cap queues this long
+
+    bool active() const;
+
+    // "drop=0.1,dup=0.01,delay=5,jitter=2,reorder=0.05,hold=10,bw=125000,queue=200"
+    // (times in milliseconds); throws std::invalid_argument
+    static LinkPolicy parse(const std::string &text);
+};
+
+class NetworkEmulator {
+  public:
+    enum class Direction { Inbound, Outbound };
+
+    NetworkEmulator(boost::asio::io_context &io_context, uint64_t seed);
+
+    void setPolicy(Direction direction, const LinkPolicy &policy);
+    const LinkPolicy &policy(Direction direction) const { return link(direction).policy; }
+
+    // Calls `deliver` zero, one or two times, now or later; returns false if the datagram was
+    // dropped (random loss or a full bandwidth queue)
+    bool transmit(Direction direction, size_t bytes, const std::function<void()> &deliver);
+
+    void stop();  // deliveries still pending are discarded
+
+  private:
+    struct Link {
+        LinkPolicy policy;
+        std::chrono::steady_clock::time_point linkFreeAt{};  // when the cap has sent the backlog
+    };
+
+    boost::asio::io_context &io_context_;
+    FastRandom random_;
+    Link links_[2];
+    std::shared_ptr<char> lifetime_ = std::make_shared<char>();  // pending timers hold a weak_ptr
+
+    Link &link(Direction direction) { return links_[static_cast<int>(direction)]; }
+    const Link &link(Direction direction) const { return links_[static_cast<int>(direction)]; }
+    bool chance(double probability) {
+        return probability > 0 && random_.nextDouble() < probability;
+    }
+    void deliverAfter(std::chrono::microseconds delay, const std::function<void()> &deliver);
+};
+
+#endif  // NETWORK_EMULATOR_H
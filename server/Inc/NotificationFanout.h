@@ -0,0 +1,118 @@
+#ifndef NOTIFICATION_FANOUT_H
+#define NOTIFICATION_FANOUT_H
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Message.h"
+#include "SpscQueue.h"
+#include "TimerWheel.h"
+#include "Util.h"
+
+using boost::asio::ip::udp;
+
+/*
+Notification fan-out stage.
+
+The request thread publishes availability changes and new subscriptions as ChangeEvents into a
+lock-free ring and returns straight away; a dedicated thread owns the subscription registry and its
+expiry wheel, formats the monitor updates and sends them. A mutating request therefore replies
+without waiting on the number of watchers.
+*/
+class NotificationFanout {
+  public:
+    struct ChangeEvent {
+        enum class Kind : uint8_t { Availability, Subscribe, Rebind, Remove };
+
+        Kind kind = Kind::Availability;
+        std::string facility;
+        Util::Day day = Util::Day::Monday;
+
+        uint32_t version = 0;        // Availability only, day version after the change
+        uint64_t changedMask = 0;    // Availability only, half-hour slots that changed
+        uint64_t availableMask = 0;  // Availability only, every available slot of the day
+
+        TimeOfDay startTime;           // Subscribe only
+        TimeOfDay endTime;             // Subscribe only
+        uint32_t monitorInterval = 0;  // Subscribe only, seconds
+        uint8_t monitorFlags = 0;      // Subscribe only, MONITOR_FLAG_*
+        udp::endpoint clientEndpoint;  // Subscribe and Rebind
+        uint64_t sessionToken = 0;     // Subscribe and Rebind, 0 for clients without one
+    };
+
+    // Sends one datagram; invoked on the fan-out thread
+    using Sender = std::function<void(const uint8_t *data, size_t size, const udp::endpoint &)>;
+
+    explicit NotificationFanout(Sender sender);
+    ~NotificationFanout();
+
+    void start();
+    void stop();
+
+    // Producer side, called from the request thread only
+    void publishChange(const std::string &facility, Util::Day day, uint32_t version,
+                       uint64_t changedMask, uint64_t availableMask);
+    void subscribe(const std::string &facility, Util::Day day, TimeOfDay startTime,
+                   TimeOfDay endTime, uint32_t interval, uint8_t flags,
+                   const udp::endpoint &clientEndpoint, uint64_t sessionToken = 0);
+    // The session's subscriptions go to `clientEndpoint` from now on
+    void rebind(uint64_t sessionToken, const udp::endpoint &clientEndpoint);
+    // Drops every subscription to a facility that has left the catalog
+    void removeFacility(const std::string &facility);
+
+  private:
+    struct MonitorInfo {
+        udp::endpoint clientEndpoint;  // Client's IP and port
+        Util::Day day;
+        TimeOfDay startTime;
+        TimeOfDay endTime;
+        uint32_t monitorInterval;  // Monitor duration in seconds
+        uint8_t flags;             // MONITOR_FLAG_*
+        uint64_t sessionToken;     // 0 if the subscription stays with clientEndpoint
+    };
+
+    // for monitoring clients
+    using TimeRangeMap = std::multimap<TimeOfDay, MonitorInfo>;  // map startTime
+    using DayMap = std::unordered_map<Util::Day, TimeRangeMap>;
+    using FacilityMonitorMap = std::unordered_map<std::string, DayMap>;
+
+    // Expiry handle for one subscription; multimap nodes stay put until erased
+    struct MonitorExpiry {
+        TimeRangeMap *ranges;
+        TimeRangeMap::iterator entry;
+    };
+
+    const size_t EVENT_QUEUE_CAPACITY = 8192;
+    const std::chrono::milliseconds MONITOR_WHEEL_TICK{1000};
+    const size_t MONITOR_WHEEL_SLOTS = 512;
+
+    boost::asio::io_context io_context_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard_;
+    std::thread thread_;
+    Sender sender_;
+
+    SpscQueue<ChangeEvent> events_;
+    std::atomic<bool> drainScheduled_{false};
+
+    // Owned by the fan-out thread
+    FacilityMonitorMap monitoringClients;
+    std::vector<FacilityMonitorMap::node_type> removedFacilities_;  // until their entries expire
+    TimerWheel<MonitorExpiry> monitorExpiry_;
+    ChangeEvent current_;  // reused pop target
+
+    void push(ChangeEvent &&event);
+    void drain();
+    void registerMonitorClient(ChangeEvent &event);
+    void rebindMonitorClients(const ChangeEvent &event);
+    void removeMonitorClients(const ChangeEvent &event);
+    void notifyMonitorClients(const ChangeEvent &event);
+    void sendDelta(const ChangeEvent &event, const TimeRangeMap &monitorMap);
+    void expireMonitorClients(std::vector<MonitorExpiry> &expired);
+};
+
+#endif  // NOTIFICATION_FANOUT_H
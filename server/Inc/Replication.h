@@ -0,0 +1,142 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "WriteAheadLog.h"
+
+using boost::asio::ip::udp;
+
+/*
+Primary/backup replication of committed booking mutations.
+
+The primary streams the same records it writes to its WAL, numbered by LSN, to every backup:
+[Type=BATCH][LastLsn(8)][WalRecord]...[WalRecord]
+A backup applies records strictly in LSN order and answers with its highest applied LSN:
+[Type=ACK][AppliedLsn(8)]
+Batching is ack-clocked: while a batch to a backup is unacknowledged, new records queue up and
+go out together when the ack arrives, so an idle primary sends each record at once and a busy one
+packs many records per datagram. Recovery is go-back-N: if a backup's ack stops advancing, the
+primary resends everything after it. An empty batch doubles as a heartbeat and tells the backup
+how far the log goes, so a lost tail is noticed even when no new mutations arrive.
+
+Read-only followers join at runtime by sending [Type=FOLLOW][AppliedLsn(8)] to the primary's
+replication port and are then streamed to like backups, except that replies never wait for them.
+A follower that stops acking is forgotten and simply sends FOLLOW again.
+
+Both sides run on the request thread's io_context, so replicated records are applied to the
+facilities without any locking.
+*/
+namespace Replication {
+
+enum class PacketType : uint8_t { BATCH = 1, ACK = 2, FOLLOW = 3 };
+
+constexpr size_t PACKET_HEADER = 1 + 8;
+constexpr size_t MAX_DATAGRAM = 1400;  // stay under a typical MTU
+
+}  // namespace Replication
+
+class ReplicationPrimary {
+  public:
+    // Called whenever the LSN acknowledged by every live backup advances
+    using ReplicatedHandler = std::function<void(uint64_t lsn)>;
+
+    // `port` is where followers register; 0 picks any port (backups only)
+    ReplicationPrimary(boost::asio::io_context &io_context, std::vector<udp::endpoint> backups,
+                       uint64_t startLsn, ReplicatedHandler onReplicated,
+                       unsigned short port = 0);
+
+    void replicate(const WalRecord &record);  // record.lsn must be startLsn + 1, + 2, ...
+    uint64_t replicatedLsn() const { return replicatedLsn_; }
+    void stop();
+
+  private:
+    struct Backup {
+        udp::endpoint endpoint;
+        uint64_t ackedLsn;
+        uint64_t sentLsn;
+        std::chrono::steady_clock::time_point lastHeard;
+        std::chrono::steady_clock::time_point lastProgress;
+        bool live = true;
+        bool synchronous = true;  // false for followers: replies never wait for them
+    };
+
+    const std::chrono::milliseconds HEARTBEAT_INTERVAL{100};
+    const std::chrono::milliseconds RETRANSMIT_AFTER{200};
+    const std::chrono::milliseconds BACKUP_TIMEOUT{1000};
+    const size_t MAX_RETAINED_RECORDS = 65536;
+
+    boost::asio::io_context &io_context_;
+    udp::socket socket_;
+    boost::asio::steady_timer heartbeatTimer_;
+    ReplicatedHandler onReplicated_;
+
+    std::vector<Backup> backups_;
+    std::deque<WalRecord> log_;  // recent records, ascending lsn; the catch-up window
+    uint64_t lastLsn_;
+    uint64_t replicatedLsn_;
+    bool flushScheduled_ = false;  // coalesces the records of one event-loop turn
+
+    udp::endpoint ackSender_;
+    std::array<uint8_t, 64> ackBuffer_;
+
+    void flush();
+    void sendFrom(Backup &backup, uint64_t afterLsn);
+    void sendPacket(std::vector<uint8_t> packet, const udp::endpoint &endpoint);
+    void receiveAcks();
+    void handleAck(Backup &backup, uint64_t lsn);
+    void onHeartbeat();
+    void updateReplicatedLsn();
+};
+
+class ReplicationBackup {
+  public:
+    using ApplyHandler = std::function<void(const WalRecord &record)>;
+    using TakeoverHandler = std::function<void()>;
+
+    // Listens for the primary on `port`; calls onTakeover once it has been silent for `takeoverAfter`.
+    // The countdown starts with the first batch or heartbeat: a backup that has never heard from a
+    // primary has nothing to take over from, and may just have been started before it.
+    // Without onTakeover it never takes over and only tracks how stale it is.
+    ReplicationBackup(boost::asio::io_context &io_context, unsigned short port, uint64_t appliedLsn,
+                      ApplyHandler onApply, TakeoverHandler onTakeover,
+                      std::chrono::milliseconds takeoverAfter);
+
+    // Follower: register with the primary's replication endpoint, and again whenever it goes quiet
+    void follow(const udp::endpoint &primary);
+
+    uint64_t appliedLsn() const { return appliedLsn_; }
+    // Upper bound on how far the local copy lags the primary (time since it was last caught up)
+    std::chrono::milliseconds staleness() const;
+    void stop();
+
+  private:
+    const std::chrono::milliseconds REREGISTER_AFTER{300};
+
+    udp::socket socket_;
+    boost::asio::steady_timer watchdog_;
+    ApplyHandler onApply_;
+    TakeoverHandler onTakeover_;
+    std::chrono::milliseconds takeoverAfter_;
+
+    uint64_t appliedLsn_;
+    std::chrono::steady_clock::time_point lastHeard_;
+    std::chrono::steady_clock::time_point lastCaughtUp_;
+    udp::endpoint primary_;
+    udp::endpoint sender_;
+    bool following_ = false;
+    bool heardFromPrimary_ = false;
+    std::array<uint8_t, 2048> recvBuffer_;
+
+    void receiveBatches();
+    void handleBatch(size_t size);
+    void sendToPrimary(Replication::PacketType type);
+    void checkPrimary();
+};
+
+#endif  // REPLICATION_H
@@ -0,0 +1,60 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "NetworkEmulator.h"
+
+/*
+Deterministic, single-threaded simulation of many clients talking to one UDPServer.
+
+The server's socket and clock are replaced (UDPServer::useTransport): requests go in through
+deliver() and replies come back through a callback, all on the calling thread. A virtual-time
+event queue carries the datagrams both ways and applies each LinkPolicy's drop, duplicate, delay,
+jitter and reorder (not the bandwidth cap) from one seeded FastRandom. The same config always
+gives the same run, and nothing waits on a real timer.
+
+Each client runs BOOK/CHANGE/EXTEND/CANCEL/QUERY closed-loop on its own bookings and retransmits
+after retryTimeout until it gets an answer. The run is then checked:
+  - every answer to one request is the same (at-most-once replays the cached reply),
+  - the server holds exactly the bookings its clients were told they have,
+  - no two bookings overlap and no booked slot is also offered as free.
+*/
+struct SimulationConfig {
+    size_t clients = 32;
+    uint64_t requests = 100000;  // over all clients
+    size_t facilities = 4;       // each open Monday to Friday, 08:00 to 18:00
+    LinkPolicy toServer;
+    LinkPolicy toClients;
+    std::chrono::microseconds retryTimeout{20000};
+    bool atLeastOnce = false;
+    uint64_t seed = 1;
+};
+
+struct SimulationReport {
+    uint64_t requests = 0;       // answered, each counted once
+    uint64_t transmissions = 0;  // including retransmits
+    uint64_t dropped = 0;        // datagrams lost, both directions
+    uint64_t duplicated = 0;     // datagrams delivered twice, both directions
+    uint64_t conflictingReplies = 0;  // a request answered two different ways
+    uint64_t unknownBookings = 0;     // held by the server, but no client was told
+    uint64_t missingBookings = 0;     // a client was told, but the server does not hold it
+    uint64_t overlappingBookings = 0;
+    std::chrono::microseconds virtualTime{0};
+    double serverNsPerDatagram = 0;  // wall time inside UDPServer::deliver
+    double wallSeconds = 0;
+
+    bool consistent() const {
+        return conflictingReplies == 0 && unknownBookings == 0 && missingBookings == 0 &&
+               overlappingBookings == 0;
+    }
+    std::string format() const;
+};
+
+class Simulation {
+  public:
+    static SimulationReport run(const SimulationConfig &config);
+};
+
+#endif  // SIMULATION_H
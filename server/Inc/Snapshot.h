@@ -0,0 +1,84 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "Facility.h"
+
+/*
+Fixed-layout snapshot of every facility, its free slots, bookings and day versions.
+
+The file is a header followed by four packed arrays (facility records, slot records, booking
+records, facility names). Records use host byte order so the loader can mmap the file and walk the
+arrays in place; slot arrays are written per facility in sorted order, so restoring a facility is a
+straight copy with no sorting. The header records the last WAL LSN the snapshot covers, and
+recovery only replays records after it.
+*/
+class Snapshot {
+  public:
+    // Writes to `path` atomically (temporary file, rename over the old one, directory sync)
+    static void write(const std::string &path,
+                      const std::unordered_map<std::string, Facility> &facilities,
+                      uint64_t walLsn);
+
+    // Returns false if there is no snapshot at `path`; throws if the file is invalid
+    static bool load(const std::string &path, std::unordered_map<std::string, Facility> &facilities,
+                     uint64_t &walLsn);
+
+  private:
+    static constexpr char MAGIC[4] = {'B', 'S', 'N', 'P'};
+    static constexpr uint32_t FORMAT_VERSION = 1;
+    static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    struct Header {
+        char magic[4];
+        uint32_t formatVersion;
+        uint32_t byteOrderMark;
+        uint32_t nextBookingId;
+        uint64_t walLsn;
+        uint32_t facilityCount;
+        uint32_t slotCount;
+        uint32_t bookingCount;
+        uint32_t namesSize;
+        uint64_t facilitiesOffset;
+        uint64_t slotsOffset;
+        uint64_t bookingsOffset;
+        uint64_t namesOffset;
+    };
+
+    struct FacilityRecord {
+        uint32_t nameOffset;  // into the names blob
+        uint32_t nameLength;
+        uint32_t firstSlot;
+        uint32_t slotCount;
+        uint32_t firstBooking;
+        uint32_t bookingCount;
+        uint32_t dayVersions[7];
+        uint32_t reserved;
+    };
+
+    struct SlotRecord {
+        uint8_t day;
+        uint8_t reserved;
+        uint16_t startTime;  // HHMM
+        uint16_t endTime;    // HHMM
+        uint16_t padding;
+    };
+
+    struct BookingRecord {
+        uint32_t bookingId;
+        uint8_t day;
+        uint8_t reserved;
+        uint16_t startTime;  // HHMM
+        uint16_t endTime;    // HHMM
+        uint16_t padding;
+    };
+
+    static_assert(sizeof(Header) == 72, "snapshot header layout changed");
+    static_assert(sizeof(FacilityRecord) == 56, "snapshot facility layout changed");
+    static_assert(sizeof(SlotRecord) == 8, "snapshot slot layout changed");
+    static_assert(sizeof(BookingRecord) == 12, "snapshot booking layout changed");
+};
+
+#endif  // SNAPSHOT_H
@@ -0,0 +1,60 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*
+Bounded lock-free single-producer / single-consumer ring.
+
+Capacity is rounded up to a power of two. Head and tail live on separate cache lines and each side
+keeps a cached copy of the other side's index, so the shared counters are only re-read when the
+ring looks full (producer) or empty (consumer).
+*/
+template <typename T>
+class SpscQueue {
+  public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+        slots_ = std::make_unique<T[]>(size);
+    }
+
+    // Producer side; returns false if the ring is full
+    bool tryPush(T &&value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ > mask_) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ > mask_) return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns false if the ring is empty
+    bool tryPop(T &out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_) return false;
+        }
+        out = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    std::unique_ptr<T[]> slots_;
+    size_t mask_;
+
+    alignas(64) std::atomic<size_t> head_{0};  // next slot to pop
+    size_t cachedTail_ = 0;                    // consumer's view of tail_
+    alignas(64) std::atomic<size_t> tail_{0};  // next slot to push
+    size_t cachedHead_ = 0;                    // producer's view of head_
+};
+
+#endif  // SPSC_QUEUE_H
@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include "TextWriter.h"
+
+/*
+Request instrumentation, owned by the request thread.
+
+LatencyHistogram is HDR-style: values are grouped by power of two and each power of two is split
+into SUB_BUCKETS linear steps, so a bucket is never wider than 1/SUB_BUCKETS of the values in it.
+Recording is a bit_width, a shift and two increments, with no allocation and no atomics.
+*/
+class LatencyHistogram {
+  public:
+    static constexpr int SUB_BUCKET_BITS = 3;  // 8 steps per power of two: <= 12.5% error
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 40;  // ~1100 s in nanoseconds; larger values are clamped
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    void record(uint64_t nanos) {
+        ++counts_[bucketOf(nanos)];
+        ++count_;
+        sum_ += nanos;
+        max_ = std::max(max_, nanos);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    uint64_t mean() const { return count_ ? sum_ / count_ : 0; }
+    uint64_t percentile(double p) const;  // upper bound of the bucket holding the p-th percentile
+    void merge(const LatencyHistogram &other);
+
+    // Values below 2 * SUB_BUCKETS get a bucket each; above that, the top SUB_BUCKET_BITS + 1
+    // bits pick the bucket within the power of two
+    static size_t bucketOf(uint64_t value) {
+        value = std::min(value, (uint64_t{2} << MAX_EXPONENT) - 1);
+        int shift = std::max(static_cast<int>(std::bit_width(value)) - 1 - SUB_BUCKET_BITS, 0);
+        return static_cast<size_t>(shift) * SUB_BUCKETS + static_cast<size_t>(value >> shift);
+    }
+    static uint64_t bucketUpperBound(size_t index);
+
+  private:
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct ServerStats {
+    static constexpr size_t OPERATIONS = 11;  // indexed by Operation value; 0 collects unknown ones
+
+    std::array<LatencyHistogram, OPERATIONS> latency;  // receive until the reply is sent or held
+    uint64_t requests = 0;          // handled here, duplicates included
+    uint64_t failed = 0;            // answered with an error status
+    uint64_t duplicates = 0;        // request key in the duplicate filter and not yet expired
+    uint64_t cacheHits = 0;         // ... and answered from the cached reply
+    uint64_t malformed = 0;         // could not be unmarshalled, dropped
+    uint64_t requestsDropped = 0;   // simulated request loss
+    uint64_t repliesDropped = 0;    // simulated reply loss
+    uint64_t relayed = 0;           // follower: mutations relayed to the primary
+    uint64_t repliesHeld = 0;       // replies that waited for the WAL sync or the backups
+    uint64_t sessionMoves = 0;      // a session token came back from a new address
+    uint64_t waitlisted = 0;        // WAITLIST requests that got in line
+    uint64_t waitlistBooked = 0;    // ... and were booked when the time freed up
+
+    static const char *operationName(size_t operation);
+    // One line per operation that has been seen, then the counters; with every operation seen
+    // this still leaves room in a 1 KB reply for a few facility lines
+    void format(uint64_t notificationsSent, TextWriter &out) const;
+};
+
+#endif  // STATS_H
@@ -0,0 +1,87 @@
+#ifndef TEXT_WRITER_H
+#define TEXT_WRITER_H
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/*
+Text replies and notifications are written with this into a buffer the caller owns, usually a
+TextBuffer on the stack, so building one costs no heap allocation. Integers go through
+std::to_chars and the constant parts are string_views. What does not fit is dropped and
+truncated() says so; MAX_TEXT_REPLY is sized so that no reply to a request that fit in a datagram
+gets there.
+*/
+class TextWriter {
+  public:
+    TextWriter(char *buffer, size_t capacity)
+        : begin_(buffer), end_(buffer), limit_(buffer + capacity) {}
+    TextWriter(const TextWriter &) = delete;
+    TextWriter &operator=(const TextWriter &) = delete;
+
+    TextWriter &operator<<(std::string_view text) {
+        size_t count = std::min(text.size(), static_cast<size_t>(limit_ - end_));
+        truncated_ |= count < text.size();
+        end_ = std::copy_n(text.data(), count, end_);
+        return *this;
+    }
+    TextWriter &operator<<(char c) { return *this << std::string_view(&c, 1); }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    TextWriter &operator<<(Integer value) {
+        auto [end, error] = std::to_chars(end_, limit_, value);
+        if (error != std::errc()) {
+            truncated_ = true;
+            return *this;
+        }
+        end_ = end;
+        return *this;
+    }
+
+    // `value` in at least `width` digits, zero-filled on the left: padded(800, 4) is "0800"
+    TextWriter &padded(unsigned value, int width) {
+        char digits[10];
+        auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+        for (int pad = width - static_cast<int>(end - digits); pad > 0; --pad) *this << '0';
+        return *this << std::string_view(digits, static_cast<size_t>(end - digits));
+    }
+
+    std::string_view view() const { return {begin_, static_cast<size_t>(end_ - begin_)}; }
+    std::string str() const { return std::string(view()); }
+    size_t size() const { return static_cast<size_t>(end_ - begin_); }
+    size_t remaining() const { return static_cast<size_t>(limit_ - end_); }
+    bool truncated() const { return truncated_; }
+    void clear() {
+        end_ = begin_;
+        truncated_ = false;
+    }
+
+  private:
+    char *begin_;
+    char *end_;
+    char *limit_;
+    bool truncated_ = false;
+};
+
+// The storage comes first among the bases, so it exists before the TextWriter is pointed at it
+template <size_t Capacity>
+struct TextStorage {
+    std::array<char, Capacity> storage;
+};
+
+// A TextWriter with its own storage
+template <size_t Capacity>
+class TextBuffer : private TextStorage<Capacity>, public TextWriter {
+  public:
+    TextBuffer() : TextWriter(this->storage.data(), Capacity) {}
+};
+
+// Longer than any text reply: a facility name is at most a request datagram (1024 bytes) and the
+// longest sentence around it, the availability list, adds under 500
+constexpr size_t MAX_TEXT_REPLY = 2048;
+
+#endif  // TEXT_WRITER_H
@@ -0,0 +1,107 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+Hashed timing wheel driven by a single steady_timer.
+
+Every tick the cursor advances one bucket. An entry is parked in the bucket its deadline hashes to
+together with the number of full revolutions still to wait, so it costs sizeof(T) + 4 bytes instead
+of a heap-allocated asio timer plus its handler. Entries fire in batches, never early and at most
+one tick late.
+*/
+template <typename T>
+class TimerWheel {
+  public:
+    using ExpiryHandler = std::function<void(std::vector<T> &expired)>;
+
+    TimerWheel(boost::asio::io_context &io_context, std::chrono::milliseconds tick,
+               size_t slotCount, ExpiryHandler onExpire)
+        : timer_(io_context),
+          tick_(tick),
+          buckets_(slotCount),
+          onExpire_(std::move(onExpire)) {}
+
+    void schedule(const T &payload, std::chrono::milliseconds delay) {
+        size_t ticks = static_cast<size_t>((delay.count() + tick_.count() - 1) / tick_.count());
+        if (running_) ++ticks;  // current tick is already partially elapsed
+        if (ticks == 0) ticks = 1;
+
+        size_t slot = (cursor_ + ticks) % buckets_.size();
+        uint32_t rounds = static_cast<uint32_t>((ticks - 1) / buckets_.size());
+        buckets_[slot].push_back({payload, rounds});
+        ++size_;
+
+        if (!running_) {
+            running_ = true;
+            nextTick_ = std::chrono::steady_clock::now() + tick_;
+            arm();
+        }
+    }
+
+    size_t size() const { return size_; }
+
+    void stop() {
+        running_ = false;
+        timer_.cancel();
+    }
+
+  private:
+    struct Entry {
+        T payload;
+        uint32_t rounds;  // full revolutions left before this entry fires
+    };
+
+    boost::asio::steady_timer timer_;
+    std::chrono::milliseconds tick_;
+    std::chrono::steady_clock::time_point nextTick_;
+    std::vector<std::vector<Entry>> buckets_;
+    std::vector<T> expired_;  // reused between ticks
+    ExpiryHandler onExpire_;
+    size_t cursor_ = 0;
+    size_t size_ = 0;
+    bool running_ = false;
+
+    void arm() {
+        timer_.expires_at(nextTick_);
+        timer_.async_wait([this](const boost::system::error_code &ec) {
+            if (!ec && running_) advance();
+        });
+    }
+
+    void advance() {
+        cursor_ = (cursor_ + 1) % buckets_.size();
+        auto &bucket = buckets_[cursor_];
+
+        for (size_t i = 0; i < bucket.size();) {
+            if (bucket[i].rounds == 0) {
+                expired_.push_back(std::move(bucket[i].payload));
+                bucket[i] = std::move(bucket.back());
+                bucket.pop_back();
+            } else {
+                --bucket[i].rounds;
+                ++i;
+            }
+        }
+
+        if (!expired_.empty()) {
+            size_ -= expired_.size();
+            onExpire_(expired_);
+            expired_.clear();
+        }
+
+        if (size_ == 0) {
+            running_ = false;  // idle wheel holds no timer in the queue
+            return;
+        }
+        nextTick_ += tick_;
+        arm();
+    }
+};
+
+#endif  // TIMER_WHEEL_H
@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+Request trace: every datagram the server received from a client and every reply it sent back,
+with the time and the client. Written on the request thread while capture is on; read back by
+trace_replay. Monitor notifications are not recorded.
+
+On disk (network byte order): [Magic][Version][Reserved], then per datagram
+[TimestampUs(8)][Kind][AddressLength][Address][Port][Length][Datagram]
+TimestampUs counts from the start of the capture; AddressLength is 4 or 16.
+*/
+namespace TraceFormat {
+constexpr char MAGIC[4] = {'B', 'T', 'R', 'C'};
+constexpr uint16_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 8;  // [Magic][Version][Reserved]
+}  // namespace TraceFormat
+
+struct TraceRecord {
+    enum class Kind : uint8_t { Request = 0, Reply = 1 };
+
+    uint64_t timestampUs = 0;
+    Kind kind = Kind::Request;
+    boost::asio::ip::udp::endpoint client;
+    std::vector<uint8_t> datagram;
+};
+
+class TraceWriter {
+  public:
+    explicit TraceWriter(const std::string &path);  // truncates; throws if it can't be created
+    ~TraceWriter();
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    void write(TraceRecord::Kind kind, const boost::asio::ip::udp::endpoint &client,
+               const void *data, size_t size);
+
+  private:
+    std::FILE *file_;
+    std::chrono::steady_clock::time_point started_;
+    std::vector<uint8_t> record_;  // reused for every record
+};
+
+class TraceReader {
+  public:
+    explicit TraceReader(const std::string &path);  // throws if missing or not a trace
+    ~TraceReader();
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+
+    bool next(TraceRecord &record);  // false at the end of the trace or at a torn tail
+
+  private:
+    std::FILE *file_;
+};
+
+#endif  // TRACE_H
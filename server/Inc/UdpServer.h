@@ -7,13 +7,29 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <functional>
 #include <map>
 #include "Facility.h"
+#include "FacilityCatalog.h"
 #include "Message.h"
+#include "NetworkEmulator.h"
+#include "NotificationFanout.h"
+#include "Replication.h"
+#include "Snapshot.h"
+#include "Stats.h"
+#include "TextWriter.h"
+#include "Trace.h"
+#include "Waitlist.h"
+#include "WriteAheadLog.h"
 #include <set>
 #include <tuple>
 #include <chrono>
 #include <queue>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <thread>
 
 using namespace boost::asio;
 using boost::asio::ip::udp;
@@ -28,16 +44,60 @@ class UDPServer {
     void start();  // Start the server
     void stop();   // stop the server
 
-  private:
-    struct MonitorInfo {
-        udp::endpoint clientEndpoint;  // Client's IP and port
-        Util::Day day;
-        uint16_t startTime;
-        uint16_t endTime;
-        uint32_t monitorInterval;  // Monitor duration in seconds
-        std::shared_ptr<boost::asio::steady_timer> timer;
-    };
+    // Replay `path` into the facilities, then log every mutation to it (call before start).
+    // Records up to `fromLsn` are skipped because a loaded snapshot already contains them.
+    void enableWriteAheadLog(const std::string &path, uint64_t fromLsn = 0);
+
+    // Write every facility to `snapshotPath` and empty the WAL (call after stop)
+    void checkpoint(const std::string &snapshotPath);
+
+    // Primary: stream every committed mutation to `backups` and hold each reply until the live
+    // backups have applied it; followers may register on `followerPort`. On a backup this takes
+    // effect once it takes over.
+    void replicateTo(std::vector<udp::endpoint> backups, unsigned short followerPort = 0);
+
+    // Backup: reject client requests and apply the primary's stream from `replicationPort`,
+    // becoming the primary once it has been silent for `takeoverAfter`
+    void runAsBackup(unsigned short replicationPort, std::chrono::milliseconds takeoverAfter);
+    bool isBackup() const { return backup_ != nullptr && !primaryEndpoint_; }
+
+    // Allow reloadCatalog(); `current` describes the catalog the server was started with. If WAL
+    // replay changed the catalog since, a reload brings it back in line with the file.
+    void enableCatalogReload(const std::string &path, unsigned threads,
+                             FacilityCatalog::Definition current);
+    // Re-read the catalog off the request thread and apply only what changed. Unchanged
+    // facilities keep their bookings, subscriptions and duplicate-filter entries; bookings the new
+    // hours cannot hold are cancelled. Backups and followers take catalog changes from the primary.
+    void reloadCatalog();
+
+    // Follower: apply the stream from `primaryReplication`, answer QUERY/MONITOR/RESYNC locally and
+    // relay mutations to the primary's client endpoint `primary`
+    void runAsFollower(const udp::endpoint &primary, const udp::endpoint &primaryReplication);
+
+    // Drop, delay, duplicate, reorder or rate-limit client datagrams in each direction, with every
+    // decision drawn from `seed` (monitor notifications are not affected)
+    void emulateNetwork(const LinkPolicy &inbound, const LinkPolicy &outbound, uint64_t seed);
 
+    // What a STATS request returns; enableStatsDump() also logs it every `interval`
+    std::string statsReport() const;
+    void enableStatsDump(std::chrono::seconds interval);
+
+    // Record every client request as received and every reply as sent to `path` until stop()
+    void enableCapture(const std::string &path);
+
+    // Simulation: replies go to `transport` instead of the socket, the duplicate filter reads
+    // `clock`, and requests come in through deliver() on the caller's thread. Monitor
+    // notifications still use the socket.
+    using TransportFunction =
+        std::function<void(const std::string &datagram, const udp::endpoint &client)>;
+    using ClockFunction = std::function<std::chrono::steady_clock::time_point()>;
+    void useTransport(TransportFunction transport, ClockFunction clock);
+    void deliver(const std::vector<uint8_t> &datagram, const udp::endpoint &client) {
+        handle_request(datagram, client);
+    }
+    const unordered_map<string, Facility> &getFacilities() const { return facilities; }
+
+  private:
     // Boost Asio context and socket
     io_context &io_context_;
     short port_;
@@ -46,60 +106,174 @@ class UDPServer {
     array<char, 1024> recv_buffer_;
     bool atLeastOnce_;  // True for At-Least-Once, False for At-Most-Once
 
-    const float SEND_SUCCESS_RATE =
-        0;  // 100% success rate for send message (the smaller , the higher rate)
-
-    const float DROP_REQUEST_PROBABILITY =
-        0;  // 100% success rate for receiving request (the smaller , the higher rate)
+    // Fault injection on client requests and replies; none unless emulateNetwork() was called
+    std::unique_ptr<NetworkEmulator> network_;
+    std::unique_ptr<TraceWriter> capture_;  // before the emulator, so it sees what clients sent
+    TransportFunction transport_;             // replaces the socket when set
+    ClockFunction clock_ = &std::chrono::steady_clock::now;
 
     // Facility and client management
     unordered_map<string, Facility> facilities;
     Facility &getFacilityOrThrow(const string &facilityName);
 
     // Store processed request keys
-    std::unordered_map<std::string,
-                       std::pair<std::chrono::steady_clock::time_point, ResponseMessage>>
+    std::unordered_map<RequestKey,
+                       std::pair<std::chrono::steady_clock::time_point, ResponseMessage>,
+                       RequestKey::Hash>
         processedRequests;
     const size_t MAX_PROCESSED_REQUESTS = 1000;
-    std::queue<std::string> requestOrder;  // Tracks insertion order
+    std::queue<RequestKey> requestOrder;  // Tracks insertion order
+
+    // Monitor subscriptions and their updates are handled off the request path
+    NotificationFanout fanout_;
+
+    // Requests waiting for taken time; only the primary keeps one, and it is not logged
+    Waitlist waitlist_;
 
-    // for monitoring clients
-    using TimeRangeMap = multimap<uint16_t, MonitorInfo>;  // map startTime
-    using DayMap = unordered_map<Util::Day, TimeRangeMap>;
-    using FacilityMonitorMap = unordered_map<string, DayMap>;
-    FacilityMonitorMap monitoringClients;
+    // Instrumentation; stats_ belongs to the request thread, the fan-out thread counts its sends
+    ServerStats stats_;
+    std::atomic<uint64_t> notificationsSent_{0};
+    std::chrono::seconds statsInterval_{0};
+    steady_timer statsTimer_;
+    static constexpr size_t STATS_TOP_FACILITIES = 5;
+    static constexpr size_t STATS_REPLY_BYTES = 1024;  // the reply must fit a 1 KB datagram
+    void dumpStats();
+
+    // Durability: a mutation's reply is held until its WAL batch has been synced
+    struct PendingReply {
+        uint64_t lsn;
+        std::string data;
+        udp::endpoint endpoint;
+    };
+    std::unique_ptr<WriteAheadLog> wal_;
+    uint64_t lastLoggedLsn_ = 0;
+    uint64_t durableLsn_ = 0;
+    std::deque<PendingReply> pendingReplies_;  // ascending lsn
+
+    // ... and, when replicating, until every live backup has applied it
+    std::vector<udp::endpoint> replicaEndpoints_;
+    unsigned short followerPort_ = 0;
+    std::unique_ptr<ReplicationPrimary> replicator_;
+    std::unique_ptr<ReplicationBackup> backup_;
+    uint64_t replicatedLsn_ = 0;
+
+    // Catalog reload: the reload thread parses the file and diffs it against the published
+    // definition, which holds only the hours text of each facility and is swapped atomically. The
+    // request thread then changes `facilities` in place, logging the change like any mutation so
+    // the WAL and the replicas follow it. A definition entry left empty means the facility's hours
+    // came from the WAL or a primary, so the next reload applies the file's hours to it.
+    struct CatalogChange {
+        std::unordered_map<std::string, Facility> upserts;  // new or with different hours
+        std::vector<std::string> removed;
+        std::shared_ptr<const FacilityCatalog::Definition> definition;
+    };
+    std::string catalogPath_;
+    unsigned catalogThreads_ = 1;
+    std::atomic<std::shared_ptr<const FacilityCatalog::Definition>> catalogDefinition_;
+    std::atomic<bool> reloadInProgress_{false};
+    std::thread reloadThread_;
+
+    // Segments logged as CATALOG_HOURS, waiting for their facility's CATALOG_APPLY
+    std::unordered_map<std::string, Facility> catalogPending_;
+
+    void applyCatalogChange(CatalogChange &change);
+    void logCatalogHours(const Facility &fresh);
+    void replaceHours(Facility &current, Facility &fresh);
+    void removeFacility(const std::string &name);
+    void applyCatalogRecord(const WalRecord &record);
+    void markCatalogReplayed(const std::string &name);
+
+    // Protocol sessions (Message.h), opened by a HELLO for version 2 or later: facility IDs are
+    // handed out once and never reused, a session remembers the HELLO's request ID and version
+    // and is found by its token, or by the address it was last seen at
+    struct ProtocolSession {
+        uint32_t helloRequestId;
+        uint8_t version;
+        udp::endpoint endpoint;
+    };
+    std::vector<std::string> facilityNames_;  // ID - 1 -> name, as sent in HelloReply
+    std::unordered_map<std::string, uint32_t> facilityIds_;
+    std::unordered_map<uint64_t, ProtocolSession> sessions_;  // by token
+    std::map<udp::endpoint, uint64_t> sessionTokens_;         // the latest session at an address
+    std::queue<uint64_t> sessionOrder_;
+    FastRandom tokenRandom_;
+    static constexpr size_t MAX_SESSIONS = 10000;
+
+    void assignFacilityId(const std::string &name);
+    uint64_t openSession(uint32_t helloRequestId, uint8_t version, const udp::endpoint &client);
+    const ProtocolSession *findSession(const RequestMessage &request) const;
+    bool decodeCompact(const std::vector<uint8_t> &requestData, const udp::endpoint &client,
+                       RequestMessage &request);
+
+    // Follower: mutations are relayed under follower-assigned request IDs so that requests from
+    // different clients cannot collide in the primary's duplicate filter
+    struct ForwardedRequest {
+        udp::endpoint clientEndpoint;
+        uint32_t requestId;
+        RequestKey requestKey;
+    };
+    std::optional<udp::endpoint> primaryEndpoint_;
+    std::unique_ptr<udp::socket> forwardSocket_;
+    std::unordered_map<uint32_t, ForwardedRequest> forwardedRequests_;  // by relayed request ID
+    std::unordered_map<RequestKey, uint32_t, RequestKey::Hash> relayedIds_;  // -> relayed ID
+    std::queue<uint32_t> forwardOrder_;
+    uint32_t nextRelayedId_ = 1;
+    array<uint8_t, 1024> forwardBuffer_;
+    udp::endpoint forwardSender_;
+
+    void logMutation(Operation operation, const string &facility, uint32_t bookingId,
+                     const Facility::TimeSlot &slot);
+    void applyWalRecord(const WalRecord &record);
+    void applyReplicatedRecord(const WalRecord &record);
+    void takeOver();
+    void forwardToPrimary(const RequestMessage &request, const RequestKey &requestKey);
+    void receiveForwardedReplies();
+    void stalenessNote(TextWriter &out) const;  // appended to replies a replica answers
+    uint64_t committedLsn() const;
+    void releaseDurableReplies(uint64_t lsn);
+    void releaseCommittedReplies();
+    void failHeldReplies();
 
     void do_receive();  // Async receive function
     void handle_receive(const boost::system::error_code &error,
                         size_t bytes_transferred);  // Handle incoming request
-    void do_send(const string &message,
-                 const udp::endpoint &endpoint);  // Send response (with probability to fail)
+    void handle_request(const std::vector<uint8_t> &requestData, const udp::endpoint &client);
+    void do_send(string message,
+                 const udp::endpoint &endpoint);  // Send response (through the network emulator)
+    void send_datagram(string message, const udp::endpoint &endpoint);
     void do_send_reliable(
-        const std::string &message,
-        const udp::endpoint &endpoint);  // Send response (100% success rate), only used for
-                                         // callback function (notifyClient)
+        const uint8_t *data, size_t size,
+        const udp::endpoint &endpoint);  // Send response (100% success rate), only used by the
+                                         // notification fan-out thread
 
     // Facility operations
-    string queryAvailability(const std::string &facility, const Util::Day &day);
+    void queryAvailability(const std::string &facility, const Util::Day &day, TextWriter &out);
+
+    // Booking operations report what happened; the reply is rendered from that, as text or not
+    OpResult bookFacility(const string &facility, const Facility::TimeSlot &slot);
+
+    OpResult modifyBookFacility(const string &facility, uint32_t bookingId, int offsetMinutes);
 
-    string bookFacility(const string &facility, const Util::Day &day, uint16_t startTime,
-                        uint16_t endTime);
+    OpResult extendBookFacility(const string &facility, uint32_t bookingId, int extensionMinutes);
 
-    string modifyBookFacility(string &facility, uint32_t bookingId, int offsetMinutes);
+    OpResult cancelBookFacility(const string &facility, uint32_t bookingId);
 
-    string extendBookFacility(std::string &facility, uint32_t bookingId, int extensionMinutes);
+    // Booked at once if the range is free, otherwise queued until it frees up (Waitlist.h)
+    OpResult waitlistFacility(const RequestMessage &request, const Facility::TimeSlot &range,
+                              bool binaryResults);
+    void bookForWaitlist(Facility &facility, Util::Day day, uint64_t freedMask);
 
-    string cancelBookFacility(const string &facility, uint32_t bookingId);
+    void registerMonitorClient(const std::string &facility, const Facility::TimeSlot &range,
+                               uint32_t interval, uint8_t flags,
+                               const udp::endpoint &clientEndpoint, uint64_t sessionToken);
 
-    string registerMonitorClient(const std::string &facility, const Util::Day &day,
-                                 uint16_t startTime, uint16_t endTime, uint32_t interval,
-                                 const udp::endpoint &clientEndpoint);
+    string resyncAvailability(const std::string &facility, const Util::Day &day);
 
-    void removeMonitorClient(const string &facility, const udp::endpoint &clientEndpoint);
+    string helloClient(const RequestMessage &request, const udp::endpoint &client);
 
     void notifyMonitorClients(
-        const std::string &facility, uint16_t changedStartTime,
-        uint16_t changedEndTime);  // Notify monitoring clients when availability changes
+        const Facility &facility, Util::Day day,
+        uint64_t changedMask);  // Notify monitoring clients when availability changes
 };
 
 #endif  // UDP_SERVER_H
@@ -1,19 +1,74 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <compare>
+#include <cstdint>
+#include <iterator>
 #include <string>
-#include <random>
+#include <string_view>
+
+// xoshiro256** seeded through splitmix64: a few nanoseconds per number and no allocation.
+// Not for cryptographic use.
+class FastRandom {
+  public:
+    explicit FastRandom(uint64_t seed);
+    uint64_t next();
+    double nextDouble();  // uniform in [0, 1)
+
+  private:
+    uint64_t state_[4];
+};
+
+// Time of day as minutes after midnight, what Facility, the fan-out and the server compute with.
+// HHMM (1030 for 10:30) is what the wire, the WAL, snapshots and the catalog carry; it is converted
+// once where a time comes in or goes out. Half-hour slot i starts at ofSlot(i).
+class TimeOfDay {
+  public:
+    static constexpr int MINUTES_PER_SLOT = 30;
+
+    constexpr TimeOfDay() = default;
+    constexpr explicit TimeOfDay(int minutes) : minutes_(static_cast<uint16_t>(minutes)) {}
+    static constexpr TimeOfDay fromHHMM(int hhmm) {
+        return TimeOfDay(hhmm / 100 * 60 + hhmm % 100);
+    }
+    static constexpr TimeOfDay ofSlot(int slot) { return TimeOfDay(slot * MINUTES_PER_SLOT); }
+
+    constexpr int minutes() const { return minutes_; }
+    constexpr int slot() const { return minutes_ / MINUTES_PER_SLOT; }  // the one it falls in
+    constexpr int hour() const { return minutes_ / 60; }
+    constexpr int minute() const { return minutes_ % 60; }
+    constexpr uint16_t toHHMM() const { return static_cast<uint16_t>(hour() * 100 + minute()); }
+
+    constexpr TimeOfDay operator+(int minutes) const { return TimeOfDay(minutes_ + minutes); }
+    constexpr int operator-(TimeOfDay other) const { return minutes_ - other.minutes_; }
+    constexpr auto operator<=>(const TimeOfDay &other) const = default;
+
+  private:
+    uint16_t minutes_ = 0;
+};
+
+static_assert(TimeOfDay::fromHHMM(1030).minutes() == 630 && TimeOfDay(630).toHHMM() == 1030);
+static_assert(TimeOfDay::fromHHMM(1745).slot() == 35 && TimeOfDay::ofSlot(35).toHHMM() == 1730);
 
 class Util {
   public:
     enum class Day { Monday, Tuesday, Wednesday, Thursday, Friday, Saturday, Sunday };
+    // False for values past Sunday, which a cast from a wire byte can produce
+    static constexpr bool isDay(Day day) {
+        return static_cast<unsigned>(day) <= static_cast<unsigned>(Day::Sunday);
+    }
     static Day stringToDay(const std::string &dayStr);
     static std::string dayToString(Day day);
+    static constexpr std::string_view dayName(Day day) {
+        constexpr std::string_view names[] = {"Monday", "Tuesday",  "Wednesday", "Thursday",
+                                               "Friday", "Saturday", "Sunday"};
+        size_t index = static_cast<size_t>(day);
+        return index < std::size(names) ? names[index] : "Unknown";
+    }
     static std::pair<int, int> parseTime(uint16_t time);
-    static int toHHMM(int minutes);
-    static int toMinutes(int hhmm);
-
-    static float generateFpRandNumber();
+    // Plain integer conversions for wire values, which may be out of range
+    static constexpr int toHHMM(int minutes) { return minutes / 60 * 100 + minutes % 60; }
+    static constexpr int toMinutes(int hhmm) { return hhmm / 100 * 60 + hhmm % 100; }
 };
 
 #endif
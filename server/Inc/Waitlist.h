@@ -0,0 +1,68 @@
+#ifndef WAITLIST_H
+#define WAITLIST_H
+
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Facility.h"
+#include "Util.h"
+
+/*
+Requests waiting for a time range that was taken, per facility and day. When time frees up,
+match() books it for the waiters whose whole range is now free, higher priority first and in the
+order they joined within a priority, so one cancellation ends in one booking instead of a herd of
+clients polling for it. A waiter leaves the list when it gets its booking or its waiting time
+runs out; expired waiters are dropped whenever add() or match() comes across them, so nothing
+runs on a timer and the clock may be virtual.
+*/
+class Waitlist {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        Facility::TimeSlot range;
+        uint8_t priority = 0;
+        uint64_t client = 0;  // RequestKey::client; a client waits once per range
+        uint32_t requestId = 0;  // of the WAITLIST request, which the confirmation answers
+        boost::asio::ip::udp::endpoint endpoint;  // for the confirmation, unless its session moved
+        uint64_t sessionToken = 0;
+        bool binaryResults = false;  // confirm with an OpResult rather than a sentence
+        Clock::time_point expiresAt;
+    };
+    struct Assignment {
+        Waiter waiter;
+        uint32_t bookingId;
+    };
+
+    static constexpr size_t MAX_WAITERS_PER_DAY = 1000;
+
+    // The waiter's place in line, counting from 1, or 0 if the day's line is full (or there is no
+    // such day). Joining again for the same range renews the waiting time and keeps the place
+    // among waiters of the new priority.
+    size_t add(const std::string &facility, Waiter waiter, Clock::time_point now);
+
+    // Books what it can of the time in `freedMask` for the first eligible waiters
+    std::vector<Assignment> match(Facility &facility, Util::Day day, uint64_t freedMask,
+                                  Clock::time_point now);
+
+    void remove(const std::string &facility);  // the facility closed
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+  private:
+    using Line = std::map<std::pair<int, uint64_t>, Waiter>;  // by (-priority, arrival)
+
+    std::unordered_map<std::string, std::array<Line, 7>> lines_;  // by facility, then day
+    uint64_t nextArrival_ = 0;
+    size_t size_ = 0;
+
+    void dropExpired(Line &line, Clock::time_point now);
+};
+
+#endif  // WAITLIST_H
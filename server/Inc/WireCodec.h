@@ -0,0 +1,426 @@
+#ifndef WIRE_CODEC_H
+#define WIRE_CODEC_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+Declarative wire layouts. A message lists its fields once, in wire order, as member pointers
+
+    using Wire = WireLayout<WireField<&DeltaMessage::facilityName>,
+                            WireField<&DeltaMessage::day, uint8_t>, ...>;
+
+and gets from the list its exact encoded size, an encoder into a caller-supplied buffer and a
+decoder, both bounds-checked. Integers go big-endian at their own width (or the width given as
+the second WireField argument), enums as their underlying type, strings as [Length(2)][Bytes],
+vectors as [Count(2)][Elements]. WireVarint<T> as the second argument packs an integer into 7 bits
+per byte, low group first with the top bit set on all but the last; signed ones are zigzagged
+first so that small negatives stay short.
+
+WireOptional<...> groups std::optional members that travel together at the end of a message:
+the group is written only when all of its members are set and read only when all of its bytes
+are there, and the first group that is left out ends the message.
+*/
+
+class WireWriter {
+  public:
+    constexpr WireWriter(uint8_t *data, size_t capacity) : data_(data), capacity_(capacity) {}
+
+    template <typename T>
+    constexpr void put(T value) {
+        static_assert(std::is_integral_v<T>, "only integers go on the wire as numbers");
+        need(sizeof(T));
+        auto bits = static_cast<std::make_unsigned_t<T>>(value);
+        for (size_t i = sizeof(T); i-- > 0;) {
+            data_[size_++] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    constexpr void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            put(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        put(static_cast<uint8_t>(value));
+    }
+
+    constexpr void putBytes(const char *bytes, size_t count) {
+        need(count);
+        std::copy_n(bytes, count, data_ + size_);
+        size_ += count;
+    }
+
+    constexpr size_t size() const { return size_; }
+
+  private:
+    uint8_t *data_;
+    size_t capacity_;
+    size_t size_ = 0;
+
+    constexpr void need(size_t count) const {
+        if (capacity_ - size_ < count) {
+            throw std::runtime_error("Buffer too small for the encoded message.");
+        }
+    }
+};
+
+class WireReader {
+  public:
+    // `message` names what is being read in the overflow error
+    constexpr WireReader(const uint8_t *data, size_t size, const char *message)
+        : data_(data), size_(size), message_(message) {}
+
+    template <typename T>
+    constexpr T get() {
+        static_assert(std::is_integral_v<T>, "only integers go on the wire as numbers");
+        need(sizeof(T));
+        std::make_unsigned_t<T> bits = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bits = static_cast<std::make_unsigned_t<T>>((bits << 8) | data_[offset_++]);
+        }
+        return static_cast<T>(bits);
+    }
+
+    constexpr uint64_t getVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto byte = get<uint8_t>();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+        throw std::runtime_error(std::string("Varint too long in ") + message_ + ".");
+    }
+
+    constexpr void getBytes(std::string &out, size_t count) {
+        need(count);
+        out.assign(data_ + offset_, data_ + offset_ + count);
+        offset_ += count;
+    }
+
+    constexpr size_t remaining() const { return size_ - offset_; }
+
+    // Throws unless `count` more bytes are left
+    constexpr void need(size_t count) const {
+        if (remaining() < count) {
+            throw std::runtime_error(std::string("Buffer overflow while reading ") + message_ +
+                                     ".");
+        }
+    }
+
+  private:
+    const uint8_t *data_;
+    size_t size_;
+    size_t offset_ = 0;
+    const char *message_;
+};
+
+// How one value is encoded
+template <typename T>
+struct WireType {
+    static_assert(std::is_integral_v<T>, "no wire encoding for this type");
+    static constexpr size_t minSize = sizeof(T);
+
+    static constexpr size_t size(T) { return sizeof(T); }
+    static constexpr void encode(T value, WireWriter &writer) { writer.put(value); }
+    static constexpr T decode(WireReader &reader) { return reader.get<T>(); }
+};
+
+template <>
+struct WireType<std::string> {
+    static constexpr size_t minSize = sizeof(uint16_t);
+
+    static constexpr size_t size(const std::string &value) { return minSize + value.size(); }
+    static constexpr void encode(const std::string &value, WireWriter &writer) {
+        if (value.size() > std::numeric_limits<uint16_t>::max()) {
+            throw std::runtime_error("String too long for a wire field.");
+        }
+        writer.put(static_cast<uint16_t>(value.size()));
+        writer.putBytes(value.data(), value.size());
+    }
+    static constexpr std::string decode(WireReader &reader) {
+        std::string value;
+        reader.getBytes(value, reader.get<uint16_t>());
+        return value;
+    }
+};
+
+// Encodes like std::string, for messages that are only ever sent; nothing decodes into a view
+template <>
+struct WireType<std::string_view> {
+    static constexpr size_t minSize = sizeof(uint16_t);
+
+    static constexpr size_t size(std::string_view value) { return minSize + value.size(); }
+    static constexpr void encode(std::string_view value, WireWriter &writer) {
+        if (value.size() > std::numeric_limits<uint16_t>::max()) {
+            throw std::runtime_error("String too long for a wire field.");
+        }
+        writer.put(static_cast<uint16_t>(value.size()));
+        writer.putBytes(value.data(), value.size());
+    }
+};
+
+template <typename T>
+struct WireType<std::vector<T>> {
+    static constexpr size_t minSize = sizeof(uint16_t);
+
+    static constexpr size_t size(const std::vector<T> &values) {
+        size_t total = minSize;
+        for (const auto &value : values) total += WireType<T>::size(value);
+        return total;
+    }
+    static constexpr void encode(const std::vector<T> &values, WireWriter &writer) {
+        if (values.size() > std::numeric_limits<uint16_t>::max()) {
+            throw std::runtime_error("Too many elements for a wire field.");
+        }
+        writer.put(static_cast<uint16_t>(values.size()));
+        for (const auto &value : values) WireType<T>::encode(value, writer);
+    }
+    static constexpr std::vector<T> decode(WireReader &reader) {
+        // A count that the rest of the datagram cannot hold is rejected before allocating
+        size_t count = reader.get<uint16_t>();
+        reader.need(count * WireType<T>::minSize);
+        std::vector<T> values(count);
+        for (auto &value : values) value = WireType<T>::decode(reader);
+        return values;
+    }
+};
+
+template <typename T>
+struct WireVarint {
+    static_assert(std::is_integral_v<T>, "only integers pack into varints");
+    T value;
+
+    constexpr WireVarint(T v) : value(v) {}
+    constexpr operator T() const { return value; }
+};
+
+template <typename T>
+struct WireType<WireVarint<T>> {
+    static constexpr size_t minSize = 1;
+
+    static constexpr uint64_t zigzag(T value) {
+        if constexpr (std::is_signed_v<T>) {
+            auto wide = static_cast<int64_t>(value);
+            return (static_cast<uint64_t>(wide) << 1) ^ static_cast<uint64_t>(wide >> 63);
+        } else {
+            return value;
+        }
+    }
+    static constexpr size_t size(WireVarint<T> value) {
+        size_t bytes = 1;
+        for (uint64_t bits = zigzag(value); bits >= 0x80; bits >>= 7) ++bytes;
+        return bytes;
+    }
+    static constexpr void encode(WireVarint<T> value, WireWriter &writer) {
+        writer.putVarint(zigzag(value));
+    }
+    static constexpr WireVarint<T> decode(WireReader &reader) {
+        uint64_t bits = reader.getVarint();
+        if constexpr (std::is_signed_v<T>) {
+            auto value = static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1));
+            if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max()) {
+                throw std::runtime_error("Varint out of range.");
+            }
+            return static_cast<T>(value);
+        } else {
+            if (bits > std::numeric_limits<T>::max()) {
+                throw std::runtime_error("Varint out of range.");
+            }
+            return static_cast<T>(bits);
+        }
+    }
+};
+
+namespace wire_detail {
+
+template <typename>
+struct Member;
+template <typename Message, typename T>
+struct Member<T Message::*> {
+    using Owner = Message;
+    using Stored = T;
+};
+
+template <typename T>
+struct Unwrapped {
+    using Type = T;
+    static constexpr bool optional = false;
+};
+template <typename T>
+struct Unwrapped<std::optional<T>> {
+    using Type = T;
+    static constexpr bool optional = true;
+};
+
+template <typename T, bool = std::is_enum_v<T>>
+struct Encoded {
+    using Type = T;
+};
+template <typename T>
+struct Encoded<T, true> {
+    using Type = std::underlying_type_t<T>;
+};
+
+}  // namespace wire_detail
+
+// One member, optionally encoded at another width (e.g. an int-sized enum as one byte)
+template <auto Member, typename As = void>
+struct WireField {
+    using Message = typename wire_detail::Member<decltype(Member)>::Owner;
+    using Stored = typename wire_detail::Member<decltype(Member)>::Stored;
+    using Value = typename wire_detail::Unwrapped<Stored>::Type;
+    using Encoded = std::conditional_t<std::is_void_v<As>,
+                                       typename wire_detail::Encoded<Value>::Type, As>;
+    using Wire = WireType<Encoded>;
+
+    static constexpr bool optional = wire_detail::Unwrapped<Stored>::optional;
+    static constexpr size_t minSize = Wire::minSize;
+
+    static constexpr bool present(const Message &message) {
+        if constexpr (optional) {
+            return (message.*Member).has_value();
+        } else {
+            return true;
+        }
+    }
+
+    static constexpr size_t size(const Message &message) { return Wire::size(encoded(message)); }
+    static constexpr void encode(const Message &message, WireWriter &writer) {
+        Wire::encode(encoded(message), writer);
+    }
+    static constexpr void decode(Message &message, WireReader &reader) {
+        message.*Member = static_cast<Value>(Wire::decode(reader));
+    }
+
+    // As a part of a WireLayout: always there
+    static constexpr bool measure(const Message &message, size_t &total) {
+        static_assert(!optional, "std::optional members go in a WireOptional");
+        total += size(message);
+        return true;
+    }
+    static constexpr bool write(const Message &message, WireWriter &writer) {
+        encode(message, writer);
+        return true;
+    }
+    static constexpr bool read(Message &message, WireReader &reader) {
+        decode(message, reader);
+        return true;
+    }
+
+  private:
+    static constexpr decltype(auto) encoded(const Message &message) {
+        const Value &value = [&]() -> const Value & {
+            if constexpr (optional) {
+                return *(message.*Member);
+            } else {
+                return message.*Member;
+            }
+        }();
+        if constexpr (std::is_same_v<Encoded, Value>) {
+            return value;
+        } else {
+            return static_cast<Encoded>(value);
+        }
+    }
+};
+
+template <typename... Fields>
+struct WireOptional {
+    static constexpr size_t groupSize = (0 + ... + Fields::minSize);
+    static constexpr size_t minSize = 0;
+
+    template <typename Message>
+    static constexpr bool measure(const Message &message, size_t &total) {
+        if (!(Fields::present(message) && ...)) return false;
+        total += (0 + ... + Fields::size(message));
+        return true;
+    }
+    template <typename Message>
+    static constexpr bool write(const Message &message, WireWriter &writer) {
+        if (!(Fields::present(message) && ...)) return false;
+        (Fields::encode(message, writer), ...);
+        return true;
+    }
+    template <typename Message>
+    static constexpr bool read(Message &message, WireReader &reader) {
+        if (reader.remaining() < groupSize) return false;
+        (Fields::decode(message, reader), ...);
+        return true;
+    }
+};
+
+template <typename... Parts>
+struct WireLayout {
+    static constexpr size_t minSize = (0 + ... + Parts::minSize);
+
+    template <typename Message>
+    static constexpr size_t size(const Message &message) {
+        size_t total = 0;
+        (void)(Parts::measure(message, total) && ...);
+        return total;
+    }
+    template <typename Message>
+    static constexpr void encode(const Message &message, WireWriter &writer) {
+        (void)(Parts::write(message, writer) && ...);
+    }
+    template <typename Message>
+    static constexpr void decode(Message &message, WireReader &reader) {
+        (void)(Parts::read(message, reader) && ...);
+    }
+};
+
+// Marshalling for a message that names its layouts: visitWire(visit) calls visit once per
+// WireLayout, in wire order, and may pick the later ones from fields the earlier ones decoded
+template <typename Message>
+struct WireMessage {
+    size_t encodedSize() const {
+        size_t size = 0;
+        self().visitWire([&](auto layout) { size += decltype(layout)::size(self()); });
+        return size;
+    }
+
+    // Encodes into [out, out + capacity) and returns the bytes written; throws if they don't fit
+    size_t marshal(uint8_t *out, size_t capacity) const {
+        WireWriter writer(out, capacity);
+        self().visitWire([&](auto layout) { decltype(layout)::encode(self(), writer); });
+        return writer.size();
+    }
+
+    std::vector<uint8_t> marshal() const {
+        std::vector<uint8_t> buffer(encodedSize());
+        marshal(buffer.data(), buffer.size());
+        return buffer;
+    }
+
+    // Replaces `out` with the encoding, reusing its capacity
+    void marshal(std::string &out) const {
+        out.resize(encodedSize());
+        marshal(reinterpret_cast<uint8_t *>(out.data()), out.size());
+    }
+
+    static Message unmarshal(const uint8_t *data, size_t size) {
+        Message message;
+        WireReader reader(data, size, Message::WIRE_NAME);
+        message.visitWire([&](auto layout) { decltype(layout)::decode(message, reader); });
+        return message;
+    }
+    static Message unmarshal(const std::vector<uint8_t> &buffer) {
+        return unmarshal(buffer.data(), buffer.size());
+    }
+    static Message unmarshal(const std::string &buffer) {
+        return unmarshal(reinterpret_cast<const uint8_t *>(buffer.data()), buffer.size());
+    }
+
+  private:
+    const Message &self() const { return static_cast<const Message &>(*this); }
+};
+
+#endif  // WIRE_CODEC_H
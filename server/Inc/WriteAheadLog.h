@@ -0,0 +1,104 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Message.h"
+#include "Util.h"
+
+/*
+One committed booking mutation. BOOK/CHANGE/EXTEND carry the resulting slot, CANCEL the slot that
+was released, so replay never has to re-run the booking rules.
+
+On disk (network byte order):
+[BodyLength][Checksum][Lsn(8)][OpCode][BookingID][Day][StartTime][EndTime][NameLength][FacilityName]
+*/
+struct WalRecord {
+    uint64_t lsn = 0;
+    Operation operation = Operation::BOOK;
+    std::string facilityName;
+    uint32_t bookingId = 0;
+    Util::Day day = Util::Day::Monday;
+    uint16_t startTime = 0;  // HHMM
+    uint16_t endTime = 0;    // HHMM
+
+    void marshal(std::vector<uint8_t> &out) const;
+    // Returns the bytes consumed, or 0 if the buffer holds no complete, intact record
+    static size_t unmarshal(const uint8_t *data, size_t size, WalRecord &record);
+};
+
+/*
+Append-only write-ahead log with group commit.
+
+append() serialises a record into the open batch and returns its LSN. A flusher thread swaps the
+batch out, writes it and issues one fsync for everything in it, then reports the highest durable LSN.
+While one batch is being synced the next one fills up, so under load a single fsync covers every
+mutation that arrived during the previous one.
+
+A failed write or sync is final: the durable LSN stops where it was, the failure handler is told
+once, and nothing appended from then on is written.
+*/
+class WriteAheadLog {
+  public:
+    // Called on the flusher thread once every record up to `lsn` is on stable storage
+    using DurableHandler = std::function<void(uint64_t lsn)>;
+    // Called on the flusher thread with the errno of the write or sync that failed
+    using FailureHandler = std::function<void(int error)>;
+
+    struct ReplayResult {
+        uint64_t lastLsn = 0;
+        uint64_t validBytes = 0;  // file offset after the last intact record
+        size_t records = 0;
+    };
+
+    // Apply every intact record after `fromLsn` in order; stops at the first torn or corrupt record
+    static ReplayResult replay(const std::string &path,
+                               const std::function<void(const WalRecord &)> &apply,
+                               uint64_t fromLsn = 0);
+
+    // Opens `path` for appending, cutting off anything past `recovered.validBytes`
+    WriteAheadLog(const std::string &path, const ReplayResult &recovered);
+    ~WriteAheadLog();
+
+    void start(DurableHandler onDurable, FailureHandler onFailure);
+    void stop();  // flushes whatever is still buffered
+
+    uint64_t append(WalRecord &record);  // assigns record.lsn
+
+    // Drops every record once a snapshot covers them; only valid after stop(). LSNs keep counting.
+    void truncate();
+    bool failed() const { return failed_; }
+
+  private:
+    static constexpr char MAGIC[4] = {'B', 'W', 'A', 'L'};
+    static constexpr uint16_t FORMAT_VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 8;  // [Magic][Version][Reserved]
+
+    std::string path_;
+    std::FILE *file_ = nullptr;
+    DurableHandler onDurable_;
+    FailureHandler onFailure_;
+    std::atomic<bool> failed_{false};
+    std::thread flusher_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<uint8_t> batch_;     // filled by append(), guarded by mutex_
+    std::vector<uint8_t> flushing_;  // owned by the flusher thread
+    uint64_t nextLsn_;               // guarded by mutex_
+    uint64_t batchLastLsn_ = 0;      // guarded by mutex_
+    bool stopping_ = false;          // guarded by mutex_
+
+    void flushLoop();
+    void writeHeader();
+    bool syncFile();  // false with errno set if the data may not be on disk
+};
+
+#endif  // WRITE_AHEAD_LOG_H
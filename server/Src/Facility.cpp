@@ -1,4 +1,5 @@
 #include "Facility.h"
+#include "Logger.h"
 
 Facility::BookingInfo Facility::getBookingInfo(uint32_t bookingId) const {
     auto it = bookings.find(bookingId);
@@ -9,20 +10,37 @@ Facility::BookingInfo Facility::getBookingInfo(uint32_t bookingId) const {
     }
 }
 
-Facility::Facility(const std::string& name) : name(name) {}
+Facility::Facility(const std::string& name) : name(name) { publishAll(); }
 
 std::string Facility::getName() const { return name; }
 
 void Facility::addAvailability(const TimeSlot& slot) {
     availableSlots.push_back(slot);
     sortAvailableSlots();
+    publish(slot.day);
+}
+
+void Facility::addAvailability(std::vector<TimeSlot> slots) {
+    if (availableSlots.empty()) {
+        availableSlots = std::move(slots);
+    } else {
+        availableSlots.insert(availableSlots.end(), slots.begin(), slots.end());
+    }
+    if (!std::is_sorted(availableSlots.begin(), availableSlots.end(), slotBefore)) {
+        sortAvailableSlots();
+    }
+    publishAll();
 }
 
 bool Facility::isAvailable(const TimeSlot& requested) const {
-    uint16_t currentStart = requested.startTime;
+    return isAvailableIn(availableSlots, requested);
+}
+
+bool Facility::isAvailableIn(const std::vector<TimeSlot>& slots, const TimeSlot& requested) {
+    TimeOfDay currentStart = requested.startTime;
     while (currentStart < requested.endTime) {
         bool found = false;
-        for (const auto& slot : availableSlots) {
+        for (const auto& slot : slots) {
             if (slot.day == requested.day && slot.startTime == currentStart &&
                 slot.endTime <= requested.endTime) {
                 currentStart = slot.endTime;
@@ -35,28 +53,169 @@ bool Facility::isAvailable(const TimeSlot& requested) const {
     return true;
 }
 
-std::string Facility::getAvailability(Util::Day day) const {
-    std::ostringstream oss;
-    oss << "All slots for " << name << " on " << Util::dayToString(day) << ":\n";
+std::shared_ptr<const Facility::DayState> Facility::snapshot(Util::Day day) const {
+    return published[static_cast<size_t>(day)].load();
+}
+
+uint64_t Facility::getAvailabilityMask(Util::Day day) const {
+    return snapshot(day)->availableMask;
+}
+
+uint32_t Facility::getDayVersion(Util::Day day) const { return snapshot(day)->version; }
+
+void Facility::publish(Util::Day day) {
+    size_t d = static_cast<size_t>(day);
+    published[d].store(std::make_shared<const DayState>(
+        DayState{dayVersions[d], computeAvailabilityMask(day)}));
+}
+
+void Facility::publishAll() {
+    for (int d = 0; d < 7; ++d) publish(static_cast<Util::Day>(d));
+}
+
+uint64_t Facility::getOpeningMask(Util::Day day) const {
+    uint64_t mask = computeAvailabilityMask(day);
+    for (const auto& [bookingId, booking] : bookings) {
+        if (booking.slot.day == day) {
+            mask |= slotMask(booking.slot.startTime, booking.slot.endTime);
+        }
+    }
+    return mask;
+}
+
+uint64_t Facility::computeAvailabilityMask(Util::Day day) const {
+    // Same answer as isAvailable() for each half hour, but only over this day's (sorted) slots
+    auto first = std::partition_point(availableSlots.begin(), availableSlots.end(),
+                                      [day](const TimeSlot& s) { return s.day < day; });
+    auto last = std::partition_point(first, availableSlots.end(),
+                                     [day](const TimeSlot& s) { return s.day == day; });
+
+    uint64_t mask = 0;
+    for (int slot = 0; slot < SLOTS_PER_DAY; ++slot) {
+        TimeOfDay currentStart = TimeOfDay::ofSlot(slot);
+        TimeOfDay end = TimeOfDay::ofSlot(slot + 1);
+        auto it = first;
+        while (currentStart < end) {
+            it = std::partition_point(it, last, [currentStart](const TimeSlot& s) {
+                return s.startTime < currentStart;
+            });
+            while (it != last && it->startTime == currentStart && it->endTime > end) ++it;
+            if (it == last || it->startTime != currentStart) break;
+            currentStart = it->endTime;
+        }
+        if (currentStart >= end) mask |= uint64_t{1} << slot;
+    }
+    return mask;
+}
 
-    for (int mins = 480; mins < 1080; mins += 30) {  // 480 = 800, 1080 = 1800
-        int startTime = Util::toHHMM(mins);
-        int endTime = Util::toHHMM(mins + 30);
+namespace {
 
-        TimeSlot halfHourSlot(day, startTime, endTime);
-        bool available = isAvailable(halfHourSlot);
+// "\t0800 - 0830 -> " for every slot between opening and closing, built at compile time
+constexpr size_t LISTED_SLOTS = Facility::CLOSING.slot() - Facility::OPENING.slot();
+constexpr size_t SLOT_LINE = 16;
 
-        oss << "\t" << (startTime < 1000 ? "0" : "") << startTime << " - "
-            << (endTime < 1000 ? "0" : "") << endTime << " -> " << (available ? "yes" : "no")
-            << "\n";
+constexpr std::array<std::array<char, SLOT_LINE>, LISTED_SLOTS> slotLines() {
+    std::array<std::array<char, SLOT_LINE>, LISTED_SLOTS> lines{};
+    for (size_t i = 0; i < LISTED_SLOTS; ++i) {
+        auto put = [&line = lines[i]](size_t at, int hhmm) {
+            for (size_t digit = 4; digit-- > 0; hhmm /= 10) {
+                line[at + digit] = static_cast<char>('0' + hhmm % 10);
+            }
+        };
+        int slot = Facility::OPENING.slot() + static_cast<int>(i);
+        lines[i] = {'\t', 0, 0, 0, 0, ' ', '-', ' ', 0, 0, 0, 0, ' ', '-', '>', ' '};
+        put(1, TimeOfDay::ofSlot(slot).toHHMM());
+        put(8, TimeOfDay::ofSlot(slot + 1).toHHMM());
     }
+    return lines;
+}
+
+constexpr auto SLOT_LINES = slotLines();
+static_assert(std::string_view(SLOT_LINES[0].data(), SLOT_LINE) == "\t0800 - 0830 -> ");
+
+}  // namespace
 
-    return oss.str();
+std::string Facility::getAvailability(Util::Day day) const {
+    TextBuffer<MAX_TEXT_REPLY> text;
+    formatAvailability(day, text);
+    return text.str();
+}
+
+void Facility::formatAvailability(Util::Day day, TextWriter& out) const {
+    uint64_t mask = getAvailabilityMask(day);  // one consistent version for the whole listing
+
+    out << "All slots for " << name << " on " << Util::dayName(day) << ":\n";
+    for (size_t i = 0; i < LISTED_SLOTS; ++i) {
+        bool available = (mask >> (OPENING.slot() + static_cast<int>(i))) & 1;
+        out << std::string_view(SLOT_LINES[i].data(), SLOT_LINE) << (available ? "yes\n" : "no\n");
+    }
 }
 
 bool Facility::bookSlot(const TimeSlot& requested, uint32_t& bookingId) {
+    if (!claimSlots(requested)) {
+        return false;  // Could not fulfill full requested duration
+    }
+
+    // All required slots found — proceed to book
+    bookingId = generateBookingId();
+    bookings.emplace(bookingId, requested);
+    ++dayVersions[static_cast<size_t>(requested.day)];
+    publish(requested.day);
+
+    return true;
+}
+
+bool Facility::applyBooking(uint32_t bookingId, const TimeSlot& slot) {
+    if (bookings.count(bookingId) || !claimSlots(slot)) return false;
+
+    bookings.emplace(bookingId, slot);
+    ++dayVersions[static_cast<size_t>(slot.day)];
+    publish(slot.day);
+    nextBookingId = std::max(nextBookingId, bookingId + 1);
+    return true;
+}
+
+bool Facility::applyBookingChange(uint32_t bookingId, const TimeSlot& newSlot) {
+    auto it = bookings.find(bookingId);
+    if (it == bookings.end()) return false;
+
+    TimeSlot oldSlot = it->second.slot;
+    releaseSlots(oldSlot);
+    if (!claimSlots(newSlot)) {
+        claimSlots(oldSlot);  // rollback
+        return false;
+    }
+
+    it->second.slot = newSlot;
+    ++dayVersions[static_cast<size_t>(newSlot.day)];
+    publish(newSlot.day);
+    return true;
+}
+
+const std::vector<Facility::TimeSlot>& Facility::getAvailableSlots() const {
+    return availableSlots;
+}
+
+const std::unordered_map<uint32_t, Facility::BookingInfo>& Facility::getBookings() const {
+    return bookings;
+}
+
+void Facility::restoreState(std::vector<TimeSlot> sortedSlots,
+                            std::unordered_map<uint32_t, BookingInfo> restoredBookings,
+                            const std::array<uint32_t, 7>& versions) {
+    availableSlots = std::move(sortedSlots);
+    bookings = std::move(restoredBookings);
+    dayVersions = versions;
+    publishAll();
+}
+
+uint32_t Facility::getNextBookingId() { return nextBookingId; }
+
+void Facility::reserveBookingIds(uint32_t next) { nextBookingId = std::max(nextBookingId, next); }
+
+bool Facility::claimSlots(const TimeSlot& requested) {
     std::vector<size_t> matchedIndices;
-    uint16_t currentStart = requested.startTime;
+    TimeOfDay currentStart = requested.startTime;
 
     // Find all matching slots that make up the requested time
     for (size_t i = 0; i < availableSlots.size(); ++i) {
@@ -71,77 +230,68 @@ bool Facility::bookSlot(const TimeSlot& requested, uint32_t& bookingId) {
     }
 
     if (currentStart != requested.endTime) {
-        return false;  // Could not fulfill full requested duration
+        return false;
     }
 
-    // All required slots found — proceed to book
-    bookingId = generateBookingId();
-    bookings.emplace(bookingId, requested);
-
     // Remove matched slots from availableSlots (in reverse to avoid shifting)
     for (auto it = matchedIndices.rbegin(); it != matchedIndices.rend(); ++it) {
         availableSlots.erase(availableSlots.begin() + *it);
     }
-
     return true;
 }
 
-bool Facility::modifyBooking(uint32_t bookingId, int offsetMinutes, std::string& errorMessage) {
+void Facility::releaseSlots(const TimeSlot& slot) {
+    for (const auto& part : splitIntoThirtyMinSlots(slot)) {
+        availableSlots.push_back(part);
+    }
+    sortAvailableSlots();
+}
+
+Facility::ChangeResult Facility::modifyBooking(uint32_t bookingId, int offsetMinutes) {
     auto it = bookings.find(bookingId);
     if (it == bookings.end()) {
-        errorMessage = "Invalid Booking ID.";
-        return false;
+        return ChangeResult::InvalidBooking;
     }
 
     BookingInfo& booking = it->second;
     TimeSlot oldSlot = booking.slot;
 
-    int newStartMins = Util::toMinutes(oldSlot.startTime) + offsetMinutes;
-    int newEndMins = Util::toMinutes(oldSlot.endTime) + offsetMinutes;
+    int newStart = oldSlot.startTime.minutes() + offsetMinutes;
+    int newEnd = oldSlot.endTime.minutes() + offsetMinutes;
 
-    int newStart = Util::toHHMM(newStartMins);
-    int newEnd = Util::toHHMM(newEndMins);
-
-    if (newStart < 800 || newEnd > 1800 || newStart >= newEnd) {
-        std::cerr << "[Server] Exceed time range.\n";
-        errorMessage = "Invalid time range after applying offset.";
-        return false;
+    if (newStart < OPENING.minutes() || newEnd > CLOSING.minutes() || newStart >= newEnd) {
+        Log::debug("[Server] Exceed time range.");
+        return ChangeResult::InvalidRange;
     }
 
     TimeSlot newSlot = oldSlot;
-    newSlot.startTime = newStart;
-    newSlot.endTime = newEnd;
+    newSlot.startTime = TimeOfDay(newStart);
+    newSlot.endTime = TimeOfDay(newEnd);
 
-    // Add back all sub-slots of the old booking
+    // Work out the new availability on a private copy: the live slots stay untouched until the
+    // move is known to succeed, so a failed check has nothing to roll back
+    std::vector<TimeSlot> candidate = availableSlots;
     auto originalParts = splitIntoThirtyMinSlots(oldSlot);
-    for (const auto& part : originalParts) {
-        availableSlots.push_back(part);
-    }
-    sortAvailableSlots();
+    candidate.insert(candidate.end(), originalParts.begin(), originalParts.end());
+    std::sort(candidate.begin(), candidate.end(), slotBefore);
 
-    if (!isAvailable(newSlot)) {
-        // Remove added parts again (rollback)
-        for (const auto& part : originalParts) {
-            availableSlots.erase(std::remove(availableSlots.begin(), availableSlots.end(), part),
-                                 availableSlots.end());
-        }
-        sortAvailableSlots();
-        std::cerr << "[Server] New slot is unavailable.\n";
-        errorMessage = "Requested new time slot is unavailable.";
-        return false;
+    if (!isAvailableIn(candidate, newSlot)) {
+        Log::debug("[Server] New slot is unavailable.");
+        return ChangeResult::Unavailable;
     }
 
     // Remove new parts from availability
     auto newParts = splitIntoThirtyMinSlots(newSlot);
     for (const auto& part : newParts) {
-        availableSlots.erase(std::remove(availableSlots.begin(), availableSlots.end(), part),
-                             availableSlots.end());
+        candidate.erase(std::remove(candidate.begin(), candidate.end(), part), candidate.end());
     }
-    sortAvailableSlots();
 
+    availableSlots = std::move(candidate);
     booking.slot = newSlot;
+    ++dayVersions[static_cast<size_t>(newSlot.day)];
+    publish(newSlot.day);
 
-    return true;
+    return ChangeResult::Done;
 }
 
 std::optional<Facility::TimeSlot> Facility::cancelBooking(uint32_t bookingId) {
@@ -150,13 +300,11 @@ std::optional<Facility::TimeSlot> Facility::cancelBooking(uint32_t bookingId) {
         TimeSlot fullSlot = it->second.slot;
 
         // Split and return all sub-slots to availability
-        auto parts = splitIntoThirtyMinSlots(fullSlot);
-        for (const auto& part : parts) {
-            availableSlots.push_back(part);
-        }
-        sortAvailableSlots();
+        releaseSlots(fullSlot);
 
         bookings.erase(it);
+        ++dayVersions[static_cast<size_t>(fullSlot.day)];
+        publish(fullSlot.day);
         return fullSlot;
     }
     return std::nullopt;
@@ -182,14 +330,15 @@ void Facility::displayAvailability(Util::Day day) const {
 void Facility::displayAllSlots(Util::Day day) const {
     std::cout << "[Server] All slots for " << name << " on " << Util::dayToString(day) << ":\n";
 
-    for (int hour = 8; hour < 18; ++hour) {
-        int startTime = hour * 100;
+    for (int hour = OPENING.hour(); hour < CLOSING.hour(); ++hour) {
+        TimeOfDay start(hour * 60);
+        int startTime = start.toHHMM();
         int endTime = startTime + 100;
 
         // Check if the current slot is available
         bool isAvailable = false;
         for (const auto& slot : availableSlots) {
-            if (slot.day == day && slot.startTime <= startTime && slot.endTime > startTime) {
+            if (slot.day == day && slot.startTime <= start && slot.endTime > start) {
                 isAvailable = true;
                 break;
             }
@@ -202,53 +351,46 @@ void Facility::displayAllSlots(Util::Day day) const {
     }
 }
 
-void Facility::sortAvailableSlots() {
-    std::sort(availableSlots.begin(), availableSlots.end(),
-              [](const TimeSlot& a, const TimeSlot& b) {
-                  if (a.day != b.day) return a.day < b.day;
-                  return a.startTime < b.startTime;
-              });
+bool Facility::slotBefore(const TimeSlot& a, const TimeSlot& b) {
+    if (a.day != b.day) return a.day < b.day;
+    return a.startTime < b.startTime;
 }
 
-uint32_t Facility::generateBookingId() {
-    static uint32_t currentId =
-        1000;  // should include client endpoint, but for simplity, just use hardcoded value here
-    return currentId++;
+void Facility::sortAvailableSlots() {
+    std::sort(availableSlots.begin(), availableSlots.end(), slotBefore);
 }
 
+// should include client endpoint, but for simplity, just use hardcoded value here
+uint32_t Facility::nextBookingId = 1000;
+
+uint32_t Facility::generateBookingId() { return nextBookingId++; }
+
 std::vector<Facility::TimeSlot> Facility::splitIntoThirtyMinSlots(
     const Facility::TimeSlot& slot) const {
     std::vector<TimeSlot> result;
-    int start = slot.startTime;
-    int end = slot.endTime;
-
-    while (start < end) {
-        int next = Util::toHHMM(Util::toMinutes(start) + 30);
+    for (TimeOfDay start = slot.startTime; start < slot.endTime;) {
+        TimeOfDay next = start + TimeOfDay::MINUTES_PER_SLOT;
         result.emplace_back(slot.day, start, next);
         start = next;
     }
     return result;
 }
 
-bool Facility::extendBooking(uint32_t bookingId, int extensionMinutes, std::string& errorMessage) {
+Facility::ChangeResult Facility::extendBooking(uint32_t bookingId, int extensionMinutes) {
     auto it = bookings.find(bookingId);
     if (it == bookings.end()) {
-        errorMessage = "Invalid Booking ID.";
-        return false;
+        return ChangeResult::InvalidBooking;
     }
 
     BookingInfo& booking = it->second;
     TimeSlot oldSlot = booking.slot;
 
-    int oldEndMins = Util::toMinutes(oldSlot.endTime);
-    int newEndMins = oldEndMins + extensionMinutes;
-    int newEnd = Util::toHHMM(newEndMins);
-
-    if (newEnd > 1800 || newEnd <= oldSlot.endTime) {
-        std::cerr << "[Server] Invalid extension range.\n";
-        errorMessage = "Extension goes beyond allowed time range or is non-positive.";
-        return false;
+    int newEndMinutes = oldSlot.endTime.minutes() + extensionMinutes;
+    if (newEndMinutes > CLOSING.minutes() || newEndMinutes <= oldSlot.endTime.minutes()) {
+        Log::debug("[Server] Invalid extension range.");
+        return ChangeResult::InvalidRange;
     }
+    TimeOfDay newEnd(newEndMinutes);
 
     TimeSlot extendedSlot = oldSlot;
     extendedSlot.endTime = newEnd;
@@ -256,8 +398,7 @@ bool Facility::extendBooking(uint32_t bookingId, int extensionMinutes, std::stri
     // Check availability for the extension period
     TimeSlot extensionOnlySlot(oldSlot.day, oldSlot.endTime, newEnd);
     if (!isAvailable(extensionOnlySlot)) {
-        errorMessage = "Extension time slot is not available.";
-        return false;
+        return ChangeResult::Unavailable;
     }
 
     // Reserve the extended portion by removing it from availability
@@ -266,10 +407,11 @@ bool Facility::extendBooking(uint32_t bookingId, int extensionMinutes, std::stri
         availableSlots.erase(std::remove(availableSlots.begin(), availableSlots.end(), part),
                              availableSlots.end());
     }
-    sortAvailableSlots();
 
     // Update the booking
     booking.slot = extendedSlot;
+    ++dayVersions[static_cast<size_t>(extendedSlot.day)];
+    publish(extendedSlot.day);
 
-    return true;
+    return ChangeResult::Done;
 }
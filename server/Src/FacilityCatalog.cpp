@@ -0,0 +1,195 @@
+#include "FacilityCatalog.h"
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return {};
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+Util::Day parseDay(std::string_view text) {
+    static const char *const NAMES[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    for (int d = 0; d < 7; ++d) {
+        if (text == NAMES[d]) return static_cast<Util::Day>(d);
+    }
+    throw std::invalid_argument("unknown day '" + std::string(text) + "'");
+}
+
+// HHMM on a half-hour boundary within Facility::OPENING..CLOSING, which also bound queries and
+// every booking check; returns minutes since midnight
+int parseTime(std::string_view text) {
+    if (text.size() != 4 || text.find_first_not_of("0123456789") != std::string_view::npos) {
+        throw std::invalid_argument("bad time '" + std::string(text) + "'");
+    }
+    int hhmm = std::stoi(std::string(text));
+    int minutes = Util::toMinutes(hhmm);
+    if (hhmm % 100 >= 60 || minutes % 30 != 0) {
+        throw std::invalid_argument("time '" + std::string(text) + "' is not on a half hour");
+    }
+    if (minutes < Facility::OPENING.minutes() || minutes > Facility::CLOSING.minutes()) {
+        char bounds[16];
+        std::snprintf(bounds, sizeof(bounds), "%04d-%04d", Facility::OPENING.toHHMM(),
+                      Facility::CLOSING.toHHMM());
+        throw std::invalid_argument("time '" + std::string(text) + "' is outside " + bounds);
+    }
+    return minutes;
+}
+
+}  // namespace
+
+Facility FacilityCatalog::parseLine(const std::string &line) {
+    std::string_view text(line);
+    size_t bar = text.find('|');
+    if (bar == std::string_view::npos) {
+        throw std::invalid_argument("expected '<name>|<opening hours>'");
+    }
+    std::string_view name = trim(text.substr(0, bar));
+    if (name.empty()) throw std::invalid_argument("empty facility name");
+
+    std::vector<Facility::TimeSlot> slots;
+    std::string_view hours = text.substr(bar + 1);
+    while (!hours.empty()) {
+        size_t comma = hours.find(',');
+        std::string_view entry = trim(hours.substr(0, comma));
+        hours = comma == std::string_view::npos ? std::string_view{} : hours.substr(comma + 1);
+        if (entry.empty()) continue;
+
+        size_t space = entry.find(' ');
+        size_t dash = entry.find('-', space);
+        if (space == std::string_view::npos || dash == std::string_view::npos) {
+            throw std::invalid_argument("expected '<days> <HHMM>-<HHMM>', got '" +
+                                        std::string(entry) + "'");
+        }
+
+        std::string_view days = entry.substr(0, space);
+        size_t dayDash = days.find('-');
+        Util::Day firstDay = parseDay(days.substr(0, dayDash));
+        Util::Day lastDay =
+            dayDash == std::string_view::npos ? firstDay : parseDay(days.substr(dayDash + 1));
+        int open = parseTime(trim(entry.substr(space + 1, dash - space - 1)));
+        int close = parseTime(trim(entry.substr(dash + 1)));
+        if (lastDay < firstDay || close <= open) {
+            throw std::invalid_argument("empty range '" + std::string(entry) + "'");
+        }
+
+        for (int d = static_cast<int>(firstDay); d <= static_cast<int>(lastDay); ++d) {
+            for (int start = open; start < close; start += 30) {
+                slots.emplace_back(static_cast<Util::Day>(d), TimeOfDay(start),
+                                   TimeOfDay(start + TimeOfDay::MINUTES_PER_SLOT));
+            }
+        }
+    }
+
+    // Entries written in day/time order (the usual case) come out already sorted
+    Facility facility{std::string(name)};
+    facility.addAvailability(std::move(slots));
+
+    // Overlapping entries would leave the same half hour listed twice
+    Util::Day previousDay = Util::Day::Monday;
+    TimeOfDay previousEnd;
+    for (const auto &slot : facility.getAvailableSlots()) {
+        if (slot.day == previousDay && slot.startTime < previousEnd) {
+            throw std::invalid_argument("overlapping opening hours on " +
+                                        Util::dayToString(slot.day));
+        }
+        previousDay = slot.day;
+        previousEnd = slot.endTime;
+    }
+    return facility;
+}
+
+std::string FacilityCatalog::hoursOf(const std::string &line) {
+    std::string hours;
+    for (char c : line.substr(line.find('|') + 1)) {
+        if (c != ' ' && c != '\t' && c != '\r') hours += c;
+    }
+    return hours;
+}
+
+std::unordered_map<std::string, Facility> FacilityCatalog::load(const std::string &path,
+                                                                unsigned threads,
+                                                                Definition *definition) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open facility catalog: " + path);
+    }
+    threads = std::max(1u, threads);
+
+    std::unordered_map<std::string, Facility> facilities;
+    std::vector<std::string> lines;
+    std::vector<size_t> lineNumbers;
+    std::vector<std::optional<Facility>> built;
+    lines.reserve(BATCH_LINES);
+    lineNumbers.reserve(BATCH_LINES);
+
+    auto buildBatch = [&]() {
+        built.clear();
+        built.resize(lines.size());
+        std::vector<std::exception_ptr> errors(lines.size());
+
+        auto buildRange = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                try {
+                    built[i].emplace(parseLine(lines[i]));
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        if (threads == 1 || lines.size() < 2 * threads) {
+            buildRange(0, lines.size());
+        } else {
+            std::vector<std::thread> workers;
+            size_t perThread = (lines.size() + threads - 1) / threads;
+            for (size_t begin = 0; begin < lines.size(); begin += perThread) {
+                workers.emplace_back(buildRange, begin, std::min(begin + perThread, lines.size()));
+            }
+            for (auto &worker : workers) worker.join();
+        }
+
+        for (size_t i = 0; i < lines.size(); ++i) {
+            auto where = [&]() { return path + ":" + std::to_string(lineNumbers[i]) + ": "; };
+            if (errors[i]) {
+                try {
+                    std::rethrow_exception(errors[i]);
+                } catch (const std::exception &e) {
+                    throw std::runtime_error(where() + e.what());
+                }
+            }
+            std::string name = built[i]->getName();
+            if (!facilities.emplace(name, std::move(*built[i])).second) {
+                throw std::runtime_error(where() + "duplicate facility '" + name + "'");
+            }
+            if (definition) (*definition)[name] = hoursOf(lines[i]);
+        }
+        lines.clear();
+        lineNumbers.clear();
+    };
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        std::string_view content = trim(line);
+        if (content.empty() || content.front() == '#') continue;
+
+        lines.emplace_back(content);
+        lineNumbers.push_back(lineNumber);
+        if (lines.size() == BATCH_LINES) buildBatch();
+    }
+    buildBatch();
+
+    return facilities;
+}
@@ -0,0 +1,216 @@
+#include "Logger.h"
+#include <cstdio>
+#include <ctime>
+
+Logger &Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : writer_([this]() { run(); }) {}
+
+Logger::~Logger() {
+    running_ = false;
+    writer_.join();
+}
+
+bool Logger::parseLevel(const std::string &text, LogLevel &level) {
+    static const char *const NAMES[] = {"debug", "info", "warn", "error", "off"};
+    for (int i = 0; i < 5; ++i) {
+        if (text == NAMES[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Logger::RingHandle::RingHandle(Logger &logger) : ring(std::make_shared<Ring>()) {
+    std::lock_guard<std::mutex> lock(logger.ringsMutex_);
+    logger.rings_.push_back(ring);
+}
+
+Logger::RingHandle::~RingHandle() { ring->retired = true; }
+
+Logger::Ring &Logger::localRing() {
+    thread_local RingHandle handle(*this);
+    return *handle.ring;
+}
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(flushMutex_);
+    uint64_t ticket = ++flushRequested_;
+    flushed_.notify_all();  // wake the writer if it is idle
+    flushed_.wait(lock, [&]() { return flushCompleted_ >= ticket; });
+}
+
+void Logger::run() {
+    std::string out, err;
+    for (;;) {
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(flushMutex_);
+            ticket = flushRequested_;
+        }
+        bool stopping = !running_.load();
+
+        // Drain until empty, so a flush sees everything pushed before it asked
+        bool wroteAny = false;
+        while (drain(out, err)) wroteAny = true;
+
+        {
+            std::unique_lock<std::mutex> lock(flushMutex_);
+            if (ticket > flushCompleted_) {
+                flushCompleted_ = ticket;
+                flushed_.notify_all();
+            }
+            if (stopping) return;
+            if (!wroteAny && flushRequested_ == flushCompleted_) {
+                flushed_.wait_for(lock, IDLE_WAIT);
+            }
+        }
+    }
+}
+
+bool Logger::drain(std::string &out, std::string &err) {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings = rings_;
+    }
+
+    bool drainedAny = false;
+    std::string line;
+    LogRecord record;
+    for (const auto &ring : rings) {
+        bool retired = ring->retired.load();  // read first: records pushed before exit are seen
+        while (ring->records.tryPop(record)) {
+            format(record, line);
+            (record.level >= LogLevel::Warn ? err : out) += line;
+            drainedAny = true;
+        }
+
+        uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (dropped != ring->reportedDropped) {
+            err += "[Logger] Ring full, dropped " +
+                   std::to_string(dropped - ring->reportedDropped) + " record(s).\n";
+            ring->reportedDropped = dropped;
+        }
+
+        if (retired) {
+            std::lock_guard<std::mutex> lock(ringsMutex_);
+            rings_.erase(std::remove(rings_.begin(), rings_.end(), ring), rings_.end());
+        }
+    }
+
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+        out.clear();
+    }
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+        err.clear();
+    }
+    return drainedAny;
+}
+
+void Logger::format(const LogRecord &record, std::string &line) {
+    static const char *const LEVELS[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+    std::time_t seconds = record.timestampUs / 1000000;
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    char prefix[32];
+    std::snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%03d %s ", local.tm_hour, local.tm_min,
+                  local.tm_sec, static_cast<int>(record.timestampUs / 1000 % 1000),
+                  LEVELS[static_cast<int>(record.level)]);
+    line = prefix;
+
+    size_t offset = 0;
+    auto appendArg = [&]() {
+        if (offset >= record.size) {
+            line += "{}";  // more placeholders than arguments
+            return;
+        }
+        auto type = static_cast<ArgType>(record.args[offset++]);
+        auto read = [&](auto &value) {
+            std::memcpy(&value, record.args + offset, sizeof(value));
+            offset += sizeof(value);
+        };
+        switch (type) {
+            case ArgType::Int: {
+                int64_t value;
+                read(value);
+                line += std::to_string(value);
+                break;
+            }
+            case ArgType::Uint: {
+                uint64_t value;
+                read(value);
+                line += std::to_string(value);
+                break;
+            }
+            case ArgType::Double: {
+                double value;
+                read(value);
+                char text[32];
+                std::snprintf(text, sizeof(text), "%g", value);
+                line += text;
+                break;
+            }
+            case ArgType::Bool: {
+                bool value;
+                read(value);
+                line += value ? "true" : "false";
+                break;
+            }
+            case ArgType::Char: {
+                char value;
+                read(value);
+                line += value;
+                break;
+            }
+            case ArgType::String: {
+                size_t length = record.args[offset++];
+                line.append(reinterpret_cast<const char *>(record.args + offset), length);
+                offset += length;
+                break;
+            }
+            case ArgType::Endpoint: {
+                PackedEndpoint value;
+                read(value);
+                if (value.v6) {
+                    line += '[';
+                    line += boost::asio::ip::address_v6(value.address).to_string();
+                    line += ']';
+                } else {
+                    line += boost::asio::ip::address_v4({value.address[0], value.address[1],
+                                                         value.address[2], value.address[3]})
+                                .to_string();
+                }
+                line += ':';
+                line += std::to_string(value.port);
+                break;
+            }
+            case ArgType::Truncated:
+                line += ELLIPSIS;  // did not fit in the record
+                break;
+        }
+    };
+
+    for (const char *p = record.format; *p; ++p) {
+        if (p[0] == '{' && p[1] == '}') {
+            appendArg();
+            ++p;
+        } else {
+            line += *p;
+        }
+    }
+    line += '\n';
+}
@@ -0,0 +1,113 @@
+#include "NetworkEmulator.h"
+#include <algorithm>
+#include <stdexcept>
+
+bool LinkPolicy::active() const {
+    return dropRate > 0 || duplicateRate > 0 || delay.count() > 0 || jitter.count() > 0 ||
+           reorderRate > 0 || bandwidth > 0;
+}
+
+LinkPolicy LinkPolicy::parse(const std::string &text) {
+    auto millis = [](double value) {
+        return std::chrono::microseconds(static_cast<int64_t>(value * 1000));
+    };
+    auto probability = [&](double value, const std::string &key) {
+        if (value < 0 || value > 1) {
+            throw std::invalid_argument(key + " must be between 0 and 1");
+        }
+        return value;
+    };
+
+    LinkPolicy policy;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = std::min(text.find(',', start), text.size());
+        std::string entry = text.substr(start, end - start);
+        start = end + 1;
+        if (entry.empty()) continue;
+
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            throw std::invalid_argument("expected key=value, got '" + entry + "'");
+        }
+        std::string key = entry.substr(0, equals);
+        double value = std::stod(entry.substr(equals + 1));
+        if (key == "drop") {
+            policy.dropRate = probability(value, key);
+        } else if (key == "dup") {
+            policy.duplicateRate = probability(value, key);
+        } else if (key == "delay") {
+            policy.delay = millis(value);
+        } else if (key == "jitter") {
+            policy.jitter = millis(value);
+        } else if (key == "reorder") {
+            policy.reorderRate = probability(value, key);
+        } else if (key == "hold") {
+            policy.reorderHold = millis(value);
+        } else if (key == "bw") {
+            policy.bandwidth = static_cast<uint64_t>(value);
+        } else if (key == "queue") {
+            policy.maxQueueDelay = millis(value);
+        } else {
+            throw std::invalid_argument("unknown network policy key '" + key + "'");
+        }
+    }
+    return policy;
+}
+
+NetworkEmulator::NetworkEmulator(boost::asio::io_context &io_context, uint64_t seed)
+    : io_context_(io_context), random_(seed) {}
+
+void NetworkEmulator::setPolicy(Direction direction, const LinkPolicy &policy) {
+    link(direction) = Link{policy, {}};
+}
+
+bool NetworkEmulator::transmit(Direction direction, size_t bytes,
+                               const std::function<void()> &deliver) {
+    Link &l = link(direction);
+    const LinkPolicy &policy = l.policy;
+    if (!policy.active()) {
+        deliver();
+        return true;
+    }
+    if (chance(policy.dropRate)) return false;
+
+    std::chrono::microseconds latency = policy.delay;
+    if (policy.bandwidth > 0) {
+        // The datagram leaves once everything queued before it has gone out
+        auto now = std::chrono::steady_clock::now();
+        auto queued = std::max(l.linkFreeAt, now);
+        auto queueDelay = std::chrono::duration_cast<std::chrono::microseconds>(queued - now);
+        if (queueDelay > policy.maxQueueDelay) return false;
+        auto sendTime = static_cast<int64_t>(bytes * 1000000 / policy.bandwidth);
+        l.linkFreeAt = queued + std::chrono::microseconds(sendTime);
+        latency += std::chrono::duration_cast<std::chrono::microseconds>(l.linkFreeAt - now);
+    }
+    if (policy.jitter.count() > 0) {
+        latency += std::chrono::microseconds(random_.next() % (policy.jitter.count() + 1));
+    }
+    if (chance(policy.reorderRate)) latency += policy.reorderHold;
+
+    deliverAfter(latency, deliver);
+    if (chance(policy.duplicateRate)) {
+        // The copy trails the original by up to one jitter
+        auto extra = policy.jitter.count() > 0 ? random_.next() % (policy.jitter.count() + 1) : 0;
+        deliverAfter(latency + std::chrono::microseconds(extra), deliver);
+    }
+    return true;
+}
+
+void NetworkEmulator::deliverAfter(std::chrono::microseconds delay,
+                                   const std::function<void()> &deliver) {
+    if (delay.count() <= 0) {
+        deliver();
+        return;
+    }
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_context_, delay);
+    std::weak_ptr<char> alive = lifetime_;
+    timer->async_wait([timer, alive, deliver](const boost::system::error_code &ec) {
+        if (!ec && alive.lock()) deliver();
+    });
+}
+
+void NetworkEmulator::stop() { lifetime_.reset(); }
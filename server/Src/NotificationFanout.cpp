@@ -0,0 +1,227 @@
+#include "NotificationFanout.h"
+#include "Facility.h"
+#include "Logger.h"
+#include "TextWriter.h"
+
+NotificationFanout::NotificationFanout(Sender sender)
+    : workGuard_(boost::asio::make_work_guard(io_context_)),
+      sender_(std::move(sender)),
+      events_(EVENT_QUEUE_CAPACITY),
+      monitorExpiry_(io_context_, MONITOR_WHEEL_TICK, MONITOR_WHEEL_SLOTS,
+                     [this](std::vector<MonitorExpiry> &expired) {
+                         expireMonitorClients(expired);
+                     }) {}
+
+NotificationFanout::~NotificationFanout() { stop(); }
+
+void NotificationFanout::start() {
+    if (thread_.joinable()) return;
+    thread_ = std::thread([this]() { io_context_.run(); });
+}
+
+void NotificationFanout::stop() {
+    if (!thread_.joinable()) return;
+    workGuard_.reset();
+    io_context_.stop();
+    thread_.join();
+    monitorExpiry_.stop();
+}
+
+void NotificationFanout::publishChange(const std::string &facility, Util::Day day,
+                                       uint32_t version, uint64_t changedMask,
+                                       uint64_t availableMask) {
+    ChangeEvent event;
+    event.kind = ChangeEvent::Kind::Availability;
+    event.facility = facility;
+    event.day = day;
+    event.version = version;
+    event.changedMask = changedMask;
+    event.availableMask = availableMask;
+    push(std::move(event));
+}
+
+void NotificationFanout::subscribe(const std::string &facility, Util::Day day,
+                                   TimeOfDay startTime, TimeOfDay endTime, uint32_t interval,
+                                   uint8_t flags, const udp::endpoint &clientEndpoint,
+                                   uint64_t sessionToken) {
+    ChangeEvent event;
+    event.kind = ChangeEvent::Kind::Subscribe;
+    event.facility = facility;
+    event.day = day;
+    event.startTime = startTime;
+    event.endTime = endTime;
+    event.clientEndpoint = clientEndpoint;
+    event.monitorInterval = interval;
+    event.monitorFlags = flags;
+    event.sessionToken = sessionToken;
+    push(std::move(event));
+}
+
+void NotificationFanout::rebind(uint64_t sessionToken, const udp::endpoint &clientEndpoint) {
+    ChangeEvent event;
+    event.kind = ChangeEvent::Kind::Rebind;
+    event.clientEndpoint = clientEndpoint;
+    event.sessionToken = sessionToken;
+    push(std::move(event));
+}
+
+void NotificationFanout::removeFacility(const std::string &facility) {
+    ChangeEvent event;
+    event.kind = ChangeEvent::Kind::Remove;
+    event.facility = facility;
+    push(std::move(event));
+}
+
+void NotificationFanout::push(ChangeEvent &&event) {
+    // A full ring means the fan-out thread is behind; wait for a free slot rather than lose a
+    // subscription or an update
+    while (!events_.tryPush(std::move(event))) {
+        std::this_thread::yield();
+    }
+
+    // Only the first event of a burst wakes the fan-out thread
+    if (!drainScheduled_.exchange(true)) {
+        boost::asio::post(io_context_, [this]() { drain(); });
+    }
+}
+
+void NotificationFanout::drain() {
+    drainScheduled_.store(false);
+
+    while (events_.tryPop(current_)) {
+        switch (current_.kind) {
+            case ChangeEvent::Kind::Subscribe:
+                registerMonitorClient(current_);
+                break;
+            case ChangeEvent::Kind::Availability:
+                notifyMonitorClients(current_);
+                break;
+            case ChangeEvent::Kind::Rebind:
+                rebindMonitorClients(current_);
+                break;
+            case ChangeEvent::Kind::Remove:
+                removeMonitorClients(current_);
+                break;
+        }
+    }
+}
+
+void NotificationFanout::registerMonitorClient(ChangeEvent &event) {
+    // Store monitor info in the map; the timing wheel removes it once the interval ends
+    TimeRangeMap &ranges = monitoringClients[event.facility][event.day];
+    auto entry = ranges.emplace(event.startTime,
+                                MonitorInfo{event.clientEndpoint, event.day, event.startTime,
+                                            event.endTime, event.monitorInterval,
+                                            event.monitorFlags, event.sessionToken});
+    monitorExpiry_.schedule({&ranges, entry}, std::chrono::seconds(event.monitorInterval));
+}
+
+// Clients rarely move, so this walks every subscription rather than keeping an index by token
+void NotificationFanout::rebindMonitorClients(const ChangeEvent &event) {
+    for (auto &[facility, days] : monitoringClients) {
+        for (auto &[day, ranges] : days) {
+            for (auto &[start, info] : ranges) {
+                if (info.sessionToken == event.sessionToken) {
+                    info.clientEndpoint = event.clientEndpoint;
+                }
+            }
+        }
+    }
+}
+
+// The expiry wheel still holds iterators into the facility's maps, so they are unlinked from the
+// registry, which stops its updates, and kept until the last of them has expired
+void NotificationFanout::removeMonitorClients(const ChangeEvent &event) {
+    auto facilityIt = monitoringClients.find(event.facility);
+    if (facilityIt == monitoringClients.end()) return;
+    removedFacilities_.push_back(monitoringClients.extract(facilityIt));
+}
+
+void NotificationFanout::expireMonitorClients(std::vector<MonitorExpiry> &expired) {
+    for (const auto &[ranges, entry] : expired) {
+        const MonitorInfo &info = entry->second;
+        Log::info("[Server] Monitoring expired for client: {} for {} to {}", info.clientEndpoint,
+                  info.startTime.toHHMM(), info.endTime.toHHMM());
+        ranges->erase(entry);
+    }
+
+    std::erase_if(removedFacilities_, [](const FacilityMonitorMap::node_type &removed) {
+        for (const auto &[day, ranges] : removed.mapped()) {
+            if (!ranges.empty()) return false;
+        }
+        return true;
+    });
+}
+
+void NotificationFanout::notifyMonitorClients(const ChangeEvent &event) {
+    if (event.changedMask == 0) return;
+
+    auto facilityIt = monitoringClients.find(event.facility);
+    if (facilityIt == monitoringClients.end()) return;
+
+    auto dayIt = facilityIt->second.find(event.day);
+    if (dayIt == facilityIt->second.end()) return;
+
+    const TimeRangeMap &monitorMap = dayIt->second;
+    sendDelta(event, monitorMap);
+
+    // Each changed slot's update is formatted and encoded once, on the stack, for all its watchers
+    TextBuffer<MAX_TEXT_REPLY> text;
+    std::array<uint8_t, MAX_TEXT_REPLY + TextReply::Wire::minSize> datagram;
+    for (int slot = 0; slot < Facility::SLOTS_PER_DAY; ++slot) {
+        if (!((event.changedMask >> slot) & 1)) continue;
+
+        TimeOfDay subStart = TimeOfDay::ofSlot(slot);
+        TimeOfDay subEnd = TimeOfDay::ofSlot(slot + 1);
+        size_t size = 0;
+
+        for (auto &[monitorStart, info] : monitorMap) {
+            if (monitorStart >= subEnd) break;  // sorted by start time
+            if ((info.flags & MONITOR_FLAG_DELTA) == 0 && info.endTime > subStart) {
+                if (size == 0) {
+                    bool isAvailable = (event.availableMask >> slot) & 1;
+                    text.clear();
+                    text << "Update: Availability for " << event.facility << " from "
+                         << subStart.toHHMM() << " to " << subEnd.toHHMM() << " changed to "
+                         << (isAvailable ? "available" : "not available") << '.';
+                    TextReply update;
+                    update.message = text.view();
+                    size = update.marshal(datagram.data(), datagram.size());
+                }
+                sender_(datagram.data(), size, info.clientEndpoint);
+            }
+        }
+    }
+}
+
+// Delta watchers get every change of the day regardless of their range, so the version sequence
+// they see has no holes except real losses; they filter by range themselves
+void NotificationFanout::sendDelta(const ChangeEvent &event, const TimeRangeMap &monitorMap) {
+    std::vector<uint8_t> responseData;
+
+    for (auto &[monitorStart, info] : monitorMap) {
+        if ((info.flags & MONITOR_FLAG_DELTA) == 0) continue;
+
+        if (responseData.empty()) {
+            int first = 0;
+            while (((event.changedMask >> first) & 1) == 0) ++first;
+            int last = Facility::SLOTS_PER_DAY;
+            while (((event.changedMask >> (last - 1)) & 1) == 0) --last;
+
+            DeltaMessage delta;
+            delta.facilityName = event.facility;
+            delta.day = event.day;
+            delta.version = event.version;
+            delta.firstSlot = static_cast<uint8_t>(first);
+            delta.slotCount = static_cast<uint8_t>(last - first);
+            delta.bits = (event.availableMask >> first) & ((uint64_t{1} << (last - first)) - 1);
+
+            ResponseMessage response;
+            response.requestId = 0;
+            response.status = STATUS_DELTA;
+            delta.marshal(response.message);
+            responseData = response.marshal();
+        }
+        sender_(responseData.data(), responseData.size(), info.clientEndpoint);
+    }
+}
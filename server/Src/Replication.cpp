@@ -0,0 +1,303 @@
+#include "Replication.h"
+#include <algorithm>
+#include <memory>
+#include "Logger.h"
+
+using namespace std;
+using namespace boost::asio;
+
+namespace {
+
+std::vector<uint8_t> makePacket(Replication::PacketType type, uint64_t lsn) {
+    std::vector<uint8_t> packet;
+    packet.reserve(Replication::MAX_DATAGRAM);
+    packet.push_back(static_cast<uint8_t>(type));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        packet.push_back(static_cast<uint8_t>(lsn >> shift));
+    }
+    return packet;
+}
+
+bool parsePacket(const uint8_t *data, size_t size, Replication::PacketType type, uint64_t &lsn) {
+    if (size < Replication::PACKET_HEADER || data[0] != static_cast<uint8_t>(type)) return false;
+    lsn = 0;
+    for (int i = 1; i <= 8; ++i) {
+        lsn = (lsn << 8) | data[i];
+    }
+    return true;
+}
+
+}  // namespace
+
+// -----------------------------
+// Primary
+// -----------------------------
+
+ReplicationPrimary::ReplicationPrimary(io_context &io_context, std::vector<udp::endpoint> backups,
+                                       uint64_t startLsn, ReplicatedHandler onReplicated,
+                                       unsigned short port)
+    : io_context_(io_context),
+      socket_(io_context, udp::endpoint(udp::v4(), port)),
+      heartbeatTimer_(io_context),
+      onReplicated_(std::move(onReplicated)),
+      lastLsn_(startLsn),
+      replicatedLsn_(startLsn) {
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &endpoint : backups) {
+        backups_.push_back({endpoint, startLsn, startLsn, now, now});
+    }
+    receiveAcks();
+    onHeartbeat();
+}
+
+void ReplicationPrimary::stop() {
+    heartbeatTimer_.cancel();
+    socket_.close();
+}
+
+void ReplicationPrimary::replicate(const WalRecord &record) {
+    log_.push_back(record);
+    lastLsn_ = record.lsn;
+    updateReplicatedLsn();  // nothing to wait for if no backup is live
+
+    if (!flushScheduled_) {
+        flushScheduled_ = true;
+        boost::asio::post(io_context_, [this]() {
+            flushScheduled_ = false;
+            flush();
+        });
+    }
+}
+
+void ReplicationPrimary::flush() {
+    // Backups with a batch in flight get the new records when its ack comes back
+    for (auto &backup : backups_) {
+        if (backup.live && backup.ackedLsn == backup.sentLsn && backup.sentLsn < lastLsn_) {
+            sendFrom(backup, backup.sentLsn);
+        }
+    }
+}
+
+void ReplicationPrimary::sendFrom(Backup &backup, uint64_t afterLsn) {
+    size_t index = log_.size();  // nothing new: heartbeat only
+    if (afterLsn < lastLsn_) {
+        if (log_.empty() || afterLsn + 1 < log_.front().lsn) {
+            if (backup.live) {
+                Log::error("[Replication] Backup {} is behind the retained log (acked {}); "
+                           "restart it from a snapshot.",
+                           backup.endpoint, afterLsn);
+                backup.live = false;
+            }
+            return;
+        }
+        index = afterLsn + 1 - log_.front().lsn;
+    }
+
+    // An empty batch still goes out: it is the heartbeat
+    std::vector<uint8_t> packet = makePacket(Replication::PacketType::BATCH, lastLsn_);
+    std::vector<uint8_t> record;
+    for (; index < log_.size(); ++index) {
+        record.clear();
+        log_[index].marshal(record);
+        if (packet.size() + record.size() > Replication::MAX_DATAGRAM &&
+            packet.size() > Replication::PACKET_HEADER) {
+            sendPacket(std::move(packet), backup.endpoint);
+            packet = makePacket(Replication::PacketType::BATCH, lastLsn_);
+        }
+        packet.insert(packet.end(), record.begin(), record.end());
+    }
+    sendPacket(std::move(packet), backup.endpoint);
+    backup.sentLsn = lastLsn_;
+}
+
+void ReplicationPrimary::sendPacket(std::vector<uint8_t> packet, const udp::endpoint &endpoint) {
+    auto data = std::make_shared<std::vector<uint8_t>>(std::move(packet));
+    socket_.async_send_to(buffer(*data), endpoint,
+                          [data](const boost::system::error_code &, std::size_t) {});
+}
+
+void ReplicationPrimary::receiveAcks() {
+    socket_.async_receive_from(
+        buffer(ackBuffer_), ackSender_, [this](boost::system::error_code ec, std::size_t size) {
+            if (ec == error::operation_aborted) return;
+
+            uint64_t lsn;
+            bool isAck =
+                !ec && parsePacket(ackBuffer_.data(), size, Replication::PacketType::ACK, lsn);
+            bool isFollow = !ec && !isAck &&
+                            parsePacket(ackBuffer_.data(), size, Replication::PacketType::FOLLOW, lsn);
+            if (isAck || isFollow) {
+                auto backup = std::find_if(backups_.begin(), backups_.end(), [this](const Backup &b) {
+                    return b.endpoint == ackSender_;
+                });
+                if (backup == backups_.end() && isFollow) {
+                    auto now = std::chrono::steady_clock::now();
+                    backups_.push_back({ackSender_, lsn, lsn, now, now, true, false});
+                    backup = std::prev(backups_.end());
+                    Log::info("[Replication] Follower {} joined at LSN {}.", ackSender_, lsn);
+                    sendFrom(*backup, lsn);
+                } else if (backup != backups_.end()) {
+                    handleAck(*backup, lsn);
+                }
+                updateReplicatedLsn();
+            }
+            receiveAcks();
+        });
+}
+
+void ReplicationPrimary::handleAck(Backup &backup, uint64_t lsn) {
+    auto now = std::chrono::steady_clock::now();
+    backup.lastHeard = now;
+    if (lsn != backup.ackedLsn) {  // lower means the backup restarted
+        backup.ackedLsn = lsn;
+        backup.lastProgress = now;
+        backup.sentLsn = std::max(backup.sentLsn, lsn);
+    }
+
+    uint64_t oldestRetained = log_.empty() ? lastLsn_ + 1 : log_.front().lsn;
+    if (!backup.live && lsn + 1 >= oldestRetained) {
+        Log::info("[Replication] Backup {} is back.", backup.endpoint);
+        backup.live = true;
+    }
+    if (backup.live && lsn == backup.sentLsn && lsn < lastLsn_) {
+        sendFrom(backup, lsn);  // everything queued while the batch was in flight
+    }
+}
+
+void ReplicationPrimary::onHeartbeat() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto &backup : backups_) {
+        if (backup.live && now - backup.lastHeard >= BACKUP_TIMEOUT) {
+            Log::warn("[Replication] Backup {} stopped acknowledging; no longer waiting for it.",
+                      backup.endpoint);
+            backup.live = false;
+        }
+
+        // Go-back-N: an ack that has stopped advancing means something after it was lost
+        if (backup.ackedLsn < lastLsn_ && now - backup.lastProgress >= RETRANSMIT_AFTER) {
+            backup.sentLsn = backup.ackedLsn;
+            backup.lastProgress = now;
+        }
+        sendFrom(backup, backup.sentLsn);
+    }
+
+    // Followers come and go; one that stopped acking has to register again
+    backups_.erase(std::remove_if(backups_.begin(), backups_.end(),
+                                  [](const Backup &b) { return !b.synchronous && !b.live; }),
+                   backups_.end());
+
+    // Keep a bounded window of recent records so backups and new followers can catch up
+    while (log_.size() > MAX_RETAINED_RECORDS) log_.pop_front();
+    updateReplicatedLsn();
+
+    heartbeatTimer_.expires_after(HEARTBEAT_INTERVAL);
+    heartbeatTimer_.async_wait([this](const boost::system::error_code &ec) {
+        if (!ec) onHeartbeat();
+    });
+}
+
+void ReplicationPrimary::updateReplicatedLsn() {
+    uint64_t lsn = lastLsn_;
+    for (const auto &backup : backups_) {
+        if (backup.live && backup.synchronous) lsn = std::min(lsn, backup.ackedLsn);
+    }
+    if (lsn > replicatedLsn_) {
+        replicatedLsn_ = lsn;
+        if (onReplicated_) onReplicated_(lsn);
+    }
+}
+
+// -----------------------------
+// Backup
+// -----------------------------
+
+ReplicationBackup::ReplicationBackup(io_context &io_context, unsigned short port,
+                                     uint64_t appliedLsn, ApplyHandler onApply,
+                                     TakeoverHandler onTakeover,
+                                     std::chrono::milliseconds takeoverAfter)
+    : socket_(io_context, udp::endpoint(udp::v4(), port)),
+      watchdog_(io_context),
+      onApply_(std::move(onApply)),
+      onTakeover_(std::move(onTakeover)),
+      takeoverAfter_(takeoverAfter),
+      appliedLsn_(appliedLsn),
+      lastHeard_(std::chrono::steady_clock::now()) {
+    Log::info("[Replication] Listening for the primary on port {}",
+              socket_.local_endpoint().port());
+    receiveBatches();
+    checkPrimary();
+}
+
+void ReplicationBackup::follow(const udp::endpoint &primary) {
+    primary_ = primary;
+    following_ = true;
+    sendToPrimary(Replication::PacketType::FOLLOW);
+}
+
+std::chrono::milliseconds ReplicationBackup::staleness() const {
+    if (lastCaughtUp_ == std::chrono::steady_clock::time_point{}) {
+        return std::chrono::milliseconds::max();  // never been in step with the primary
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                 lastCaughtUp_);
+}
+
+void ReplicationBackup::stop() {
+    watchdog_.cancel();
+    socket_.close();
+}
+
+void ReplicationBackup::receiveBatches() {
+    socket_.async_receive_from(buffer(recvBuffer_), sender_,
+                               [this](boost::system::error_code ec, std::size_t size) {
+                                   if (ec == error::operation_aborted) return;
+                                   if (!ec) handleBatch(size);
+                                   receiveBatches();
+                               });
+}
+
+void ReplicationBackup::handleBatch(size_t size) {
+    uint64_t primaryLsn;
+    if (!parsePacket(recvBuffer_.data(), size, Replication::PacketType::BATCH, primaryLsn)) return;
+    lastHeard_ = std::chrono::steady_clock::now();
+    heardFromPrimary_ = true;
+    primary_ = sender_;
+
+    size_t offset = Replication::PACKET_HEADER;
+    WalRecord record;
+    while (size_t used = WalRecord::unmarshal(recvBuffer_.data() + offset, size - offset, record)) {
+        offset += used;
+        if (record.lsn <= appliedLsn_) continue;  // duplicate from a retransmission
+        if (record.lsn != appliedLsn_ + 1) break;   // gap; the primary will go back and resend
+        onApply_(record);
+        appliedLsn_ = record.lsn;
+    }
+    if (appliedLsn_ >= primaryLsn) lastCaughtUp_ = lastHeard_;
+
+    sendToPrimary(Replication::PacketType::ACK);
+}
+
+void ReplicationBackup::sendToPrimary(Replication::PacketType type) {
+    auto packet = std::make_shared<std::vector<uint8_t>>(makePacket(type, appliedLsn_));
+    socket_.async_send_to(buffer(*packet), primary_,
+                          [packet](const boost::system::error_code &, std::size_t) {});
+}
+
+void ReplicationBackup::checkPrimary() {
+    auto silence = std::chrono::steady_clock::now() - lastHeard_;
+    if (following_ && silence >= REREGISTER_AFTER) {
+        sendToPrimary(Replication::PacketType::FOLLOW);  // primary restarted or dropped us
+    }
+    if (onTakeover_ && heardFromPrimary_ && silence >= takeoverAfter_) {
+        Log::warn("[Replication] Primary silent for {} ms, taking over at LSN {}.",
+                  takeoverAfter_.count(), appliedLsn_);
+        stop();
+        onTakeover_();
+        return;
+    }
+
+    watchdog_.expires_after(takeoverAfter_ / 4);
+    watchdog_.async_wait([this](const boost::system::error_code &ec) {
+        if (!ec) checkPrimary();
+    });
+}
@@ -0,0 +1,321 @@
+#include "Simulation.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+#include "UdpServer.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int OPEN_DAYS = 5;
+constexpr int SLOTS_PER_DAY = 20;              // 30 minutes each, from 08:00
+constexpr uint32_t CLIENT_NETWORK = 0x0A000000;  // client i is 10.0.0.0 + i
+constexpr unsigned short CLIENT_PORT = 4000;
+constexpr size_t REMEMBERED_ANSWERS = 16;  // per client, to compare late duplicates against
+
+struct Event {
+    enum class Kind { ToServer, ToClient, Timeout };
+
+    int64_t at;         // virtual microseconds
+    uint64_t sequence;  // events at the same time run in the order they were scheduled
+    Kind kind;
+    size_t client;
+    uint32_t requestId;  // Timeout: the request it guards
+    uint32_t attempt;    // Timeout: the transmission it guards
+    std::string datagram;
+
+    bool operator>(const Event &other) const {
+        return std::tie(at, sequence) > std::tie(other.at, other.sequence);
+    }
+};
+
+struct SimClient {
+    udp::endpoint endpoint;
+    uint32_t nextRequestId = 1;
+    uint32_t waitingFor = 0;  // 0 when idle
+    uint32_t attempt = 0;
+    Operation operation = Operation::QUERY;
+    size_t facility = 0;
+    std::string request;                  // marshalled, for retransmits
+    std::map<uint32_t, size_t> bookings;  // booking ID -> facility, as far as this client knows
+    std::deque<std::pair<uint32_t, std::string>> answered;  // recent first answers
+};
+
+class Run {
+  public:
+    explicit Run(const SimulationConfig &config)
+        : config_(config), random_(config.seed), server_(context_, 0, facilities(config),
+                                                         config.atLeastOnce) {
+        server_.useTransport(
+            [this](const std::string &datagram, const udp::endpoint &client) {
+                size_t index = client.address().to_v4().to_uint() - CLIENT_NETWORK;
+                transmit(config_.toClients, Event::Kind::ToClient, index, datagram);
+            },
+            [this]() { return virtualNow(); });
+        for (size_t i = 0; i < config.clients; ++i) {
+            clients_.emplace_back();
+            clients_.back().endpoint = udp::endpoint(
+                boost::asio::ip::address_v4(CLIENT_NETWORK + static_cast<uint32_t>(i)),
+                CLIENT_PORT);
+        }
+    }
+
+    SimulationReport run() {
+        auto started = Clock::now();
+        for (size_t i = 0; i < clients_.size(); ++i) issue(i);
+        while (!events_.empty()) {
+            std::pop_heap(events_.begin(), events_.end(), std::greater<>());
+            Event event = std::move(events_.back());
+            events_.pop_back();
+            now_ = event.at;
+            switch (event.kind) {
+                case Event::Kind::ToServer:
+                    deliverToServer(event);
+                    break;
+                case Event::Kind::ToClient:
+                    deliverToClient(event.client, event.datagram);
+                    break;
+                case Event::Kind::Timeout:
+                    retransmitIfUnanswered(event);
+                    break;
+            }
+        }
+        report_.wallSeconds = std::chrono::duration<double>(Clock::now() - started).count();
+        report_.virtualTime = std::chrono::microseconds(now_);
+        report_.serverNsPerDatagram =
+            deliveries_ ? std::chrono::duration<double, std::nano>(serverTime_).count() /
+                              static_cast<double>(deliveries_)
+                        : 0;
+        check();
+        return report_;
+    }
+
+  private:
+    const SimulationConfig &config_;
+    FastRandom random_;
+    boost::asio::io_context context_;  // never run; the server's socket just sits on it
+    UDPServer server_;
+    std::vector<SimClient> clients_;
+    std::vector<Event> events_;  // min-heap on (at, sequence)
+    uint64_t nextSequence_ = 0;
+    int64_t now_ = 0;
+    uint64_t issued_ = 0;
+    uint64_t deliveries_ = 0;
+    Clock::duration serverTime_{0};
+    SimulationReport report_;
+
+    static std::unordered_map<std::string, Facility> facilities(const SimulationConfig &config) {
+        std::unordered_map<std::string, Facility> facilities;
+        for (size_t f = 0; f < config.facilities; ++f) {
+            std::string name = "Facility " + std::to_string(f);
+            std::vector<Facility::TimeSlot> slots;
+            for (int day = 0; day < OPEN_DAYS; ++day) {
+                for (int slot = 0; slot < SLOTS_PER_DAY; ++slot) slots.push_back(slotAt(day, slot));
+            }
+            facilities.emplace(name, Facility(name));
+            facilities.at(name).addAvailability(std::move(slots));
+        }
+        return facilities;
+    }
+
+    static Facility::TimeSlot slotAt(int day, int slot) {
+        int first = Facility::OPENING.slot() + slot;
+        return Facility::TimeSlot(static_cast<Util::Day>(day), TimeOfDay::ofSlot(first),
+                                  TimeOfDay::ofSlot(first + 1));
+    }
+
+    Clock::time_point virtualNow() const {
+        return Clock::time_point(std::chrono::hours(1)) + std::chrono::microseconds(now_);
+    }
+
+    bool chance(double probability) {
+        return probability > 0 && random_.nextDouble() < probability;
+    }
+
+    void schedule(int64_t at, Event::Kind kind, size_t client, std::string datagram,
+                  uint32_t requestId = 0, uint32_t attempt = 0) {
+        events_.push_back(
+            {at, nextSequence_++, kind, client, requestId, attempt, std::move(datagram)});
+        std::push_heap(events_.begin(), events_.end(), std::greater<>());
+    }
+
+    // The virtual-time counterpart of NetworkEmulator::transmit
+    void transmit(const LinkPolicy &policy, Event::Kind kind, size_t client,
+                  const std::string &datagram) {
+        if (chance(policy.dropRate)) {
+            ++report_.dropped;
+            return;
+        }
+        int64_t latency = policy.delay.count();
+        auto jitter = [&]() {
+            return policy.jitter.count() > 0
+                       ? static_cast<int64_t>(random_.next() % (policy.jitter.count() + 1))
+                       : 0;
+        };
+        latency += jitter();
+        if (chance(policy.reorderRate)) latency += policy.reorderHold.count();
+        if (chance(policy.duplicateRate)) {
+            ++report_.duplicated;
+            schedule(now_ + latency + jitter(), kind, client, datagram);
+        }
+        schedule(now_ + latency, kind, client, datagram);
+    }
+
+    void issue(size_t index) {
+        if (issued_ == config_.requests) return;
+        ++issued_;
+        SimClient &client = clients_[index];
+
+        RequestMessage request;
+        request.requestId = client.nextRequestId++;
+        uint64_t draw = random_.next() % 100;
+        request.operation = draw < 35   ? Operation::BOOK
+                            : draw < 55 ? Operation::CANCEL
+                            : draw < 70 ? Operation::CHANGE
+                            : draw < 80 ? Operation::EXTEND
+                                        : Operation::QUERY;
+        client.facility = random_.next() % config_.facilities;
+        Facility::TimeSlot slot = slotAt(static_cast<int>(random_.next() % OPEN_DAYS),
+                                         static_cast<int>(random_.next() % SLOTS_PER_DAY));
+        request.day = slot.day;
+        request.startTime = slot.startTime.toHHMM();
+        request.endTime = slot.endTime.toHHMM();
+
+        bool needsBooking = request.operation == Operation::CANCEL ||
+                            request.operation == Operation::CHANGE ||
+                            request.operation == Operation::EXTEND;
+        if (needsBooking && client.bookings.empty()) {
+            request.operation = Operation::BOOK;
+        } else if (needsBooking) {
+            auto it = client.bookings.begin();
+            std::advance(it, random_.next() % client.bookings.size());
+            request.bookingId = it->first;
+            client.facility = it->second;
+            if (request.operation == Operation::CHANGE) {
+                request.offsetMinutes = random_.next() & 1 ? 30 : -30;
+            } else if (request.operation == Operation::EXTEND) {
+                request.offsetMinutes = 30;
+            }
+        }
+        request.facilityName = "Facility " + std::to_string(client.facility);
+
+        auto data = request.marshal();
+        client.request.assign(data.begin(), data.end());
+        client.operation = request.operation;
+        client.waitingFor = request.requestId;
+        client.attempt = 0;
+        send(index);
+    }
+
+    void send(size_t index) {
+        SimClient &client = clients_[index];
+        ++client.attempt;
+        ++report_.transmissions;
+        transmit(config_.toServer, Event::Kind::ToServer, index, client.request);
+        schedule(now_ + config_.retryTimeout.count(), Event::Kind::Timeout, index, {},
+                 client.waitingFor, client.attempt);
+    }
+
+    void retransmitIfUnanswered(const Event &timeout) {
+        const SimClient &client = clients_[timeout.client];
+        if (client.waitingFor == timeout.requestId && client.attempt == timeout.attempt) {
+            send(timeout.client);
+        }
+    }
+
+    void deliverToServer(const Event &event) {
+        std::vector<uint8_t> datagram(event.datagram.begin(), event.datagram.end());
+        auto started = Clock::now();
+        server_.deliver(datagram, clients_[event.client].endpoint);
+        serverTime_ += Clock::now() - started;
+        ++deliveries_;
+    }
+
+    void deliverToClient(size_t index, const std::string &datagram) {
+        SimClient &client = clients_[index];
+        ResponseMessage response = ResponseMessage::unmarshal(datagram);
+
+        if (response.requestId != client.waitingFor) {
+            // A late duplicate: it must say what the first answer said
+            for (const auto &[requestId, message] : client.answered) {
+                if (requestId == response.requestId && message != response.message) {
+                    ++report_.conflictingReplies;
+                }
+            }
+            return;
+        }
+
+        client.answered.emplace_back(response.requestId, response.message);
+        if (client.answered.size() > REMEMBERED_ANSWERS) client.answered.pop_front();
+        client.waitingFor = 0;
+        ++report_.requests;
+
+        const std::string marker = "Booking ID: ";
+        size_t at = response.message.find(marker);
+        if (client.operation == Operation::BOOK && at != std::string::npos) {
+            client.bookings[static_cast<uint32_t>(
+                std::stoul(response.message.substr(at + marker.size())))] = client.facility;
+        } else if (client.operation == Operation::CANCEL &&
+                   response.message.find("canceled successfully") != std::string::npos) {
+            std::string prefix = "Booking with ID ";
+            client.bookings.erase(
+                static_cast<uint32_t>(std::stoul(response.message.substr(prefix.size()))));
+        }
+        issue(index);
+    }
+
+    void check() {
+        std::set<uint32_t> told;
+        for (const auto &client : clients_) {
+            for (const auto &[bookingId, facility] : client.bookings) told.insert(bookingId);
+        }
+
+        std::set<uint32_t> held;
+        for (const auto &[name, facility] : server_.getFacilities()) {
+            uint64_t taken[7] = {};
+            for (const auto &[bookingId, booking] : facility.getBookings()) {
+                held.insert(bookingId);
+                int day = static_cast<int>(booking.slot.day);
+                uint64_t mask = Facility::slotMask(booking.slot.startTime, booking.slot.endTime);
+                if ((mask & taken[day]) != 0 ||
+                    (mask & facility.getAvailabilityMask(booking.slot.day)) != 0) {
+                    ++report_.overlappingBookings;
+                }
+                taken[day] |= mask;
+            }
+        }
+
+        for (uint32_t bookingId : held) report_.unknownBookings += told.count(bookingId) == 0;
+        for (uint32_t bookingId : told) report_.missingBookings += held.count(bookingId) == 0;
+    }
+};
+
+}  // namespace
+
+SimulationReport Simulation::run(const SimulationConfig &config) { return Run(config).run(); }
+
+std::string SimulationReport::format() const {
+    char text[512];
+    std::snprintf(
+        text, sizeof(text),
+        "Requests %llu in %.1f s virtual, %.2f s wall; %llu transmissions, %llu dropped, "
+        "%llu duplicated\n"
+        "Server cost %.0f ns per datagram\n"
+        "Conflicting replies %llu, unknown bookings %llu, missing bookings %llu, "
+        "overlapping bookings %llu: %s\n",
+        static_cast<unsigned long long>(requests),
+        std::chrono::duration<double>(virtualTime).count(), wallSeconds,
+        static_cast<unsigned long long>(transmissions), static_cast<unsigned long long>(dropped),
+        static_cast<unsigned long long>(duplicated), serverNsPerDatagram,
+        static_cast<unsigned long long>(conflictingReplies),
+        static_cast<unsigned long long>(unknownBookings),
+        static_cast<unsigned long long>(missingBookings),
+        static_cast<unsigned long long>(overlappingBookings),
+        consistent() ? "consistent" : "INCONSISTENT");
+    return text;
+}
@@ -0,0 +1,255 @@
+#include "Snapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Read-only mapping of a whole file
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ == 0) return;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_) data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) return;
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || st.st_size == 0) return;
+        size_ = static_cast<size_t>(st.st_size);
+        void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (p != MAP_FAILED) data_ = p;
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) ::munmap(data_, size_);
+        if (fd_ >= 0) ::close(fd_);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const { return static_cast<const uint8_t *>(data_); }
+    size_t size() const { return size_; }
+
+  private:
+    void *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+template <typename T>
+void appendRaw(std::vector<uint8_t> &out, const T *items, size_t count) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(items);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+}  // namespace
+
+void Snapshot::write(const std::string &path,
+                     const std::unordered_map<std::string, Facility> &facilities,
+                     uint64_t walLsn) {
+    std::vector<FacilityRecord> facilityRecords;
+    std::vector<SlotRecord> slotRecords;
+    std::vector<BookingRecord> bookingRecords;
+    std::string names;
+    facilityRecords.reserve(facilities.size());
+
+    for (const auto &[name, facility] : facilities) {
+        FacilityRecord record{};
+        record.nameOffset = static_cast<uint32_t>(names.size());
+        record.nameLength = static_cast<uint32_t>(name.size());
+        names += name;
+
+        record.firstSlot = static_cast<uint32_t>(slotRecords.size());
+        for (const auto &slot : facility.getAvailableSlots()) {
+            slotRecords.push_back({static_cast<uint8_t>(slot.day), 0, slot.startTime.toHHMM(),
+                                   slot.endTime.toHHMM(), 0});
+        }
+        record.slotCount = static_cast<uint32_t>(slotRecords.size()) - record.firstSlot;
+
+        record.firstBooking = static_cast<uint32_t>(bookingRecords.size());
+        for (const auto &[bookingId, booking] : facility.getBookings()) {
+            bookingRecords.push_back({bookingId, static_cast<uint8_t>(booking.slot.day), 0,
+                                      booking.slot.startTime.toHHMM(),
+                                      booking.slot.endTime.toHHMM(), 0});
+        }
+        record.bookingCount = static_cast<uint32_t>(bookingRecords.size()) - record.firstBooking;
+
+        for (int d = 0; d < 7; ++d) {
+            record.dayVersions[d] = facility.getDayVersion(static_cast<Util::Day>(d));
+        }
+        facilityRecords.push_back(record);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.formatVersion = FORMAT_VERSION;
+    header.byteOrderMark = BYTE_ORDER_MARK;
+    header.nextBookingId = Facility::getNextBookingId();
+    header.walLsn = walLsn;
+    header.facilityCount = static_cast<uint32_t>(facilityRecords.size());
+    header.slotCount = static_cast<uint32_t>(slotRecords.size());
+    header.bookingCount = static_cast<uint32_t>(bookingRecords.size());
+    header.namesSize = static_cast<uint32_t>(names.size());
+    header.facilitiesOffset = sizeof(Header);
+    header.slotsOffset = header.facilitiesOffset + facilityRecords.size() * sizeof(FacilityRecord);
+    header.bookingsOffset = header.slotsOffset + slotRecords.size() * sizeof(SlotRecord);
+    header.namesOffset = header.bookingsOffset + bookingRecords.size() * sizeof(BookingRecord);
+
+    std::vector<uint8_t> contents;
+    contents.reserve(header.namesOffset + names.size());
+    appendRaw(contents, &header, 1);
+    appendRaw(contents, facilityRecords.data(), facilityRecords.size());
+    appendRaw(contents, slotRecords.data(), slotRecords.size());
+    appendRaw(contents, bookingRecords.data(), bookingRecords.size());
+    appendRaw(contents, names.data(), names.size());
+
+    std::string tmpPath = path + ".tmp";
+    std::FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Cannot write snapshot: " + tmpPath);
+    }
+    bool ok = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    ok = std::fflush(file) == 0 && ok;
+#ifndef _WIN32
+    ok = ::fsync(fileno(file)) == 0 && ok;
+#endif
+    std::fclose(file);
+    if (!ok) {
+        throw std::runtime_error("Failed writing snapshot: " + tmpPath);
+    }
+
+    // Readers see the old snapshot or the new one, never neither; syncing the directory makes the
+    // rename itself survive a crash
+#ifdef _WIN32
+    if (!MoveFileExA(tmpPath.c_str(), path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        throw std::runtime_error("Cannot move snapshot into place: " + path);
+    }
+#else
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot move snapshot into place: " + path);
+    }
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    int dirFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+    ok = dirFd >= 0 && ::fsync(dirFd) == 0;
+    if (dirFd >= 0) ::close(dirFd);
+    if (!ok) {
+        throw std::runtime_error("Failed syncing the snapshot directory of " + path);
+    }
+#endif
+}
+
+bool Snapshot::load(const std::string &path,
+                    std::unordered_map<std::string, Facility> &facilities, uint64_t &walLsn) {
+    MappedFile file(path);
+    if (!file.data()) return false;
+
+    if (file.size() < sizeof(Header)) {
+        throw std::runtime_error("Snapshot too small: " + path);
+    }
+    const Header &header = *reinterpret_cast<const Header *>(file.data());
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.formatVersion != FORMAT_VERSION || header.byteOrderMark != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Unsupported snapshot format: " + path);
+    }
+    // Every section lies inside the file, suitably aligned; 64-bit sums cannot overflow here since
+    // counts are 32-bit and offsets beyond the file size are rejected first
+    auto sectionFits = [&](uint64_t offset, uint64_t count, uint64_t recordSize, size_t align) {
+        return offset <= file.size() && offset % align == 0 &&
+               count * recordSize <= file.size() - offset;
+    };
+    if (!sectionFits(header.facilitiesOffset, header.facilityCount, sizeof(FacilityRecord),
+                     alignof(FacilityRecord)) ||
+        !sectionFits(header.slotsOffset, header.slotCount, sizeof(SlotRecord),
+                     alignof(SlotRecord)) ||
+        !sectionFits(header.bookingsOffset, header.bookingCount, sizeof(BookingRecord),
+                     alignof(BookingRecord)) ||
+        !sectionFits(header.namesOffset, header.namesSize, 1, 1)) {
+        throw std::runtime_error("Truncated snapshot: " + path);
+    }
+    auto rangeFits = [](uint64_t first, uint64_t count, uint64_t total) {
+        return first + count <= total;
+    };
+
+    const auto *facilityRecords =
+        reinterpret_cast<const FacilityRecord *>(file.data() + header.facilitiesOffset);
+    const auto *slotRecords = reinterpret_cast<const SlotRecord *>(file.data() + header.slotsOffset);
+    const auto *bookingRecords =
+        reinterpret_cast<const BookingRecord *>(file.data() + header.bookingsOffset);
+    const char *names = reinterpret_cast<const char *>(file.data() + header.namesOffset);
+
+    facilities.reserve(facilities.size() + header.facilityCount);
+
+    for (uint32_t i = 0; i < header.facilityCount; ++i) {
+        const FacilityRecord &record = facilityRecords[i];
+        if (!rangeFits(record.nameOffset, record.nameLength, header.namesSize) ||
+            !rangeFits(record.firstSlot, record.slotCount, header.slotCount) ||
+            !rangeFits(record.firstBooking, record.bookingCount, header.bookingCount)) {
+            throw std::runtime_error("Corrupt snapshot record in " + path);
+        }
+
+        std::string name(names + record.nameOffset, record.nameLength);
+
+        std::vector<Facility::TimeSlot> slots;
+        slots.reserve(record.slotCount);
+        for (uint32_t s = record.firstSlot; s < record.firstSlot + record.slotCount; ++s) {
+            const SlotRecord &slot = slotRecords[s];
+            if (slot.day >= 7) throw std::runtime_error("Corrupt snapshot slot in " + path);
+            slots.push_back(Facility::TimeSlot::fromHHMM(static_cast<Util::Day>(slot.day),
+                                                         slot.startTime, slot.endTime));
+        }
+
+        std::unordered_map<uint32_t, Facility::BookingInfo> bookings;
+        bookings.reserve(record.bookingCount);
+        for (uint32_t b = record.firstBooking; b < record.firstBooking + record.bookingCount; ++b) {
+            const BookingRecord &booking = bookingRecords[b];
+            if (booking.day >= 7) throw std::runtime_error("Corrupt snapshot booking in " + path);
+            bookings.emplace(booking.bookingId,
+                             Facility::TimeSlot::fromHHMM(static_cast<Util::Day>(booking.day),
+                                                          booking.startTime, booking.endTime));
+        }
+
+        std::array<uint32_t, 7> versions;
+        std::copy(std::begin(record.dayVersions), std::end(record.dayVersions), versions.begin());
+
+        auto [it, inserted] = facilities.try_emplace(name, name);
+        it->second.restoreState(std::move(slots), std::move(bookings), versions);
+    }
+
+    Facility::reserveBookingIds(header.nextBookingId);
+    walLsn = header.walLsn;
+    return true;
+}
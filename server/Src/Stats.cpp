@@ -0,0 +1,60 @@
+#include "Stats.h"
+#include <cstdio>
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < 2 * SUB_BUCKETS) return index;
+    size_t shift = index / SUB_BUCKETS - 1;
+    uint64_t low = static_cast<uint64_t>(index - shift * SUB_BUCKETS) << shift;
+    return low + (uint64_t{1} << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) return std::min(bucketUpperBound(i), max_);
+    }
+    return max_;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+const char *ServerStats::operationName(size_t operation) {
+    static const char *const NAMES[OPERATIONS] = {"OTHER",  "QUERY",  "BOOK",
+                                                  "CHANGE", "MONITOR", "EXTEND",
+                                                  "CANCEL", "RESYNC", "STATS",
+                                                  "HELLO",  "WAITLIST"};
+    return operation < OPERATIONS ? NAMES[operation] : NAMES[0];
+}
+
+void ServerStats::format(uint64_t notificationsSent, TextWriter &out) const {
+    char line[128];
+    auto emit = [&](int length) {
+        out << std::string_view(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+    };
+    emit(std::snprintf(line, sizeof(line), "%-8s %6s %6s %6s %6s %6s %6s\n", "us", "count",
+                       "mean", "p50", "p99", "p99.9", "max"));
+    auto us = [](uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+    for (size_t op = 0; op < OPERATIONS; ++op) {
+        const LatencyHistogram &h = latency[op];
+        if (h.count() == 0) continue;
+        emit(std::snprintf(line, sizeof(line), "%-8s %6llu %6.1f %6.1f %6.1f %6.1f %6.1f\n",
+                           operationName(op), static_cast<unsigned long long>(h.count()),
+                           us(h.mean()), us(h.percentile(50)), us(h.percentile(99)),
+                           us(h.percentile(99.9)), us(h.max())));
+    }
+
+    out << "Requests " << requests << ", failed " << failed << ", duplicates " << duplicates
+        << " (" << cacheHits << " from cache)\n";
+    out << "Malformed " << malformed << "; dropped " << requestsDropped << " in, "
+        << repliesDropped << " out; held " << repliesHeld << "; relayed " << relayed << '\n';
+    out << "Notified " << notificationsSent << "; sessions moved " << sessionMoves
+        << "; waitlisted " << waitlisted << ", " << waitlistBooked << " booked\n";
+}
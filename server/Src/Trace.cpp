@@ -0,0 +1,110 @@
+#include "Trace.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t BUFFER_SIZE = 1 << 20;  // stdio buffer; a capture writes a record per datagram
+
+void putU16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void putU64(std::vector<uint8_t> &out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+uint16_t getU16(const uint8_t *p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+
+uint64_t getU64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value = (value << 8) | p[i];
+    return value;
+}
+
+bool readExactly(std::FILE *file, void *data, size_t size) {
+    return std::fread(data, 1, size, file) == size;
+}
+
+}  // namespace
+
+TraceWriter::TraceWriter(const std::string &path)
+    : file_(std::fopen(path.c_str(), "wb")), started_(std::chrono::steady_clock::now()) {
+    if (!file_) throw std::runtime_error("Cannot create trace file " + path);
+    std::setvbuf(file_, nullptr, _IOFBF, BUFFER_SIZE);
+
+    std::vector<uint8_t> header(std::begin(TraceFormat::MAGIC), std::end(TraceFormat::MAGIC));
+    putU16(header, TraceFormat::VERSION);
+    putU16(header, 0);
+    std::fwrite(header.data(), 1, header.size(), file_);
+}
+
+TraceWriter::~TraceWriter() { std::fclose(file_); }
+
+void TraceWriter::write(TraceRecord::Kind kind, const boost::asio::ip::udp::endpoint &client,
+                        const void *data, size_t size) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started_);
+
+    record_.clear();
+    putU64(record_, static_cast<uint64_t>(elapsed.count()));
+    record_.push_back(static_cast<uint8_t>(kind));
+    if (client.address().is_v4()) {
+        auto bytes = client.address().to_v4().to_bytes();
+        record_.push_back(static_cast<uint8_t>(bytes.size()));
+        record_.insert(record_.end(), bytes.begin(), bytes.end());
+    } else {
+        auto bytes = client.address().to_v6().to_bytes();
+        record_.push_back(static_cast<uint8_t>(bytes.size()));
+        record_.insert(record_.end(), bytes.begin(), bytes.end());
+    }
+    putU16(record_, client.port());
+    putU16(record_, static_cast<uint16_t>(size));
+    record_.insert(record_.end(), static_cast<const uint8_t *>(data),
+                   static_cast<const uint8_t *>(data) + size);
+    std::fwrite(record_.data(), 1, record_.size(), file_);
+}
+
+TraceReader::TraceReader(const std::string &path) : file_(std::fopen(path.c_str(), "rb")) {
+    if (!file_) throw std::runtime_error("Cannot open trace file " + path);
+    std::setvbuf(file_, nullptr, _IOFBF, BUFFER_SIZE);
+
+    uint8_t header[TraceFormat::HEADER_SIZE];
+    if (!readExactly(file_, header, sizeof(header)) ||
+        std::memcmp(header, TraceFormat::MAGIC, sizeof(TraceFormat::MAGIC)) != 0 ||
+        getU16(header + 4) != TraceFormat::VERSION) {
+        std::fclose(file_);
+        throw std::runtime_error(path + " is not a request trace");
+    }
+}
+
+TraceReader::~TraceReader() { std::fclose(file_); }
+
+bool TraceReader::next(TraceRecord &record) {
+    uint8_t fixed[10];  // [TimestampUs][Kind][AddressLength]
+    if (!readExactly(file_, fixed, sizeof(fixed))) return false;
+    size_t addressLength = fixed[9];
+    if (addressLength != 4 && addressLength != 16) return false;
+
+    uint8_t address[16 + 4];  // the address, then [Port][Length]
+    if (!readExactly(file_, address, addressLength + 4)) return false;
+    uint16_t port = getU16(address + addressLength);
+    uint16_t length = getU16(address + addressLength + 2);
+
+    record.timestampUs = getU64(fixed);
+    record.kind = static_cast<TraceRecord::Kind>(fixed[8]);
+    if (addressLength == 4) {
+        boost::asio::ip::address_v4::bytes_type bytes;
+        std::memcpy(bytes.data(), address, bytes.size());
+        record.client = {boost::asio::ip::address_v4(bytes), port};
+    } else {
+        boost::asio::ip::address_v6::bytes_type bytes;
+        std::memcpy(bytes.data(), address, bytes.size());
+        record.client = {boost::asio::ip::address_v6(bytes), port};
+    }
+    record.datagram.resize(length);
+    return readExactly(file_, record.datagram.data(), length);
+}
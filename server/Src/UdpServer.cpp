@@ -1,22 +1,45 @@
 #include "UdpServer.h"
 #include "Facility.h"
 #include "Util.h"
-#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <random>
 #include <sstream>
+#include <stdexcept>
+#include "Logger.h"
 #include "Message.h"
 
 using namespace std;
 using namespace boost::asio;
 
+namespace {
+
+// Day and times of a catalog record that only names its facility
+const Facility::TimeSlot NO_SLOT(Util::Day::Monday, TimeOfDay(), TimeOfDay());
+
+}  // namespace
+
 UDPServer::UDPServer(io_context &io_context, short portNumber,
                      std::unordered_map<std::string, Facility> facilities, bool atLeastOnce)
     : io_context_(io_context),
       port_(portNumber),
-      facilities(std::move(facilities)),  // Move the facilities into the member variable
       socket_(io_context, udp::endpoint(udp::v4(), portNumber)),
-      atLeastOnce_(atLeastOnce) {
-    cout << "[Server] Server started on port " << portNumber << " with "
-         << (atLeastOnce ? "At-Least-Once" : "At-Most-Once") << " mode." << endl;
+      atLeastOnce_(atLeastOnce),
+      facilities(std::move(facilities)),  // Move the facilities into the member variable
+      fanout_([this](const uint8_t *data, size_t size, const udp::endpoint &endpoint) {
+          do_send_reliable(data, size, endpoint);
+      }),
+      statsTimer_(io_context),
+      catalogDefinition_(std::make_shared<const FacilityCatalog::Definition>()),
+      tokenRandom_(uint64_t{std::random_device{}()} << 32 | std::random_device{}()) {
+    std::vector<std::string> names;
+    for (const auto &[name, facility] : this->facilities) names.push_back(name);
+    std::sort(names.begin(), names.end());
+    for (const auto &name : names) assignFacilityId(name);
+
+    Log::info("[Server] Server started on port {} with {} mode.", portNumber,
+              atLeastOnce ? "At-Least-Once" : "At-Most-Once");
+    fanout_.start();
     do_receive();
 }
 
@@ -25,15 +48,350 @@ UDPServer::~UDPServer() { stop(); }
 void UDPServer::start() { io_context_.run(); }
 
 void UDPServer::stop() {
+    if (!socket_.is_open()) return;  // already stopped
+    if (wal_) wal_->stop();
+    if (replicator_) replicator_->stop();
+    if (backup_) backup_->stop();
+    if (forwardSocket_) forwardSocket_->close();
+    if (reloadThread_.joinable()) reloadThread_.join();
+    statsTimer_.cancel();
+    if (network_) network_->stop();
+    capture_.reset();  // flushes the trace
+    fanout_.stop();
     socket_.close();
-    cout << "[Server] Server stopped." << endl;
+    Log::info("[Server] Server stopped.");
+}
+
+void UDPServer::enableWriteAheadLog(const std::string &path, uint64_t fromLsn) {
+    auto recovered = WriteAheadLog::replay(
+        path, [this](const WalRecord &record) { applyWalRecord(record); }, fromLsn);
+    recovered.lastLsn = std::max(recovered.lastLsn, fromLsn);  // keep counting after a checkpoint
+    Log::info("[Server] Replayed {} WAL records from {}", recovered.records, path);
+
+    wal_ = std::make_unique<WriteAheadLog>(path, recovered);
+    lastLoggedLsn_ = durableLsn_ = recovered.lastLsn;
+    wal_->start(
+        [this](uint64_t lsn) {
+            boost::asio::post(io_context_, [this, lsn]() { releaseDurableReplies(lsn); });
+        },
+        [this](int) { boost::asio::post(io_context_, [this]() { failHeldReplies(); }); });
+}
+
+void UDPServer::checkpoint(const std::string &snapshotPath) {
+    if (wal_ && wal_->failed()) {
+        Log::error("[Server] No checkpoint: the write-ahead log failed, so the disk is suspect.");
+        return;
+    }
+    // Every logged record is durable once the flusher has stopped
+    Snapshot::write(snapshotPath, facilities, lastLoggedLsn_);
+    if (wal_) wal_->truncate();
+    Log::info("[Server] Checkpoint written to {} at LSN {}", snapshotPath, lastLoggedLsn_);
+}
+
+void UDPServer::replicateTo(std::vector<udp::endpoint> backups, unsigned short followerPort) {
+    replicaEndpoints_ = std::move(backups);
+    followerPort_ = followerPort;
+    if (backup_ || (replicaEndpoints_.empty() && followerPort_ == 0)) return;  // or on takeover
+
+    replicatedLsn_ = lastLoggedLsn_;
+    replicator_ = std::make_unique<ReplicationPrimary>(
+        io_context_, replicaEndpoints_, lastLoggedLsn_,
+        [this](uint64_t lsn) {
+            replicatedLsn_ = lsn;
+            releaseCommittedReplies();
+        },
+        followerPort_);
+    if (followerPort_ != 0) {
+        Log::info("[Server] Replicating to {} backup(s), followers register on port {}.",
+                  replicaEndpoints_.size(), followerPort_);
+    } else {
+        Log::info("[Server] Replicating to {} backup(s).", replicaEndpoints_.size());
+    }
+}
+
+void UDPServer::runAsBackup(unsigned short replicationPort,
+                            std::chrono::milliseconds takeoverAfter) {
+    backup_ = std::make_unique<ReplicationBackup>(
+        io_context_, replicationPort, lastLoggedLsn_,
+        [this](const WalRecord &record) { applyReplicatedRecord(record); },
+        [this]() { takeOver(); }, takeoverAfter);
+}
+
+void UDPServer::takeOver() {
+    // Invoked from inside the backup's own handler, so destroy it only after that returns
+    std::shared_ptr<ReplicationBackup> retired(std::move(backup_));
+    boost::asio::post(io_context_, [retired]() {});
+
+    Log::info("[Server] Now serving as primary from LSN {}.", lastLoggedLsn_);
+    replicateTo(replicaEndpoints_, followerPort_);
+}
+
+void UDPServer::enableCatalogReload(const std::string &path, unsigned threads,
+                                    FacilityCatalog::Definition current) {
+    catalogPath_ = path;
+    catalogThreads_ = threads;
+
+    // Facilities whose hours were replayed from the WAL may differ from what `current` says
+    bool replayed = false;
+    for (const auto &[name, hours] : *catalogDefinition_.load()) {
+        if (hours.empty()) {
+            current[name].clear();
+            replayed = true;
+        }
+    }
+    catalogDefinition_.store(
+        std::make_shared<const FacilityCatalog::Definition>(std::move(current)));
+    if (replayed && !backup_) reloadCatalog();
+}
+
+void UDPServer::reloadCatalog() {
+    if (catalogPath_.empty()) {
+        Log::warn("[Server] No catalog to reload.");
+        return;
+    }
+    if (backup_) {
+        Log::warn("[Server] Catalog changes come from the primary; reload skipped.");
+        return;
+    }
+    if (reloadInProgress_.exchange(true)) return;  // one at a time
+    if (reloadThread_.joinable()) reloadThread_.join();  // the previous one has finished
+
+    reloadThread_ = std::thread([this]() {
+        auto change = std::make_shared<CatalogChange>();
+        try {
+            FacilityCatalog::Definition definition;
+            change->upserts = FacilityCatalog::load(catalogPath_, catalogThreads_, &definition);
+
+            // Diff against the published definition; unchanged facilities stay as they are
+            auto current = catalogDefinition_.load();
+            for (const auto &[name, hours] : *current) {
+                auto it = definition.find(name);
+                if (it == definition.end()) {
+                    change->removed.push_back(name);
+                } else if (it->second == hours) {
+                    change->upserts.erase(name);
+                }
+            }
+            change->definition =
+                std::make_shared<const FacilityCatalog::Definition>(std::move(definition));
+        } catch (const std::exception &e) {
+            Log::error("[Server] Catalog reload failed, keeping the current one: {}", e.what());
+            reloadInProgress_ = false;
+            return;
+        }
+
+        boost::asio::post(io_context_, [this, change]() {
+            applyCatalogChange(*change);
+            reloadInProgress_ = false;
+        });
+    });
+}
+
+void UDPServer::applyCatalogChange(CatalogChange &change) {
+    // Logged like any other mutation, so the WAL and the replicas go through the same change
+    for (const auto &name : change.removed) {
+        auto it = facilities.find(name);
+        if (it == facilities.end()) continue;
+        const auto &bookings = it->second.getBookings();
+        if (!bookings.empty()) {
+            Log::warn("[Server] Closing {} drops {} booking(s).", name, bookings.size());
+        }
+        for (const auto &[bookingId, booking] : bookings) {
+            logMutation(Operation::CANCEL, name, bookingId, booking.slot);
+        }
+        logMutation(Operation::CATALOG_REMOVE, name, 0, NO_SLOT);
+        removeFacility(name);
+    }
+
+    size_t added = 0;
+    for (auto &[name, fresh] : change.upserts) {
+        auto it = facilities.find(name);
+        if (it == facilities.end()) {
+            logCatalogHours(fresh);
+            assignFacilityId(name);
+            facilities.emplace(name, std::move(fresh));
+            ++added;
+            continue;
+        }
+
+        // Bookings the new hours cannot hold are cancelled before the hours change
+        Facility &current = it->second;
+        Facility probe = fresh;
+        std::vector<uint32_t> dropped;
+        for (const auto &[bookingId, booking] : current.getBookings()) {
+            if (!probe.applyBooking(bookingId, booking.slot)) dropped.push_back(bookingId);
+        }
+        for (uint32_t bookingId : dropped) {
+            Log::warn("[Server] Booking {} at {} is outside the new opening hours and was dropped.",
+                      bookingId, name);
+            auto slot = current.cancelBooking(bookingId);
+            logMutation(Operation::CANCEL, name, bookingId, *slot);
+        }
+        logCatalogHours(fresh);
+        replaceHours(current, fresh);
+    }
+
+    catalogDefinition_.store(std::move(change.definition));
+    Log::info("[Server] Catalog reloaded: {} added, {} changed, {} removed.", added,
+              change.upserts.size() - added, change.removed.size());
+}
+
+void UDPServer::logCatalogHours(const Facility &fresh) {
+    for (const auto &slot : fresh.getAvailableSlots()) {
+        logMutation(Operation::CATALOG_HOURS, fresh.getName(), 0, slot);
+    }
+    logMutation(Operation::CATALOG_APPLY, fresh.getName(), 0, NO_SLOT);
+}
+
+void UDPServer::replaceHours(Facility &current, Facility &fresh) {
+    std::array<uint64_t, 7> before;
+    for (int d = 0; d < 7; ++d) before[d] = current.getAvailabilityMask(static_cast<Util::Day>(d));
+
+    // Existing bookings keep their IDs; applyCatalogChange has already cancelled, and logged, the
+    // ones the new hours do not cover
+    for (const auto &[bookingId, booking] : current.getBookings()) {
+        if (!fresh.applyBooking(bookingId, booking.slot)) {
+            Log::warn("[Server] Booking {} at {} is outside the new opening hours and was dropped.",
+                      bookingId, current.getName());
+        }
+    }
+
+    // Versions only move forward, so delta watchers see the new hours as a change
+    std::array<uint32_t, 7> versions;
+    for (int d = 0; d < 7; ++d) versions[d] = current.getDayVersion(static_cast<Util::Day>(d)) + 1;
+    current.restoreState(fresh.getAvailableSlots(), fresh.getBookings(), versions);
+
+    for (int d = 0; d < 7; ++d) {
+        Util::Day day = static_cast<Util::Day>(d);
+        if (uint64_t changed = before[d] ^ current.getAvailabilityMask(day)) {
+            notifyMonitorClients(current, day, changed);
+            bookForWaitlist(current, day, changed);  // new hours may cover waiting ranges
+        }
+    }
+}
+
+void UDPServer::removeFacility(const std::string &name) {
+    facilities.erase(name);
+    waitlist_.remove(name);
+    fanout_.removeFacility(name);
+}
+
+// Replay side of logCatalogHours and the removals in applyCatalogChange
+void UDPServer::applyCatalogRecord(const WalRecord &record) {
+    const std::string &name = record.facilityName;
+    switch (record.operation) {
+        case Operation::CATALOG_HOURS: {
+            if (!Util::isDay(record.day)) {
+                Log::warn("[Server] WAL record {} has an invalid day, skipped.", record.lsn);
+                return;
+            }
+            auto pending = catalogPending_.try_emplace(name, name).first;
+            pending->second.addAvailability(
+                Facility::TimeSlot::fromHHMM(record.day, record.startTime, record.endTime));
+            return;
+        }
+        case Operation::CATALOG_APPLY: {
+            auto pending = catalogPending_.extract(name);
+            Facility fresh = pending ? std::move(pending.mapped()) : Facility(name);
+            auto it = facilities.find(name);
+            if (it == facilities.end()) {
+                assignFacilityId(name);
+                facilities.emplace(name, std::move(fresh));
+            } else {
+                replaceHours(it->second, fresh);
+            }
+            break;
+        }
+        case Operation::CATALOG_REMOVE:
+            removeFacility(name);
+            break;
+        default:
+            return;
+    }
+    markCatalogReplayed(name);
+}
+
+// The facility's hours now come from the log rather than from this server's catalog file
+void UDPServer::markCatalogReplayed(const std::string &name) {
+    auto definition = std::make_shared<FacilityCatalog::Definition>(*catalogDefinition_.load());
+    (*definition)[name].clear();
+    catalogDefinition_.store(std::move(definition));
+}
+
+void UDPServer::runAsFollower(const udp::endpoint &primary,
+                              const udp::endpoint &primaryReplication) {
+    primaryEndpoint_ = primary;
+    backup_ = std::make_unique<ReplicationBackup>(
+        io_context_, 0, lastLoggedLsn_,
+        [this](const WalRecord &record) { applyReplicatedRecord(record); }, nullptr,
+        std::chrono::milliseconds(400));
+    backup_->follow(primaryReplication);
+
+    forwardSocket_ = std::make_unique<udp::socket>(io_context_, udp::endpoint(udp::v4(), 0));
+    receiveForwardedReplies();
+    Log::info("[Server] Following primary {}; mutations are relayed to it.", primary);
+}
+
+void UDPServer::forwardToPrimary(const RequestMessage &request, const RequestKey &requestKey) {
+    // A client retry reuses the relayed ID, so the primary's duplicate filter still applies
+    auto [it, isNew] = relayedIds_.try_emplace(requestKey, nextRelayedId_);
+    uint32_t relayedId = it->second;
+    if (isNew) {
+        ++nextRelayedId_;
+        forwardedRequests_[relayedId] = {request.clientEndpoint, request.requestId, requestKey};
+        forwardOrder_.push(relayedId);
+        if (forwardOrder_.size() > MAX_PROCESSED_REQUESTS) {
+            auto oldest = forwardedRequests_.find(forwardOrder_.front());
+            relayedIds_.erase(oldest->second.requestKey);
+            forwardedRequests_.erase(oldest);
+            forwardOrder_.pop();
+        }
+    }
+
+    RequestMessage relayed = request;
+    relayed.requestId = relayedId;
+    auto data = std::make_shared<std::vector<uint8_t>>(relayed.marshal());
+    forwardSocket_->async_send_to(buffer(*data), *primaryEndpoint_,
+                                  [data](const boost::system::error_code &, std::size_t) {});
+}
+
+void UDPServer::receiveForwardedReplies() {
+    forwardSocket_->async_receive_from(
+        buffer(forwardBuffer_), forwardSender_,
+        [this](boost::system::error_code ec, std::size_t size) {
+            if (ec == boost::asio::error::operation_aborted) return;
+            if (!ec && size > 0) {
+                try {
+                    ResponseMessage response =
+                        ResponseMessage::unmarshal(forwardBuffer_.data(), size);
+                    auto it = forwardedRequests_.find(response.requestId);
+                    if (it != forwardedRequests_.end()) {
+                        response.requestId = it->second.requestId;
+                        std::string reply;
+                        response.marshal(reply);
+                        do_send(std::move(reply), it->second.clientEndpoint);
+                    }
+                } catch (const std::exception &e) {
+                    Log::warn("[Server] Bad reply from the primary: {}", e.what());
+                }
+            }
+            receiveForwardedReplies();
+        });
+}
+
+void UDPServer::stalenessNote(TextWriter &out) const {
+    auto lag = backup_->staleness();
+    if (lag == std::chrono::milliseconds::max()) {
+        out << "\n[Replica] Not yet in step with the primary.";
+        return;
+    }
+    out << "\n[Replica] At most " << lag.count() << " ms behind the primary.";
 }
 
 void UDPServer::do_receive() {
     socket_.async_receive_from(buffer(recv_buffer_), remote_endpoint_,
                                [this](boost::system::error_code ec, std::size_t bytes_recvd) {
                                    if (!ec && bytes_recvd > 0) {
-                                       string request(recv_buffer_.data(), bytes_recvd);
                                        handle_receive(ec, bytes_recvd);
                                    }
                                    do_receive();  // Continue listening
@@ -43,22 +401,75 @@ void UDPServer::do_receive() {
 void UDPServer::handle_receive(const boost::system::error_code &error, size_t bytes_transferred) {
     if (error) return;  // Early return on error
 
-    if (Util::generateFpRandNumber() < DROP_REQUEST_PROBABILITY) {
-        std::cout << "[Server] Request loss (simulated)." << std::endl;
-        return;  // simulate dropping the incoming request
+    if (capture_) {
+        capture_->write(TraceRecord::Kind::Request, remote_endpoint_, recv_buffer_.data(),
+                        bytes_transferred);
     }
-
     std::vector<uint8_t> requestData(recv_buffer_.begin(),
                                      recv_buffer_.begin() + bytes_transferred);
+    if (!network_) {
+        handle_request(requestData, remote_endpoint_);
+        return;
+    }
+
+    // The emulator may hold the datagram back, so it keeps its own copy of the sender
+    bool delivered = network_->transmit(
+        NetworkEmulator::Direction::Inbound, bytes_transferred,
+        [this, data = std::move(requestData), client = remote_endpoint_]() {
+            handle_request(data, client);
+        });
+    if (!delivered) {
+        Log::info("[Server] Request loss (simulated).");
+        ++stats_.requestsDropped;
+    }
+}
 
-    RequestMessage request = RequestMessage::unmarshal(requestData);
-    request.clientEndpoint = remote_endpoint_;
-    std::string requestKey = request.getUniqueRequestKey();
+void UDPServer::handle_request(const std::vector<uint8_t> &requestData,
+                               const udp::endpoint &client) {
+    auto started = std::chrono::steady_clock::now();
+    auto now = clock_();  // virtual under simulation
+
+    RequestMessage request;
+    try {
+        if (!CompactRequest::matches(requestData)) {
+            request = RequestMessage::unmarshal(requestData);
+        } else if (!decodeCompact(requestData, client, request)) {
+            return;
+        }
+    } catch (const std::exception &e) {
+        Log::warn("[Server] Malformed request from {}: {}", client, e.what());
+        ++stats_.malformed;
+        return;
+    }
+    request.clientEndpoint = client;
+    RequestKey requestKey = request.getUniqueRequestKey();
 
     ResponseMessage response;
     response.requestId = request.requestId;
+    uint64_t lsnBefore = lastLoggedLsn_;
+
+    if (primaryEndpoint_ && (request.operation == Operation::BOOK ||
+                             request.operation == Operation::CHANGE ||
+                             request.operation == Operation::EXTEND ||
+                             request.operation == Operation::CANCEL)) {
+        forwardToPrimary(request, requestKey);  // the reply is relayed when the primary answers
+        ++stats_.relayed;
+        return;
+    }
+
+    // A follower cannot relay a waitlist booking pushed long after the request was answered
+    bool waitlistOnFollower = primaryEndpoint_ && request.operation == Operation::WAITLIST;
+    if (isBackup() || waitlistOnFollower) {
+        response.status = 1;
+        response.message = waitlistOnFollower
+                               ? "Waitlist requests go to the primary."
+                               : "This server is a backup; send requests to the primary.";
+        std::string reply;
+        response.marshal(reply);
+        do_send(std::move(reply), client);
+        return;
+    }
 
-    auto now = std::chrono::steady_clock::now();
     auto it = processedRequests.find(requestKey);
     // how long we want to retain old requests (e.g., 30s)for demo purposes
     int expirySeconds = 30;
@@ -69,18 +480,21 @@ void UDPServer::handle_receive(const boost::system::error_code &error, size_t by
         auto age = std::chrono::duration_cast<std::chrono::seconds>(now - it->second.first).count();
         if (age <= expirySeconds) {
             isDuplicate = true;
+            ++stats_.duplicates;
         }
     }
 
     // **At-Most-Once Handling**: Ignore duplicate requests
     if (isDuplicate) {
         response = it->second.second;  // Retrieve the previous response message
-        std::cout << "[Server] Duplicate request received. Replaying cached response.\n";
+        ++stats_.cacheHits;
+        Log::info("[Server] Duplicate request {} received. Replaying cached response.",
+                  request.requestId);
     } else {
         if (!atLeastOnce_) {
             // Clean up if over capacity
             if (processedRequests.size() >= MAX_PROCESSED_REQUESTS) {
-                const std::string &oldest = requestOrder.front();
+                const RequestKey &oldest = requestOrder.front();
                 processedRequests.erase(oldest);
                 requestOrder.pop();
             }
@@ -88,56 +502,119 @@ void UDPServer::handle_receive(const boost::system::error_code &error, size_t by
             processedRequests[requestKey] = {now, response};
             requestOrder.push(requestKey);
         }
+        // Version 3 clients get an OpResult, everyone else the sentence it stands for
+        const ProtocolSession *session = findSession(request);
+        bool binaryResults = session != nullptr && session->version >= PROTOCOL_BINARY_RESULTS;
+        // Text replies are formatted here and copied into the message once at the end
+        TextBuffer<MAX_TEXT_REPLY> text;
+        auto respond = [&](const OpResult &result) {
+            if (binaryResults) {
+                response.status = STATUS_RESULT;
+                result.marshal(response.message);
+            } else {
+                response.status = result.textStatus();
+                result.formatText(request.facilityName, text);
+            }
+        };
+        auto fail = [&](ResultCode code) { respond(OpResult::failure(request.operation, code)); };
+        // Requests carry HHMM; from here on times are minutes
+        Facility::TimeSlot requested =
+            Facility::TimeSlot::fromHHMM(request.day, request.startTime, request.endTime);
+
         try {
+            // Facilities keep their state in per-day arrays; a wire day past Sunday stops here
+            if (!Util::isDay(request.day)) throw std::invalid_argument("Invalid day.");
+
             switch (request.operation) {
                 case Operation::QUERY:
+                    if (binaryResults) {
+                        if (facilities.count(request.facilityName) == 0) {
+                            fail(ResultCode::FACILITY_NOT_FOUND);
+                            break;
+                        }
+                        response.status = STATUS_DELTA;
+                        response.message = resyncAvailability(request.facilityName, request.day);
+                        break;
+                    }
                     response.status = 0;
-                    response.message = queryAvailability(request.facilityName, request.day);
+                    queryAvailability(request.facilityName, request.day, text);
+                    if (primaryEndpoint_) stalenessNote(text);
                     break;
 
                 case Operation::BOOK:
-                    response.status = 0;
-                    response.message = bookFacility(request.facilityName, request.day,
-                                                    request.startTime, request.endTime);
+                    respond(bookFacility(request.facilityName, requested));
                     break;
 
                 case Operation::CHANGE:
                     if (!request.bookingId.has_value() || !request.offsetMinutes.has_value()) {
-                        throw std::runtime_error(
-                            "Booking ID and offset are required for modification.");
+                        fail(ResultCode::MISSING_FIELD);
+                        break;
                     }
-                    response.status = 0;
-                    response.message =
-                        modifyBookFacility(request.facilityName, request.bookingId.value(),
-                                           request.offsetMinutes.value());
+                    respond(modifyBookFacility(request.facilityName, request.bookingId.value(),
+                                               request.offsetMinutes.value()));
                     break;
                 case Operation::EXTEND:
                     if (!request.bookingId.has_value() || !request.offsetMinutes.has_value()) {
-                        throw std::runtime_error("Booking ID and extension duration required.");
+                        fail(ResultCode::MISSING_FIELD);
+                        break;
                     }
-                    response.status = 0;
-                    response.message =
-                        extendBookFacility(request.facilityName, request.bookingId.value(),
-                                           request.offsetMinutes.value());
+                    respond(extendBookFacility(request.facilityName, request.bookingId.value(),
+                                               request.offsetMinutes.value()));
                     break;
 
                 case Operation::CANCEL:
                     if (!request.bookingId.has_value()) {
-                        throw std::runtime_error("Booking ID required for cancellation.");
+                        fail(ResultCode::MISSING_FIELD);
+                        break;
                     }
-                    response.status = 0;
-                    response.message =
-                        cancelBookFacility(request.facilityName, request.bookingId.value());
+                    respond(cancelBookFacility(request.facilityName, request.bookingId.value()));
                     break;
 
                 case Operation::MONITOR:
                     if (!request.monitorInterval.has_value()) {
-                        throw std::runtime_error("Monitor interval is required.");
+                        fail(ResultCode::MISSING_FIELD);
+                        break;
+                    }
+                    if (binaryResults && facilities.count(request.facilityName) == 0) {
+                        fail(ResultCode::FACILITY_NOT_FOUND);
+                        break;
+                    }
+                    registerMonitorClient(request.facilityName, requested,
+                                          request.monitorInterval.value(),
+                                          request.monitorFlags.value_or(0), client,
+                                          request.sessionToken);
+                    if (binaryResults) {
+                        respond(OpResult::success(Operation::MONITOR, 0, requested));
+                        break;
                     }
                     response.status = 0;
-                    response.message = registerMonitorClient(
-                        request.facilityName, request.day, request.startTime, request.endTime,
-                        request.monitorInterval.value(), remote_endpoint_);
+                    text << "Client registered to monitor " << request.facilityName << " from "
+                         << request.startTime << " to " << request.endTime << " for "
+                         << request.monitorInterval.value() << " seconds.\n";
+                    if (primaryEndpoint_) stalenessNote(text);
+                    break;
+
+                case Operation::WAITLIST:
+                    if (!request.monitorInterval.has_value()) {
+                        fail(ResultCode::MISSING_FIELD);
+                        break;
+                    }
+                    respond(waitlistFacility(request, requested, binaryResults));
+                    break;
+
+                case Operation::RESYNC:
+                    response.status = STATUS_DELTA;
+                    response.message = resyncAvailability(request.facilityName, request.day);
+                    break;
+
+                case Operation::STATS:
+                    response.status = 0;
+                    response.message = statsReport();
+                    break;
+
+                case Operation::HELLO:
+                    response.status = 0;
+                    response.message = helloClient(request, client);
                     break;
 
                 default:
@@ -145,232 +622,647 @@ void UDPServer::handle_receive(const boost::system::error_code &error, size_t by
                     response.message = "Invalid operation.";
                     break;
             }
+            if (text.size() > 0) response.message.assign(text.view());
         } catch (const std::exception &e) {
             response.status = 1;
             response.message = e.what();
         }
+        // Cache the filled-in reply; a retry must get the same answer, not an empty one
+        if (!atLeastOnce_) processedRequests[requestKey].second = response;
     }
 
     // Send response
-    auto responseData = response.marshal();
-    do_send(std::string(responseData.begin(), responseData.end()), remote_endpoint_);
-}
-
-void UDPServer::do_send(const string &message, const udp::endpoint &endpoint) {
-    if (Util::generateFpRandNumber() >= SEND_SUCCESS_RATE) {  // simulate the rate of loss
-        socket_.async_send_to(buffer(message), endpoint,
-                              [this](boost::system::error_code ec, std::size_t /*bytes_sent*/) {
-                                  if (ec) {
-                                      cerr << "Error sending response: " << ec.message() << endl;
-                                  }
-                              });
+    std::string reply;
+    response.marshal(reply);
+
+    // A mutation (or a replay of one that may still be in flight) is only confirmed once committed
+    bool needsCommit = lastLoggedLsn_ != lsnBefore || isDuplicate;
+    if (needsCommit && lastLoggedLsn_ > committedLsn()) {
+        pendingReplies_.push_back({lastLoggedLsn_, std::move(reply), client});
+        ++stats_.repliesHeld;
     } else {
-        std::cout << "[Server] Reply loss. (simulated)" << std::endl;
+        do_send(std::move(reply), client);
+    }
+
+    ++stats_.requests;
+    if (response.status == 1) ++stats_.failed;
+    size_t op = static_cast<size_t>(request.operation);
+    stats_.latency[op < ServerStats::OPERATIONS ? op : 0].record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                             started)
+            .count()));
+}
+
+std::string UDPServer::statsReport() const {
+    TextBuffer<STATS_REPLY_BYTES> report;
+    stats_.format(notificationsSent_.load(std::memory_order_relaxed), report);
+
+    // Utilization: booked share of the opening hours, busiest facilities first
+    auto minutes = [](const Facility::TimeSlot &slot) {
+        return static_cast<uint64_t>(slot.endTime - slot.startTime);
+    };
+    std::vector<std::pair<double, const std::string *>> busiest;
+    uint64_t totalBooked = 0, totalOpen = 0;
+    for (const auto &[name, facility] : facilities) {
+        uint64_t booked = 0, open = 0;
+        for (const auto &[id, booking] : facility.getBookings()) booked += minutes(booking.slot);
+        for (const auto &slot : facility.getAvailableSlots()) open += minutes(slot);
+        open += booked;
+        totalBooked += booked;
+        totalOpen += open;
+        busiest.emplace_back(open ? 100.0 * booked / open : 0.0, &name);
+    }
+    size_t shown = std::min(busiest.size(), STATS_TOP_FACILITIES);
+    std::partial_sort(busiest.begin(), busiest.begin() + shown, busiest.end(),
+                      [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    // Whole lines only: the facilities that do not fit are left out rather than cut off
+    char line[64];
+    auto emit = [&](int length) {
+        if (length > 0 && static_cast<size_t>(length) <= report.remaining()) {
+            report << std::string_view(line, static_cast<size_t>(length));
+        }
+    };
+    emit(std::snprintf(line, sizeof(line), "Utilization %.1f%% of %zu facilities\n",
+                       totalOpen ? 100.0 * totalBooked / totalOpen : 0.0, facilities.size()));
+    for (size_t i = 0; i < shown; ++i) {
+        emit(std::snprintf(line, sizeof(line), "  %-20.20s %5.1f%%\n",
+                           busiest[i].second->c_str(), busiest[i].first));
+    }
+    return report.str();
+}
+
+void UDPServer::enableStatsDump(std::chrono::seconds interval) {
+    statsInterval_ = interval;
+    statsTimer_.expires_after(statsInterval_);
+    statsTimer_.async_wait([this](const boost::system::error_code &ec) {
+        if (!ec) dumpStats();
+    });
+}
+
+void UDPServer::dumpStats() {
+    std::string report = statsReport();
+    size_t start = 0;
+    while (start < report.size()) {  // one record per line keeps each within the logger's limit
+        size_t end = report.find('\n', start);
+        Log::info("[Stats] {}", std::string_view(report).substr(start, end - start));
+        start = end == std::string::npos ? report.size() : end + 1;
+    }
+    enableStatsDump(statsInterval_);
+}
+
+uint64_t UDPServer::committedLsn() const {
+    uint64_t lsn = wal_ ? durableLsn_ : lastLoggedLsn_;
+    if (replicator_) lsn = std::min(lsn, replicatedLsn_);
+    return lsn;
+}
+
+void UDPServer::releaseDurableReplies(uint64_t lsn) {
+    durableLsn_ = std::max(durableLsn_, lsn);
+    releaseCommittedReplies();
+}
+
+void UDPServer::releaseCommittedReplies() {
+    uint64_t committed = committedLsn();
+    while (!pendingReplies_.empty() && pendingReplies_.front().lsn <= committed) {
+        PendingReply &reply = pendingReplies_.front();
+        do_send(std::move(reply.data), reply.endpoint);
+        pendingReplies_.pop_front();
+    }
+}
+
+// The WAL could not write: what it holds back will never be durable, so none of it is confirmed.
+// The server stops rather than go on taking bookings it cannot keep; a backup takes over.
+void UDPServer::failHeldReplies() {
+    Log::error("[Server] Write-ahead log failed; failing {} held replies and stopping.",
+               pendingReplies_.size());
+    for (PendingReply &held : pendingReplies_) {
+        ResponseMessage failure;
+        failure.requestId = ResponseMessage::unmarshal(held.data).requestId;
+        failure.status = 1;
+        failure.message = "The change could not be saved and may be lost; please check again.";
+        std::string reply;
+        failure.marshal(reply);
+        do_send(std::move(reply), held.endpoint);
+    }
+    pendingReplies_.clear();
+    io_context_.stop();
+}
+
+void UDPServer::do_send(string message, const udp::endpoint &endpoint) {
+    if (capture_) {
+        capture_->write(TraceRecord::Kind::Reply, endpoint, message.data(), message.size());
+    }
+    if (!network_) {
+        send_datagram(std::move(message), endpoint);
+        return;
+    }
+
+    size_t size = message.size();
+    bool delivered = network_->transmit(
+        NetworkEmulator::Direction::Outbound, size,
+        [this, data = std::move(message), endpoint]() { send_datagram(data, endpoint); });
+    if (!delivered) {
+        Log::info("[Server] Reply loss. (simulated)");
+        ++stats_.repliesDropped;
     }
 }
 
-void UDPServer::do_send_reliable(const std::string &message, const udp::endpoint &endpoint) {
-    socket_.async_send_to(buffer(message), endpoint,
-                          [this](boost::system::error_code ec, std::size_t /*bytes_sent*/) {
+void UDPServer::send_datagram(string message, const udp::endpoint &endpoint) {
+    if (transport_) {
+        transport_(message, endpoint);
+        return;
+    }
+    // The buffer has to outlive the asynchronous send
+    auto data = std::make_shared<std::string>(std::move(message));
+    socket_.async_send_to(buffer(*data), endpoint,
+                          [this, data](boost::system::error_code ec, std::size_t /*bytes_sent*/) {
                               if (ec) {
-                                  std::cerr << "Error sending reliable response: " << ec.message()
-                                            << std::endl;
+                                  Log::error("Error sending response: {}", ec.message());
                               }
                           });
 }
 
-std::string UDPServer::queryAvailability(const std::string &facility, const Util::Day &day) {
-    Facility &f = getFacilityOrThrow(facility);  // throws if not found
-    return f.getAvailability(day);
+void UDPServer::useTransport(TransportFunction transport, ClockFunction clock) {
+    transport_ = std::move(transport);
+    clock_ = std::move(clock);
+}
+
+void UDPServer::enableCapture(const std::string &path) {
+    capture_ = std::make_unique<TraceWriter>(path);
+    Log::info("[Server] Capturing requests and replies to {}", path);
 }
 
-std::string UDPServer::bookFacility(const std::string &facility, const Util::Day &day,
-                                    uint16_t startTime, uint16_t endTime) {
+void UDPServer::emulateNetwork(const LinkPolicy &inbound, const LinkPolicy &outbound,
+                               uint64_t seed) {
+    if (network_) network_->stop();
+    network_ = std::make_unique<NetworkEmulator>(io_context_, seed);
+    network_->setPolicy(NetworkEmulator::Direction::Inbound, inbound);
+    network_->setPolicy(NetworkEmulator::Direction::Outbound, outbound);
+}
+
+void UDPServer::do_send_reliable(const uint8_t *data, size_t size,
+                                 const udp::endpoint &endpoint) {
+    // Called from the fan-out thread, so bypass the asio socket object (not safe to share across
+    // threads) and hand the datagram straight to the kernel socket
+    auto sent = ::sendto(socket_.native_handle(), reinterpret_cast<const char *>(data),
+                         static_cast<int>(size), 0, endpoint.data(),
+                         static_cast<int>(endpoint.size()));
+    if (sent < 0) {
+        Log::error("Error sending reliable response to {}", endpoint);
+    } else {
+        notificationsSent_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void UDPServer::queryAvailability(const std::string &facility, const Util::Day &day,
+                                  TextWriter &out) {
     Facility &f = getFacilityOrThrow(facility);  // throws if not found
+    f.formatAvailability(day, out);
+}
+
+OpResult UDPServer::bookFacility(const std::string &facility, const Facility::TimeSlot &slot) {
+    auto it = facilities.find(facility);
+    if (it == facilities.end()) {
+        return OpResult::failure(Operation::BOOK, ResultCode::FACILITY_NOT_FOUND);
+    }
+    Facility &f = it->second;
 
-    Facility::TimeSlot slot(day, startTime, endTime);
     uint32_t bookingId;
+    if (!f.bookSlot(slot, bookingId)) {
+        return OpResult::failure(Operation::BOOK, ResultCode::SLOT_UNAVAILABLE);
+    }
+    logMutation(Operation::BOOK, facility, bookingId, slot);
+    notifyMonitorClients(f, slot.day, Facility::slotMask(slot.startTime, slot.endTime));
+    return OpResult::success(Operation::BOOK, bookingId, slot);
+}
 
-    if (f.bookSlot(slot, bookingId)) {
-        notifyMonitorClients(facility, startTime, endTime);
-        return "Booking confirmed for " + facility + " on " + slot.toString() +
-               ". Booking ID: " + std::to_string(bookingId);
-    } else {
-        return "Slot not available.";
+namespace {
+
+ResultCode resultCodeOf(Facility::ChangeResult change) {
+    switch (change) {
+        case Facility::ChangeResult::Done:
+            return ResultCode::OK;
+        case Facility::ChangeResult::InvalidBooking:
+            return ResultCode::INVALID_BOOKING;
+        case Facility::ChangeResult::InvalidRange:
+            return ResultCode::INVALID_TIME_RANGE;
+        case Facility::ChangeResult::Unavailable:
+            break;
     }
+    return ResultCode::SLOT_UNAVAILABLE;
 }
 
-std::string UDPServer::modifyBookFacility(std::string &facility, uint32_t bookingId,
-                                          int offsetMinutes) {
-    Facility &f = getFacilityOrThrow(facility);  // Throws if facility doesn't exist
+}  // namespace
 
-    std::string errorMessage;
+OpResult UDPServer::modifyBookFacility(const std::string &facility, uint32_t bookingId,
+                                       int offsetMinutes) {
+    auto it = facilities.find(facility);
+    if (it == facilities.end()) {
+        return OpResult::failure(Operation::CHANGE, ResultCode::FACILITY_NOT_FOUND);
+    }
+    Facility &f = it->second;
 
     // Get original booking slot before modification
-    Facility::BookingInfo oldBooking = f.getBookingInfo(bookingId);
-    Facility::TimeSlot oldSlot = oldBooking.slot;
+    auto booking = f.getBookings().find(bookingId);
+    if (booking == f.getBookings().end()) {
+        return OpResult::failure(Operation::CHANGE, ResultCode::INVALID_BOOKING);
+    }
+    Facility::TimeSlot oldSlot = booking->second.slot;
 
     // Attempt modification
-    if (!f.modifyBooking(bookingId, offsetMinutes, errorMessage)) {
-        throw std::runtime_error("Failed to modify booking: " + errorMessage);
+    auto outcome = f.modifyBooking(bookingId, offsetMinutes);
+    if (outcome != Facility::ChangeResult::Done) {
+        return OpResult::failure(Operation::CHANGE, resultCodeOf(outcome));
     }
 
-    Facility::BookingInfo newBooking = f.getBookingInfo(bookingId);
-    Facility::TimeSlot newSlot = newBooking.slot;
+    Facility::TimeSlot newSlot = f.getBookingInfo(bookingId).slot;
+    logMutation(Operation::CHANGE, facility, bookingId, newSlot);
 
     // Combine overlapping or adjacent time slots
-    uint16_t combinedStart = oldSlot.startTime;
-    uint16_t combinedEnd = oldSlot.endTime;
+    TimeOfDay combinedStart = oldSlot.startTime;
+    TimeOfDay combinedEnd = oldSlot.endTime;
 
     if ((oldSlot.endTime >= newSlot.startTime && oldSlot.startTime <= newSlot.endTime) ||
         oldSlot.endTime == newSlot.startTime || newSlot.endTime == oldSlot.startTime) {
         combinedStart = std::min(oldSlot.startTime, newSlot.startTime);
         combinedEnd = std::max(oldSlot.endTime, newSlot.endTime);
 
-        std::cout << "[Server] Combined timeslot: " << combinedStart << " to " << combinedEnd
-                  << "\n";
+        Log::debug("[Server] Combined timeslot: {} to {}", combinedStart.toHHMM(),
+                   combinedEnd.toHHMM());
 
         // call notifyMonitorClients with this combined range
-        notifyMonitorClients(facility, combinedStart, combinedEnd);
+        notifyMonitorClients(f, newSlot.day, Facility::slotMask(combinedStart, combinedEnd));
     } else {
-        // No overlap, notify both separately
-        notifyMonitorClients(facility, oldSlot.startTime, oldSlot.endTime);
-        notifyMonitorClients(facility, newSlot.startTime, newSlot.endTime);
+        // No overlap, notify both ranges in one update
+        notifyMonitorClients(f, newSlot.day,
+                             Facility::slotMask(oldSlot.startTime, oldSlot.endTime) |
+                                 Facility::slotMask(newSlot.startTime, newSlot.endTime));
     }
+    bookForWaitlist(f, newSlot.day,
+                    Facility::slotMask(oldSlot.startTime, oldSlot.endTime) &
+                        ~Facility::slotMask(newSlot.startTime, newSlot.endTime));
 
-    return "Booking with ID " + std::to_string(bookingId) + " modified successfully to " +
-           newSlot.toString() + ".";
+    return OpResult::success(Operation::CHANGE, bookingId, newSlot);
 }
 
-std::string UDPServer::extendBookFacility(std::string &facility, uint32_t bookingId,
-                                          int extensionMinutes) {
-    Facility &f = getFacilityOrThrow(facility);  // throws if not found
+OpResult UDPServer::extendBookFacility(const std::string &facility, uint32_t bookingId,
+                                       int extensionMinutes) {
+    auto it = facilities.find(facility);
+    if (it == facilities.end()) {
+        return OpResult::failure(Operation::EXTEND, ResultCode::FACILITY_NOT_FOUND);
+    }
+    Facility &f = it->second;
 
     // Get original slot before extension
-    Facility::BookingInfo oldBooking = f.getBookingInfo(bookingId);
-    Facility::TimeSlot oldSlot = oldBooking.slot;
+    auto booking = f.getBookings().find(bookingId);
+    if (booking == f.getBookings().end()) {
+        return OpResult::failure(Operation::EXTEND, ResultCode::INVALID_BOOKING);
+    }
+    Facility::TimeSlot oldSlot = booking->second.slot;
 
-    std::string errorMessage;
-    if (!f.extendBooking(bookingId, extensionMinutes, errorMessage)) {
-        throw std::runtime_error("Failed to extend booking: " + errorMessage);
+    auto outcome = f.extendBooking(bookingId, extensionMinutes);
+    if (outcome != Facility::ChangeResult::Done) {
+        return OpResult::failure(Operation::EXTEND, resultCodeOf(outcome));
     }
 
     // Get the updated slot after extension
-    Facility::BookingInfo newBooking = f.getBookingInfo(bookingId);
-    Facility::TimeSlot newSlot = newBooking.slot;
+    Facility::TimeSlot newSlot = f.getBookingInfo(bookingId).slot;
+    logMutation(Operation::EXTEND, facility, bookingId, newSlot);
 
     // Notify only for the newly added portion
     if (newSlot.endTime > oldSlot.endTime) {
-        notifyMonitorClients(facility, oldSlot.endTime, newSlot.endTime);
+        notifyMonitorClients(f, newSlot.day, Facility::slotMask(oldSlot.endTime, newSlot.endTime));
     } else if (newSlot.startTime < oldSlot.startTime) {
-        notifyMonitorClients(facility, newSlot.startTime, oldSlot.startTime);
+        notifyMonitorClients(f, newSlot.day,
+                             Facility::slotMask(newSlot.startTime, oldSlot.startTime));
     }
 
-    return "Booking with ID " + std::to_string(bookingId) + " extended successfully to " +
-           newSlot.toString() + ".";
+    return OpResult::success(Operation::EXTEND, bookingId, newSlot);
 }
 
-std::string UDPServer::cancelBookFacility(const std::string &facility, uint32_t bookingId) {
-    Facility &f = getFacilityOrThrow(facility);  // Throws if facility doesn't exist
+OpResult UDPServer::cancelBookFacility(const std::string &facility, uint32_t bookingId) {
+    auto it = facilities.find(facility);
+    if (it == facilities.end()) {
+        return OpResult::failure(Operation::CANCEL, ResultCode::FACILITY_NOT_FOUND);
+    }
+    Facility &f = it->second;
 
     auto cancelledSlot = f.cancelBooking(bookingId);
-    if (cancelledSlot.has_value()) {
-        notifyMonitorClients(facility, cancelledSlot->startTime, cancelledSlot->endTime);
-        return "Booking with ID " + std::to_string(bookingId) + " canceled successfully.";
-    } else {
-        return "Invalid booking ID.";
-    }
-}
-
-std::string UDPServer::registerMonitorClient(const std::string &facility, const Util::Day &day,
-                                             uint16_t startTime, uint16_t endTime,
-                                             uint32_t interval,
-                                             const udp::endpoint &clientEndpoint) {
-    Facility &f = getFacilityOrThrow(facility);  // Throws if facility doesn't exist
-
-    // Create MonitorInfo with the desired timeslot
-    MonitorInfo monitorInfo = {
-        clientEndpoint,
-        day,
-        startTime,
-        endTime,
-        interval,
-        std::make_shared<boost::asio::steady_timer>(io_context_, std::chrono::seconds(interval))};
-
-    // Store monitor info in the map
-    monitoringClients[facility][day].emplace(startTime, monitorInfo);
-
-    auto monitorInfoCopy = monitorInfo;
-    // Timer to auto-expire after the interval ends
-    monitorInfo.timer->async_wait(
-        [this, facility, monitorInfoCopy, clientEndpoint](const boost::system::error_code &ec) {
-            if (!ec) {
-                std::cout << "[Server] Monitoring expired for client: " << clientEndpoint
-                          << " on facility: " << facility << " for " << monitorInfoCopy.startTime
-                          << " to " << monitorInfoCopy.endTime << std::endl;
-                removeMonitorClient(facility, clientEndpoint);
-            }
-        });
+    if (!cancelledSlot.has_value()) {
+        return OpResult::failure(Operation::CANCEL, ResultCode::INVALID_BOOKING);
+    }
+    logMutation(Operation::CANCEL, facility, bookingId, *cancelledSlot);
+    uint64_t freed = Facility::slotMask(cancelledSlot->startTime, cancelledSlot->endTime);
+    notifyMonitorClients(f, cancelledSlot->day, freed);
+    bookForWaitlist(f, cancelledSlot->day, freed);
+    return OpResult::success(Operation::CANCEL, bookingId, *cancelledSlot);
+}
+
+OpResult UDPServer::waitlistFacility(const RequestMessage &request,
+                                     const Facility::TimeSlot &range, bool binaryResults) {
+    auto it = facilities.find(request.facilityName);
+    if (it == facilities.end()) {
+        return OpResult::failure(Operation::WAITLIST, ResultCode::FACILITY_NOT_FOUND);
+    }
+    // Time the facility is not open at never frees up, so nobody may wait for it
+    uint64_t wanted = Facility::slotMask(range.startTime, range.endTime);
+    if (!Util::isDay(range.day) || range.startTime >= range.endTime ||
+        range.startTime < Facility::OPENING || range.endTime > Facility::CLOSING ||
+        (wanted & ~it->second.getOpeningMask(range.day)) != 0) {
+        return OpResult::failure(Operation::WAITLIST, ResultCode::INVALID_TIME_RANGE);
+    }
+
+    // Nobody needs to wait for a range that is free
+    OpResult booked = bookFacility(request.facilityName, range);
+    if (booked.code != ResultCode::SLOT_UNAVAILABLE) return booked;
 
-    return "Client registered to monitor " + facility + " from " + std::to_string(startTime) +
-           " to " + std::to_string(endTime) + " for " + std::to_string(interval) + " seconds.\n";
+    auto now = clock_();
+    Waitlist::Waiter waiter{range,
+                            request.monitorFlags.value_or(0),
+                            request.getUniqueRequestKey().client,
+                            request.requestId,
+                            request.clientEndpoint,
+                            request.sessionToken,
+                            binaryResults,
+                            now + std::chrono::seconds(request.monitorInterval.value())};
+    size_t position = waitlist_.add(request.facilityName, std::move(waiter), now);
+    if (position == 0) {
+        return OpResult::failure(Operation::WAITLIST, ResultCode::SLOT_UNAVAILABLE);
+    }
+    ++stats_.waitlisted;
+    Log::info("[Server] {} waits for {} on {}, number {} in line.", request.clientEndpoint,
+              request.facilityName, range.toString(), position);
+    return OpResult::success(Operation::WAITLIST, 0, range);
 }
 
-void UDPServer::removeMonitorClient(const std::string &facility,
-                                    const udp::endpoint &clientEndpoint) {
-    auto facilityIt = monitoringClients.find(facility);
-    if (facilityIt == monitoringClients.end()) return;
+// After `freedMask` of the day became free: book it for whoever waits for it and tell them
+void UDPServer::bookForWaitlist(Facility &facility, Util::Day day, uint64_t freedMask) {
+    if (freedMask == 0 || waitlist_.empty()) return;
+    auto assigned = waitlist_.match(facility, day, freedMask, clock_());
+    if (assigned.empty()) return;
 
-    for (auto &[day, monitorMap] : facilityIt->second) {
-        for (auto it = monitorMap.begin(); it != monitorMap.end();) {
-            if (it->second.clientEndpoint == clientEndpoint) {
-                it = monitorMap.erase(it);
-            } else {
-                ++it;
-            }
+    uint64_t booked = 0;
+    for (const auto &[waiter, bookingId] : assigned) {
+        logMutation(Operation::BOOK, facility.getName(), bookingId, waiter.range);
+        booked |= Facility::slotMask(waiter.range.startTime, waiter.range.endTime);
+        ++stats_.waitlistBooked;
+        Log::info("[Server] Booked {} on {} from the waitlist for {}, booking ID {}.",
+                  facility.getName(), waiter.range.toString(), waiter.endpoint, bookingId);
+
+        // Pushed like a reply: only once committed, and to where the session is now
+        udp::endpoint endpoint = waiter.endpoint;
+        if (auto session = sessions_.find(waiter.sessionToken); session != sessions_.end()) {
+            endpoint = session->second.endpoint;
+        }
+        OpResult result = OpResult::success(Operation::WAITLIST, bookingId, waiter.range);
+        ResponseMessage push;
+        push.requestId = waiter.requestId;
+        if (waiter.binaryResults) {
+            push.status = STATUS_RESULT;
+            result.marshal(push.message);
+        } else {
+            push.status = 0;
+            push.message = result.toText(facility.getName());
+        }
+        std::string datagram;
+        push.marshal(datagram);
+        if (lastLoggedLsn_ > committedLsn()) {
+            pendingReplies_.push_back({lastLoggedLsn_, std::move(datagram), endpoint});
+            ++stats_.repliesHeld;
+        } else {
+            do_send(std::move(datagram), endpoint);
         }
     }
+    notifyMonitorClients(facility, day, booked);
 }
 
-void UDPServer::notifyMonitorClients(const std::string &facility, uint16_t changedStartTime,
-                                     uint16_t changedEndTime) {
-    auto facilityIt = monitoringClients.find(facility);
-    if (facilityIt == monitoringClients.end()) return;
+void UDPServer::registerMonitorClient(const std::string &facility, const Facility::TimeSlot &range,
+                                      uint32_t interval, uint8_t flags,
+                                      const udp::endpoint &clientEndpoint,
+                                      uint64_t sessionToken) {
+    getFacilityOrThrow(facility);  // Throws if facility doesn't exist
 
-    auto facilityPtr = facilities.find(facility);
-    if (facilityPtr == facilities.end()) return;
+    // Registration is handed to the fan-out stage, which owns the subscriptions
+    fanout_.subscribe(facility, range.day, range.startTime, range.endTime, interval, flags,
+                      clientEndpoint, sessionToken);
+}
 
-    const Facility &fac = facilityPtr->second;
+std::string UDPServer::resyncAvailability(const std::string &facility, const Util::Day &day) {
+    const Facility &f = getFacilityOrThrow(facility);  // Throws if facility doesn't exist
+    if (!Util::isDay(day)) throw std::invalid_argument("Invalid day.");  // indexes the day state
 
-    ResponseMessage response;
+    // The whole day fits in one delta, so resync from any version is a single full-day update
+    auto state = f.snapshot(day);  // version and bits from the same published state
+    DeltaMessage delta;
+    delta.facilityName = facility;
+    delta.day = day;
+    delta.version = state->version;
+    delta.firstSlot = 0;
+    delta.slotCount = Facility::SLOTS_PER_DAY;
+    delta.bits = state->availableMask;
 
-    for (auto &[day, monitorMap] : facilityIt->second) {
-        for (uint16_t t = changedStartTime; t < changedEndTime;
-             t = Util::toHHMM(Util::toMinutes(t) + 30)) {
-            uint16_t subStart = t;
-            uint16_t subEnd = Util::toHHMM(Util::toMinutes(t) + 30);
+    std::string payload;
+    delta.marshal(payload);
+    return payload;
+}
 
-            Facility::TimeSlot slot(day, subStart, subEnd);
-            bool isAvailable = fac.isAvailable(slot);
-            std::string availabilityStatus = isAvailable ? "available" : "not available";
+std::string UDPServer::helloClient(const RequestMessage &request, const udp::endpoint &client) {
+    HelloReply hello;
+    hello.version =
+        std::min(request.protocolVersion.value_or(PROTOCOL_LEGACY), PROTOCOL_SESSION_TOKENS);
+    if (hello.version >= PROTOCOL_COMPACT) {
+        uint64_t token = openSession(request.requestId, hello.version, client);
+        if (hello.version >= PROTOCOL_SESSION_TOKENS) hello.sessionToken = token;
+        hello.facilities = facilityNames_;
+    }
 
-            std::set<std::pair<uint16_t, uint16_t>> notified;
+    std::string payload;
+    hello.marshal(payload);
+    return payload;
+}
 
-            for (auto &[monitorStart, info] : monitorMap) {
-                if (info.endTime > subStart && monitorStart < subEnd) {
-                    // Build response
-                    response.message = "Update: Availability for " + facility + " from " +
-                                       std::to_string(subStart) + " to " + std::to_string(subEnd) +
-                                       " changed to " + availabilityStatus + ".";
-                    response.status = 0;
+void UDPServer::assignFacilityId(const std::string &name) {
+    if (facilityIds_.emplace(name, static_cast<uint32_t>(facilityNames_.size() + 1)).second) {
+        facilityNames_.push_back(name);
+    }
+}
 
-                    auto responseData = response.marshal();
-                    do_send_reliable(std::string(responseData.begin(), responseData.end()),
-                                     info.clientEndpoint);
-                }
+// Every session gets a token, sent only to version 4 clients. A HELLO from an address that had a
+// session starts a new one there; the old one is left to age out.
+uint64_t UDPServer::openSession(uint32_t helloRequestId, uint8_t version,
+                                const udp::endpoint &client) {
+    uint64_t token;
+    do {
+        token = tokenRandom_.next() | SESSION_TOKEN_BIT;
+    } while (sessions_.count(token) != 0);
+    sessions_.emplace(token, ProtocolSession{helloRequestId, version, client});
+    sessionTokens_[client] = token;
+    sessionOrder_.push(token);
+    if (sessions_.size() > MAX_SESSIONS) {
+        uint64_t oldest = sessionOrder_.front();
+        sessionOrder_.pop();
+        auto at = sessionTokens_.find(sessions_.at(oldest).endpoint);
+        if (at != sessionTokens_.end() && at->second == oldest) sessionTokens_.erase(at);
+        sessions_.erase(oldest);
+    }
+    return token;
+}
+
+// By the request's token, or else by the address it came from
+const UDPServer::ProtocolSession *UDPServer::findSession(const RequestMessage &request) const {
+    uint64_t token = request.sessionToken;
+    if (token == 0) {
+        auto at = sessionTokens_.find(request.clientEndpoint);
+        if (at == sessionTokens_.end()) return nullptr;
+        token = at->second;
+    }
+    auto session = sessions_.find(token);
+    return session == sessions_.end() ? nullptr : &session->second;
+}
+
+// False if the client has no session; it has been told to say HELLO. A request whose token names
+// a session last seen elsewhere moves the session, and its subscriptions, to the new address.
+bool UDPServer::decodeCompact(const std::vector<uint8_t> &requestData, const udp::endpoint &client,
+                              RequestMessage &request) {
+    CompactRequest compact = CompactRequest::unmarshal(requestData);
+    uint64_t token = compact.sessionToken;
+    if (token == 0) {
+        auto at = sessionTokens_.find(client);
+        if (at != sessionTokens_.end()) token = at->second;
+    }
+    auto session = sessions_.find(token);
+    if (session == sessions_.end()) {
+        ResponseMessage refusal;
+        refusal.requestId = 0;
+        refusal.status = STATUS_HELLO_REQUIRED;
+        refusal.message = "No protocol session; send HELLO first.";
+        std::string reply;
+        refusal.marshal(reply);
+        do_send(std::move(reply), client);
+        return false;
+    }
+    request = compact.toRequest(session->second.helloRequestId, facilityNames_);
+
+    if (compact.sessionToken != 0 && session->second.endpoint != client) {
+        Log::info("[Server] Session moved from {} to {}.", session->second.endpoint, client);
+        auto at = sessionTokens_.find(session->second.endpoint);
+        if (at != sessionTokens_.end() && at->second == token) sessionTokens_.erase(at);
+        sessionTokens_[client] = token;
+        session->second.endpoint = client;
+        fanout_.rebind(token, client);
+        ++stats_.sessionMoves;
+    }
+    return true;
+}
+
+void UDPServer::notifyMonitorClients(const Facility &facility, Util::Day day,
+                                     uint64_t changedMask) {
+    // Snapshot the day here; formatting and sending happen on the fan-out thread
+    auto state = facility.snapshot(day);
+    fanout_.publishChange(facility.getName(), day, state->version, changedMask,
+                          state->availableMask);
+}
+
+void UDPServer::logMutation(Operation operation, const std::string &facility,
+                            uint32_t bookingId, const Facility::TimeSlot &slot) {
+    if (!wal_ && !replicator_) return;
+
+    WalRecord record;
+    record.operation = operation;
+    record.facilityName = facility;
+    record.bookingId = bookingId;
+    record.day = slot.day;
+    record.startTime = slot.startTime.toHHMM();
+    record.endTime = slot.endTime.toHHMM();
+    record.lsn = lastLoggedLsn_ + 1;
+    lastLoggedLsn_ = wal_ ? wal_->append(record) : record.lsn;
+    if (replicator_) replicator_->replicate(record);
+}
+
+void UDPServer::applyReplicatedRecord(const WalRecord &record) {
+    // Diff the day masks around the apply so monitors on a replica see the change as well. Catalog
+    // records notify by themselves, and a removal would leave the iterator dangling.
+    bool catalog = record.operation == Operation::CATALOG_HOURS ||
+                   record.operation == Operation::CATALOG_APPLY ||
+                   record.operation == Operation::CATALOG_REMOVE;
+    auto facility = catalog ? facilities.end() : facilities.find(record.facilityName);
+    uint64_t before = 0, beforeOldDay = 0;
+    std::optional<Util::Day> oldDay;
+    if (facility != facilities.end()) {
+        const auto &bookings = facility->second.getBookings();
+        auto booking = bookings.find(record.bookingId);
+        if (booking != bookings.end() && booking->second.slot.day != record.day) {
+            oldDay = booking->second.slot.day;
+            beforeOldDay = facility->second.getAvailabilityMask(*oldDay);
+        }
+        before = facility->second.getAvailabilityMask(record.day);
+    }
+
+    applyWalRecord(record);
+
+    if (facility != facilities.end()) {
+        const Facility &f = facility->second;
+        if (uint64_t changed = before ^ f.getAvailabilityMask(record.day)) {
+            notifyMonitorClients(f, record.day, changed);
+        }
+        if (oldDay) {
+            if (uint64_t changed = beforeOldDay ^ f.getAvailabilityMask(*oldDay)) {
+                notifyMonitorClients(f, *oldDay, changed);
             }
         }
     }
+
+    // Keep the backup's own log in step so its LSNs line up after a takeover
+    if (wal_) {
+        WalRecord local = record;
+        if (wal_->append(local) != record.lsn) {
+            Log::error("[Server] Local WAL is out of step with the primary at LSN {}", record.lsn);
+        }
+    }
+    lastLoggedLsn_ = record.lsn;
+}
+
+void UDPServer::applyWalRecord(const WalRecord &record) {
+    switch (record.operation) {
+        case Operation::CATALOG_HOURS:
+        case Operation::CATALOG_APPLY:
+        case Operation::CATALOG_REMOVE:
+            applyCatalogRecord(record);
+            return;
+        default:
+            break;
+    }
+
+    auto it = facilities.find(record.facilityName);
+    if (it == facilities.end()) {
+        Log::warn("[Server] WAL record {} names unknown facility '{}', skipped.", record.lsn,
+                  record.facilityName);
+        return;
+    }
+
+    Facility &f = it->second;
+    auto slot = Facility::TimeSlot::fromHHMM(record.day, record.startTime, record.endTime);
+    bool applied = false;
+
+    switch (record.operation) {
+        case Operation::BOOK:
+            applied = f.applyBooking(record.bookingId, slot);
+            break;
+        case Operation::CHANGE:
+        case Operation::EXTEND:
+            applied = f.applyBookingChange(record.bookingId, slot);
+            break;
+        case Operation::CANCEL:
+            applied = f.cancelBooking(record.bookingId).has_value();
+            break;
+        default:
+            break;
+    }
+
+    if (!applied) {
+        Log::warn("[Server] WAL record {} could not be applied, skipped.", record.lsn);
+    }
 }
 
 Facility &UDPServer::getFacilityOrThrow(const std::string &facilityName) {
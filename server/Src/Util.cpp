@@ -2,27 +2,39 @@
 #include <unordered_map>
 #include <stdexcept>
 
-std::string Util::dayToString(Util::Day day) {
-    switch (day) {
-        case Day::Monday:
-            return "Monday";
-        case Day::Tuesday:
-            return "Tuesday";
-        case Day::Wednesday:
-            return "Wednesday";
-        case Day::Thursday:
-            return "Thursday";
-        case Day::Friday:
-            return "Friday";
-        case Day::Saturday:
-            return "Saturday";
-        case Day::Sunday:
-            return "Sunday";
-        default:
-            return "Unknown";
-    }
+namespace {
+
+uint64_t splitMix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+}  // namespace
+
+FastRandom::FastRandom(uint64_t seed) {
+    for (auto &word : state_) word = splitMix64(seed);
+}
+
+uint64_t FastRandom::next() {
+    uint64_t result = rotl(state_[1] * 5, 7) * 9;
+    uint64_t t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = rotl(state_[3], 45);
+    return result;
 }
 
+double FastRandom::nextDouble() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+std::string Util::dayToString(Util::Day day) { return std::string(dayName(day)); }
+
 Util::Day Util::stringToDay(const std::string& dayStr) {
     static const std::unordered_map<std::string, Day> dayMap = {
         {"Monday", Day::Monday},     {"Tuesday", Day::Tuesday}, {"Wednesday", Day::Wednesday},
@@ -45,22 +57,3 @@ std::pair<int, int> Util::parseTime(uint16_t time) {
     }
     return {hour, minute};
 }
-
-float Util::generateFpRandNumber() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<double> dist(0.0, 1.0);  // between 0 and 1.0
-    return dist(gen);
-}
-
-int Util::toMinutes(int hhmm) {
-    int hours = hhmm / 100;
-    int minutes = hhmm % 100;
-    return hours * 60 + minutes;
-}
-
-int Util::toHHMM(int minutes) {
-    int hours = minutes / 60;
-    int mins = minutes % 60;
-    return hours * 100 + mins;
-}
@@ -0,0 +1,78 @@
+#include "Waitlist.h"
+#include <iterator>
+
+size_t Waitlist::add(const std::string &facility, Waiter waiter, Clock::time_point now) {
+    if (!Util::isDay(waiter.range.day)) return 0;
+    Line &line = lines_[facility][static_cast<size_t>(waiter.range.day)];
+    dropExpired(line, now);
+
+    // Joining again keeps the arrival but takes the new priority, which may move the waiter
+    uint64_t arrival = nextArrival_;
+    for (auto it = line.begin(); it != line.end(); ++it) {
+        if (it->second.client == waiter.client && it->second.range == waiter.range) {
+            arrival = it->first.second;
+            line.erase(it);
+            --size_;
+            break;
+        }
+    }
+    if (arrival == nextArrival_) {
+        if (line.size() >= MAX_WAITERS_PER_DAY) return 0;
+        ++nextArrival_;
+    }
+
+    auto [it, inserted] = line.emplace(std::make_pair(-static_cast<int>(waiter.priority), arrival),
+                                       std::move(waiter));
+    ++size_;
+    return static_cast<size_t>(std::distance(line.begin(), it)) + 1;
+}
+
+std::vector<Waitlist::Assignment> Waitlist::match(Facility &facility, Util::Day day,
+                                                  uint64_t freedMask, Clock::time_point now) {
+    std::vector<Assignment> assigned;
+    auto lines = lines_.find(facility.getName());
+    if (lines == lines_.end() || !Util::isDay(day)) return assigned;
+    Line &line = lines->second[static_cast<size_t>(day)];
+
+    // A waiter is eligible if the freed time touches its range and the whole range is free now;
+    // once none of the freed time is left there is nobody else to look at
+    uint64_t available = facility.getAvailabilityMask(day);
+    for (auto it = line.begin(); it != line.end() && (available & freedMask) != 0;) {
+        Waiter &waiter = it->second;
+        if (waiter.expiresAt <= now) {
+            it = line.erase(it);
+            --size_;
+            continue;
+        }
+        uint64_t wanted = Facility::slotMask(waiter.range.startTime, waiter.range.endTime);
+        uint32_t bookingId;
+        if ((wanted & freedMask) != 0 && (wanted & ~available) == 0 &&
+            facility.bookSlot(waiter.range, bookingId)) {
+            assigned.push_back({std::move(waiter), bookingId});
+            available = facility.getAvailabilityMask(day);
+            it = line.erase(it);
+            --size_;
+            continue;
+        }
+        ++it;
+    }
+    return assigned;
+}
+
+void Waitlist::remove(const std::string &facility) {
+    auto lines = lines_.find(facility);
+    if (lines == lines_.end()) return;
+    for (const Line &line : lines->second) size_ -= line.size();
+    lines_.erase(lines);
+}
+
+void Waitlist::dropExpired(Line &line, Clock::time_point now) {
+    for (auto it = line.begin(); it != line.end();) {
+        if (it->second.expiresAt <= now) {
+            it = line.erase(it);
+            --size_;
+        } else {
+            ++it;
+        }
+    }
+}
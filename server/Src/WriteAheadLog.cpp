@@ -0,0 +1,253 @@
+#include "WriteAheadLog.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+void putU16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void putU32(std::vector<uint8_t> &out, uint32_t value) {
+    putU16(out, static_cast<uint16_t>(value >> 16));
+    putU16(out, static_cast<uint16_t>(value));
+}
+
+void putU64(std::vector<uint8_t> &out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value >> 32));
+    putU32(out, static_cast<uint32_t>(value));
+}
+
+uint16_t getU16(const uint8_t *p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+
+uint32_t getU32(const uint8_t *p) {
+    return (static_cast<uint32_t>(getU16(p)) << 16) | getU16(p + 2);
+}
+
+uint64_t getU64(const uint8_t *p) {
+    return (static_cast<uint64_t>(getU32(p)) << 32) | getU32(p + 4);
+}
+
+// FNV-1a, enough to catch a torn or half-written tail
+uint32_t checksum(const uint8_t *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr size_t RECORD_PREFIX = 8;                       // [BodyLength][Checksum]
+constexpr size_t FIXED_BODY = 8 + 1 + 4 + 1 + 2 + 2 + 2;  // body without the facility name
+
+}  // namespace
+
+void WalRecord::marshal(std::vector<uint8_t> &out) const {
+    size_t bodyLength = FIXED_BODY + facilityName.size();
+    size_t start = out.size();
+
+    putU32(out, static_cast<uint32_t>(bodyLength));
+    putU32(out, 0);  // checksum, patched below
+
+    putU64(out, lsn);
+    out.push_back(static_cast<uint8_t>(operation));
+    putU32(out, bookingId);
+    out.push_back(static_cast<uint8_t>(day));
+    putU16(out, startTime);
+    putU16(out, endTime);
+    putU16(out, static_cast<uint16_t>(facilityName.size()));
+    out.insert(out.end(), facilityName.begin(), facilityName.end());
+
+    uint32_t sum = checksum(out.data() + start + RECORD_PREFIX, bodyLength);
+    for (int i = 0; i < 4; ++i) {
+        out[start + 4 + i] = static_cast<uint8_t>(sum >> (24 - 8 * i));
+    }
+}
+
+size_t WalRecord::unmarshal(const uint8_t *data, size_t size, WalRecord &record) {
+    if (size < RECORD_PREFIX) return 0;
+
+    uint32_t bodyLength = getU32(data);
+    if (bodyLength < FIXED_BODY || size - RECORD_PREFIX < bodyLength) return 0;
+
+    const uint8_t *body = data + RECORD_PREFIX;
+    if (getU32(data + 4) != checksum(body, bodyLength)) return 0;
+
+    uint16_t nameLength = getU16(body + FIXED_BODY - 2);
+    if (FIXED_BODY + nameLength != bodyLength) return 0;
+
+    record.lsn = getU64(body);
+    record.operation = static_cast<Operation>(body[8]);
+    record.bookingId = getU32(body + 9);
+    record.day = static_cast<Util::Day>(body[13]);
+    record.startTime = getU16(body + 14);
+    record.endTime = getU16(body + 16);
+    record.facilityName.assign(reinterpret_cast<const char *>(body + FIXED_BODY), nameLength);
+
+    return RECORD_PREFIX + bodyLength;
+}
+
+WriteAheadLog::ReplayResult WriteAheadLog::replay(
+    const std::string &path, const std::function<void(const WalRecord &)> &apply,
+    uint64_t fromLsn) {
+    ReplayResult result;
+
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) return result;  // no log yet
+
+    std::vector<uint8_t> contents;
+    uint8_t chunk[64 * 1024];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        contents.insert(contents.end(), chunk, chunk + n);
+    }
+    std::fclose(file);
+
+    if (contents.size() < HEADER_SIZE) return result;  // crashed before the header was synced
+
+    if (!std::equal(std::begin(MAGIC), std::end(MAGIC), contents.begin()) ||
+        getU16(contents.data() + 4) != FORMAT_VERSION) {
+        throw std::runtime_error("Not a write-ahead log (or unsupported version): " + path);
+    }
+
+    size_t offset = HEADER_SIZE;
+    WalRecord record;
+    while (size_t used = WalRecord::unmarshal(contents.data() + offset, contents.size() - offset,
+                                              record)) {
+        if (record.lsn > fromLsn) {  // older records are already in the snapshot
+            apply(record);
+            ++result.records;
+        }
+        result.lastLsn = record.lsn;
+        offset += used;
+    }
+    result.validBytes = offset;
+
+    if (offset != contents.size()) {
+        Log::warn("[WAL] Ignoring {} bytes of torn or corrupt tail in {}", contents.size() - offset,
+                  path);
+    }
+    return result;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string &path, const ReplayResult &recovered)
+    : path_(path), nextLsn_(recovered.lastLsn + 1) {
+    if (std::filesystem::exists(path)) {
+        std::filesystem::resize_file(path, recovered.validBytes);  // drop a torn tail
+    }
+
+    file_ = std::fopen(path.c_str(), "ab");
+    if (!file_) {
+        throw std::runtime_error("Cannot open write-ahead log: " + path);
+    }
+
+    if (recovered.validBytes == 0) writeHeader();
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    stop();
+    if (file_) std::fclose(file_);
+}
+
+void WriteAheadLog::start(DurableHandler onDurable, FailureHandler onFailure) {
+    onDurable_ = std::move(onDurable);
+    onFailure_ = std::move(onFailure);
+    flusher_ = std::thread([this]() { flushLoop(); });
+}
+
+void WriteAheadLog::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (flusher_.joinable()) flusher_.join();
+}
+
+uint64_t WriteAheadLog::append(WalRecord &record) {
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wasEmpty = batch_.empty();
+        record.lsn = nextLsn_++;
+        if (failed_) return record.lsn;  // never written, so never reported durable
+        record.marshal(batch_);
+        batchLastLsn_ = record.lsn;
+    }
+
+    // A non-empty batch means the flusher is already due to pick it up
+    if (wasEmpty) wake_.notify_one();
+    return record.lsn;
+}
+
+void WriteAheadLog::truncate() {
+    std::fclose(file_);
+    file_ = std::fopen(path_.c_str(), "wb");
+    if (!file_) {
+        throw std::runtime_error("Cannot truncate write-ahead log: " + path_);
+    }
+    writeHeader();
+}
+
+void WriteAheadLog::flushLoop() {
+    uint64_t lastDurableLsn = nextLsn_ - 1;  // as of start(), before any append
+    while (true) {
+        uint64_t durableLsn;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return stopping_ || !batch_.empty(); });
+            if (batch_.empty()) return;  // stopping with nothing left to flush
+
+            // Take the whole open batch; appends continue into the (cleared) spare buffer
+            flushing_.swap(batch_);
+            batch_.clear();
+            durableLsn = batchLastLsn_;
+        }
+
+        errno = 0;
+        if (std::fwrite(flushing_.data(), 1, flushing_.size(), file_) != flushing_.size() ||
+            !syncFile()) {
+            int error = errno != 0 ? errno : EIO;
+            Log::error("[WAL] Writing {} failed ({}); nothing after LSN {} is acknowledged",
+                       path_, std::strerror(error), lastDurableLsn);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                failed_ = true;
+                batch_.clear();
+            }
+            if (onFailure_) onFailure_(error);
+            return;
+        }
+
+        lastDurableLsn = durableLsn;
+        if (onDurable_) onDurable_(durableLsn);
+    }
+}
+
+void WriteAheadLog::writeHeader() {
+    std::vector<uint8_t> header(std::begin(MAGIC), std::end(MAGIC));
+    putU16(header, FORMAT_VERSION);
+    putU16(header, 0);
+    if (std::fwrite(header.data(), 1, header.size(), file_) != header.size() || !syncFile()) {
+        throw std::runtime_error("Cannot write the write-ahead log header: " + path_ + ": " +
+                                 std::strerror(errno));
+    }
+}
+
+bool WriteAheadLog::syncFile() {
+    if (std::fflush(file_) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file_)) == 0;
+#else
+    return ::fdatasync(fileno(file_)) == 0;
+#endif
+}
@@ -1,8 +1,12 @@
 #include <boost/asio.hpp>
 #include <iostream>
 #include "UdpServer.h"
+#include "Snapshot.h"
 #include "Facility.h"
+#include "FacilityCatalog.h"
+#include "Logger.h"
 #include "Util.h"
+#include <functional>
 #include <unordered_map>
 
 using namespace boost::asio;
@@ -18,36 +22,204 @@ void initFacilities(unordered_map<string, Facility>& facilities) {
         Facility& f = facilities.at(name);
 
         // Generate slots from 08:00 to 18:00 in 30-minute intervals for Monday to Friday
+        vector<Facility::TimeSlot> slots;
         for (int d = static_cast<int>(Util::Day::Monday); d <= static_cast<int>(Util::Day::Friday);
              ++d) {
             Util::Day day = static_cast<Util::Day>(d);
-            int start = 800;
-            while (start < 1800) {
-                int end = Util::toHHMM(Util::toMinutes(start) + 30);
-                f.addAvailability(Facility::TimeSlot(day, start, end));
-                start = end;
+            for (int slot = Facility::OPENING.slot(); slot < Facility::CLOSING.slot(); ++slot) {
+                slots.emplace_back(day, TimeOfDay::ofSlot(slot), TimeOfDay::ofSlot(slot + 1));
             }
         }
+        f.addAvailability(std::move(slots));  // generated in order, so no sort
     }
-    cout << "[INFO] Facilities initialized successfully with full weekday slots (08:00 to 18:00)."
-         << endl;
+    Log::info(
+        "[INFO] Facilities initialized successfully with full weekday slots (08:00 to 18:00).");
 }
 
-int main() {
+// Parses "host:port"
+udp::endpoint resolveEndpoint(boost::asio::io_context& io_context, const string& address) {
+    auto colon = address.rfind(':');
+    if (colon == string::npos) {
+        throw std::runtime_error("Expected host:port, got '" + address + "'");
+    }
+    udp::resolver resolver(io_context);
+    return *resolver.resolve(udp::v4(), address.substr(0, colon), address.substr(colon + 1))
+                .begin();
+}
+
+int main(int argc, char* argv[]) {
+    // Optional: --wal <path> keeps bookings across restarts,
+    // --snapshot <path> loads a checkpoint at startup and writes a fresh one on shutdown,
+    // --replica <host:port> (repeatable) streams mutations to a backup,
+    // --backup <port> runs as a backup fed by the primary on that port,
+    // --follower-port <port> lets read replicas register with this primary,
+    // --follow <host:port> --follow-stream <host:port> runs as a read replica of that primary,
+    // --catalog <path> loads the facilities from a catalog file (--catalog-threads <n> in parallel)
+    // and SIGHUP reloads it,
+    // --log-level debug|info|warn|error|off sets the least severe level that is logged,
+    // --stats-interval <seconds> logs the STATS report periodically,
+    // --net-in / --net-out <policy> inject faults on client requests / replies (--net-seed <n>),
+    // e.g. "drop=0.1,dup=0.02,delay=5,jitter=3,reorder=0.05,bw=125000",
+    // --capture <path> records client requests and replies for trace_replay
+    const auto TAKEOVER_AFTER = std::chrono::seconds(1);
+    string walPath;
+    string snapshotPath;
+    unsigned short port = 2222;
+    vector<string> replicas;
+    unsigned short replicationPort = 0;
+    unsigned short followerPort = 0;
+    string followAddress;
+    string followStreamAddress;
+    string catalogPath;
+    unsigned catalogThreads = 1;
+    LogLevel logLevel = LogLevel::Info;
+    int statsInterval = 0;
+    LinkPolicy netIn, netOut;
+    uint64_t netSeed = 1;
+    string capturePath;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--wal" && i + 1 < argc) {
+            walPath = argv[++i];
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = static_cast<unsigned short>(stoi(argv[++i]));
+        } else if (arg == "--replica" && i + 1 < argc) {
+            replicas.push_back(argv[++i]);
+        } else if (arg == "--backup" && i + 1 < argc) {
+            replicationPort = static_cast<unsigned short>(stoi(argv[++i]));
+        } else if (arg == "--follower-port" && i + 1 < argc) {
+            followerPort = static_cast<unsigned short>(stoi(argv[++i]));
+        } else if (arg == "--follow" && i + 1 < argc) {
+            followAddress = argv[++i];
+        } else if (arg == "--follow-stream" && i + 1 < argc) {
+            followStreamAddress = argv[++i];
+        } else if (arg == "--catalog" && i + 1 < argc) {
+            catalogPath = argv[++i];
+        } else if (arg == "--catalog-threads" && i + 1 < argc) {
+            catalogThreads = static_cast<unsigned>(stoul(argv[++i]));
+        } else if (arg == "--log-level" && i + 1 < argc &&
+                   Logger::parseLevel(argv[i + 1], logLevel)) {
+            ++i;
+        } else if (arg == "--stats-interval" && i + 1 < argc) {
+            statsInterval = stoi(argv[++i]);
+        } else if ((arg == "--net-in" || arg == "--net-out") && i + 1 < argc) {
+            try {
+                (arg == "--net-in" ? netIn : netOut) = LinkPolicy::parse(argv[++i]);
+            } catch (const std::exception& e) {
+                cerr << arg << ": " << e.what() << endl;
+                return 1;
+            }
+        } else if (arg == "--net-seed" && i + 1 < argc) {
+            netSeed = stoull(argv[++i]);
+        } else if (arg == "--capture" && i + 1 < argc) {
+            capturePath = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--port <n>] [--wal <path>] [--snapshot <path>]"
+                    " [--replica <host:port>]... [--backup <replication port>]"
+                    " [--follower-port <port>] [--follow <host:port> --follow-stream <host:port>]"
+                    " [--catalog <path> [--catalog-threads <n>]]"
+                    " [--log-level debug|info|warn|error|off] [--stats-interval <seconds>]"
+                    " [--net-in <policy>] [--net-out <policy>] [--net-seed <n>]"
+                    " [--capture <path>]"
+                 << endl;
+            return 1;
+        }
+    }
+    if (followAddress.empty() != followStreamAddress.empty()) {
+        cerr << "--follow and --follow-stream must be given together" << endl;
+        return 1;
+    }
+    Logger::instance().setLevel(logLevel);
+
     try {
         boost::asio::io_context io_context;
 
         unordered_map<string, Facility> facilities;
-        initFacilities(facilities);  // Initialize facilities with test data
+        FacilityCatalog::Definition catalogDefinition;
+        uint64_t snapshotLsn = 0;
+        bool restoredFromSnapshot =
+            !snapshotPath.empty() && Snapshot::load(snapshotPath, facilities, snapshotLsn);
+        if (restoredFromSnapshot) {
+            Log::info("[INFO] Loaded {} facilities from {}", facilities.size(), snapshotPath);
+            // The snapshot does not say which catalog hours its facilities were built from, so
+            // they start out as differing from any; the reload below then brings them in line with
+            // the catalog file, edits made while the server was down included
+            for (const auto& entry : facilities) catalogDefinition.emplace(entry.first, "");
+        } else if (!catalogPath.empty()) {
+            auto started = std::chrono::steady_clock::now();
+            facilities = FacilityCatalog::load(catalogPath, catalogThreads, &catalogDefinition);
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started);
+            Log::info("[INFO] Loaded {} facilities from {} in {} ms.", facilities.size(),
+                      catalogPath, elapsed.count());
+        } else {
+            initFacilities(facilities);  // Initialize facilities with test data
+        }
+
+        // Instantiate the UDP server with At-Most-Once semantics (false).
+        UDPServer server(io_context, port, facilities, false);
+        if (!walPath.empty()) {
+            server.enableWriteAheadLog(walPath, snapshotLsn);
+        }
+        if (replicationPort != 0) {
+            server.runAsBackup(replicationPort, TAKEOVER_AFTER);
+        }
+        vector<udp::endpoint> backups;
+        for (const auto& replica : replicas) {
+            backups.push_back(resolveEndpoint(io_context, replica));
+        }
+        server.replicateTo(std::move(backups), followerPort);
+        if (!followAddress.empty()) {
+            server.runAsFollower(resolveEndpoint(io_context, followAddress),
+                                 resolveEndpoint(io_context, followStreamAddress));
+        }
 
-        // Instantiate the UDP server on port 2222 with At-Most-Once semantics (false).
-        UDPServer server(io_context, 2222, facilities, false);
+        if (netIn.active() || netOut.active()) {
+            server.emulateNetwork(netIn, netOut, netSeed);
+        }
+        if (!capturePath.empty()) {
+            server.enableCapture(capturePath);
+        }
+        if (statsInterval > 0) {
+            server.enableStatsDump(std::chrono::seconds(statsInterval));
+        }
+        if (!catalogPath.empty()) {
+            server.enableCatalogReload(catalogPath, catalogThreads, std::move(catalogDefinition));
+            if (restoredFromSnapshot) server.reloadCatalog();
+        }
+
+#ifdef SIGHUP
+        // SIGHUP re-reads the catalog without a restart
+        boost::asio::signal_set reloadSignal(io_context, SIGHUP);
+        std::function<void()> waitForReload = [&]() {
+            reloadSignal.async_wait([&](const boost::system::error_code& ec, int) {
+                if (ec) return;
+                server.reloadCatalog();
+                waitForReload();
+            });
+        };
+        waitForReload();
+#endif
+
+        // Ctrl-C / SIGTERM end the event loop so the checkpoint below runs
+        boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&io_context](const boost::system::error_code&, int) {
+            io_context.stop();
+        });
 
-        cout << "[Server] Starting UDP Server on port 2222..." << endl;
+        Log::info("[Server] Starting UDP Server on port {}...", port);
         // Run the server. This call will block and continuously handle incoming UDP requests.
         server.start();
+
+        server.stop();
+        if (!snapshotPath.empty()) {
+            server.checkpoint(snapshotPath);
+        }
     } catch (std::exception& e) {
-        std::cerr << "Exception: " << e.what() << std::endl;
+        Log::error("Exception: {}", e.what());
     }
 
     return 0;
@@ -1,7 +1,16 @@
+#include "../client/Inc/BookingClient.h"
+#include "../server/Inc/FacilityCatalog.h"
+#include "../server/Inc/Logger.h"
 #include "../server/Inc/Message.h"
+#include "../server/Inc/NetworkEmulator.h"
+#include "../server/Inc/Simulation.h"
+#include "../server/Inc/Trace.h"
 #include "../server/Inc/UdpServer.h"
+#include <atomic>
 #include <boost/asio.hpp>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <regex>
 #include <thread>
@@ -16,12 +25,33 @@ void initFacility(unordered_map<string, Facility> &facilities);
 void queryTest(io_context &io_context, const udp::endpoint &server_endpoint);
 
 void monitorTest(io_context &io_context, const udp::endpoint &server_endpoint);
-void clientAMonitor(io_context &io_context,
-                    const udp::endpoint &server_endpoint);
+void clientAMonitor(const udp::endpoint &server_endpoint);
 void clientBMonitor(io_context &io_context,
                     const udp::endpoint &server_endpoint);
 void modifyTest(io_context &io_context, const udp::endpoint &server_endpoint);
 void extendTest(io_context &io_context, const udp::endpoint &server_endpoint);
+void deltaMonitorTest(io_context &io_context,
+                      const udp::endpoint &server_endpoint);
+void walRecoveryTest();
+void replicationTest();
+void followerTest();
+void catalogTest();
+void catalogReloadTest();
+void snapshotReadTest();
+void loggerTest();
+void networkEmulatorTest();
+void captureTest();
+void simulationTest();
+void compactProtocolTest();
+void binaryResultTest();
+void sessionTokenTest();
+void clientLibraryTest();
+void waitlistTest();
+void statsTest(io_context &io_context, const udp::endpoint &server_endpoint);
+void invalidDayTest(io_context &io_context, const udp::endpoint &server_endpoint);
+ResponseMessage sendRequest(udp::socket &socket, const RequestMessage &request,
+                            const udp::endpoint &server_endpoint);
+void printDelta(const string &label, const ResponseMessage &response);
 
 int main() {
   try {
@@ -59,15 +89,105 @@ int main() {
     // -----------------------------
     extendTest(io_context, server_endpoint);
 
+    // -----------------------------
+    // DELTA MONITOR TEST
+    // -----------------------------
+    deltaMonitorTest(io_context, server_endpoint);
+
     // -----------------------------
     // MONITORING TEST
     // -----------------------------
     monitorTest(io_context, server_endpoint);
 
+    // -----------------------------
+    // STATS TEST
+    // -----------------------------
+    statsTest(io_context, server_endpoint);
+
+    // -----------------------------
+    // INVALID DAY TEST
+    // -----------------------------
+    invalidDayTest(io_context, server_endpoint);
+
     // Shutdown server after test
     io_context.stop();
     serverThread.join();
 
+    // -----------------------------
+    // WAL RECOVERY TEST
+    // -----------------------------
+    walRecoveryTest();
+
+    // -----------------------------
+    // REPLICATION TEST
+    // -----------------------------
+    replicationTest();
+
+    // -----------------------------
+    // FOLLOWER TEST
+    // -----------------------------
+    followerTest();
+
+    // -----------------------------
+    // CATALOG TEST
+    // -----------------------------
+    catalogTest();
+
+    // -----------------------------
+    // CATALOG RELOAD TEST
+    // -----------------------------
+    catalogReloadTest();
+
+    // -----------------------------
+    // SNAPSHOT READ TEST
+    // -----------------------------
+    snapshotReadTest();
+
+    // -----------------------------
+    // LOGGER TEST
+    // -----------------------------
+    loggerTest();
+
+    // -----------------------------
+    // NETWORK EMULATOR TEST
+    // -----------------------------
+    networkEmulatorTest();
+
+    // -----------------------------
+    // CAPTURE TEST
+    // -----------------------------
+    captureTest();
+
+    // -----------------------------
+    // SIMULATION TEST
+    // -----------------------------
+    simulationTest();
+
+    // -----------------------------
+    // COMPACT PROTOCOL TEST
+    // -----------------------------
+    compactProtocolTest();
+
+    // -----------------------------
+    // BINARY RESULT TEST
+    // -----------------------------
+    binaryResultTest();
+
+    // -----------------------------
+    // SESSION TOKEN TEST
+    // -----------------------------
+    sessionTokenTest();
+
+    // -----------------------------
+    // CLIENT LIBRARY TEST
+    // -----------------------------
+    clientLibraryTest();
+
+    // -----------------------------
+    // WAITLIST TEST
+    // -----------------------------
+    waitlistTest();
+
     cout << "[TEST] All tests completed successfully.\n";
   } catch (const exception &e) {
     cerr << "[ERROR] Exception: " << e.what() << endl;
@@ -80,65 +200,65 @@ int main() {
 void initFacility(unordered_map<string, Facility> &facilities) {
   facilities.emplace("Gym", Facility("Gym"));
   facilities.at("Gym").addAvailability(
-      Facility::TimeSlot(Util::Day::Monday, 1000, 1030));
+      Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1000, 1030));
   facilities.at("Gym").addAvailability(
-      Facility::TimeSlot(Util::Day::Monday, 1030, 1100));
+      Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1030, 1100));
   facilities.at("Gym").addAvailability(
-      Facility::TimeSlot(Util::Day::Monday, 1100, 1130));
+      Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1100, 1130));
   facilities.at("Gym").addAvailability(
-      Facility::TimeSlot(Util::Day::Monday, 1130, 1200));
+      Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1130, 1200));
   facilities.at("Gym").addAvailability(
-      Facility::TimeSlot(Util::Day::Monday, 1230, 1300));
+      Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1230, 1300));
   facilities.at("Gym").addAvailability(
-      Facility::TimeSlot(Util::Day::Monday, 1330, 1400));
+      Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1330, 1400));
 
   facilities.emplace("Swimming Pool", Facility("Swimming Pool"));
   facilities.at("Swimming Pool")
-      .addAvailability(Facility::TimeSlot(Util::Day::Wednesday, 900, 1100));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Wednesday, 900, 1100));
   facilities.at("Swimming Pool")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 1400, 1600));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 1400, 1600));
 
   facilities.emplace("Tennis Court", Facility("Tennis Court"));
   facilities.at("Tennis Court")
-      .addAvailability(Facility::TimeSlot(Util::Day::Monday, 1500, 1700));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Monday, 1500, 1700));
   facilities.at("Tennis Court")
-      .addAvailability(Facility::TimeSlot(Util::Day::Saturday, 1000, 1200));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Saturday, 1000, 1200));
 
   facilities.emplace("Study Room", Facility("Study Room"));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 800, 830));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 800, 830));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 830, 900));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 830, 900));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 900, 930));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 900, 930));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 930, 1000));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 930, 1000));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 1000, 1030));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 1000, 1030));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 1030, 1100));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 1030, 1100));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 1100, 1130));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 1100, 1130));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Tuesday, 1130, 1200));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Tuesday, 1130, 1200));
   facilities.at("Study Room")
-      .addAvailability(Facility::TimeSlot(Util::Day::Thursday, 1300, 1500));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Thursday, 1300, 1500));
 
   facilities.emplace("Fitness Center", Facility("Fitness Center"));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 800, 830));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 800, 830));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 830, 900));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 830, 900));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 900, 930));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 900, 930));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 930, 1000));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 930, 1000));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 1000, 1030));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 1000, 1030));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 1030, 1100));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 1030, 1100));
   facilities.at("Fitness Center")
-      .addAvailability(Facility::TimeSlot(Util::Day::Friday, 1130, 1200));
+      .addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Friday, 1130, 1200));
   cout << "[INFO] Facilities initialized successfully.\n";
 }
 
@@ -283,13 +403,1207 @@ void extendTest(io_context &io_context, const udp::endpoint &server_endpoint) {
   cout << "[EXTEND TEST] Extend test completed.\n\n";
 }
 
+// -----------------------------
+// WAL RECOVERY TEST
+// -----------------------------
+void walRecoveryTest() {
+  cout << "\n[WAL TEST]\n";
+
+  const string walPath = "server_test.wal";
+  const string snapshotPath = "server_test.snap";
+  std::remove(walPath.c_str());
+  std::remove(snapshotPath.c_str());
+  uint32_t bookingId = 0;
+
+  // Run 1 books a slot and checkpoints; run 2 starts from the snapshot and
+  // cancels it
+  for (int run = 1; run <= 2; ++run) {
+    io_context server_context;
+    unordered_map<string, Facility> facilities;
+    uint64_t snapshotLsn = 0;
+    if (Snapshot::load(snapshotPath, facilities, snapshotLsn)) {
+      cout << "[WAL TEST] Loaded snapshot at LSN " << snapshotLsn << endl;
+    } else {
+      initFacility(facilities);
+    }
+
+    UDPServer server(server_context, 9001, facilities, false);
+    server.enableWriteAheadLog(walPath, snapshotLsn);
+    thread serverThread([&server_context]() { server_context.run(); });
+
+    udp::socket socket(server_context, udp::endpoint(udp::v4(), 0));
+    udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9001);
+    array<uint8_t, 1024> recv_buffer{};
+    udp::endpoint sender_endpoint;
+
+    RequestMessage request;
+    request.requestId = 5000 + run;
+    request.facilityName = "Tennis Court";
+    request.day = Util::Day::Monday;
+    request.startTime = 1500;
+    request.endTime = 1700;
+    if (run == 1) {
+      request.operation = Operation::BOOK;
+    } else {
+      request.operation = Operation::CANCEL;
+      request.bookingId = bookingId;
+    }
+
+    socket.send_to(buffer(request.marshal()), server_endpoint);
+    size_t len = socket.receive_from(buffer(recv_buffer), sender_endpoint);
+    vector<uint8_t> responseData(recv_buffer.begin(), recv_buffer.begin() + len);
+    ResponseMessage response = ResponseMessage::unmarshal(responseData);
+    cout << "[WAL TEST] Run " << run << " Response: " << response.message
+         << endl;
+
+    smatch match;
+    if (run == 1 && regex_search(response.message, match,
+                                 regex(R"(Booking ID:\s*(\d+))"))) {
+      bookingId = stoi(match[1]);
+    }
+
+    server_context.stop();
+    serverThread.join();
+    server.stop();
+    server.checkpoint(snapshotPath);
+  }
+
+  // A snapshot cut short inside its record arrays is refused, not read past
+  // its end
+  std::filesystem::resize_file(snapshotPath, 100);
+  try {
+    unordered_map<string, Facility> facilities;
+    uint64_t snapshotLsn = 0;
+    Snapshot::load(snapshotPath, facilities, snapshotLsn);
+    cout << "[WAL TEST] Truncated snapshot loaded\n";
+  } catch (const std::runtime_error &e) {
+    cout << "[WAL TEST] Truncated snapshot rejected: " << e.what() << endl;
+  }
+
+  std::remove(walPath.c_str());
+  std::remove(snapshotPath.c_str());
+  cout << "[WAL TEST] WAL recovery test completed.\n";
+}
+
+// -----------------------------
+// REPLICATION TEST
+// -----------------------------
+ResponseMessage sendRequest(udp::socket &socket, const RequestMessage &request,
+                            const udp::endpoint &server_endpoint) {
+  array<uint8_t, 1024> recv_buffer{};
+  udp::endpoint sender_endpoint;
+  socket.send_to(buffer(request.marshal()), server_endpoint);
+  size_t len = socket.receive_from(buffer(recv_buffer), sender_endpoint);
+  vector<uint8_t> responseData(recv_buffer.begin(), recv_buffer.begin() + len);
+  return ResponseMessage::unmarshal(responseData);
+}
+
+void replicationTest() {
+  cout << "\n[REPLICATION TEST]\n";
+
+  // Two servers with their own event loops, as two processes would have
+  io_context primary_context, backup_context;
+  unordered_map<string, Facility> primaryFacilities, backupFacilities;
+  initFacility(primaryFacilities);
+  initFacility(backupFacilities);
+
+  UDPServer backup(backup_context, 9003, backupFacilities, false);
+  backup.runAsBackup(9102, std::chrono::milliseconds(300));
+  UDPServer primary(primary_context, 9002, primaryFacilities, false);
+  primary.replicateTo({udp::endpoint(ip::make_address("127.0.0.1"), 9102)});
+
+  thread backupThread([&backup_context]() { backup_context.run(); });
+  thread primaryThread([&primary_context]() { primary_context.run(); });
+
+  udp::socket socket(backup_context, udp::endpoint(udp::v4(), 0));
+  udp::endpoint primary_endpoint(ip::make_address("127.0.0.1"), 9002);
+  udp::endpoint backup_endpoint(ip::make_address("127.0.0.1"), 9003);
+
+  RequestMessage request;
+  request.requestId = 6001;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Fitness Center";
+  request.day = Util::Day::Friday;
+  request.startTime = 800;
+  request.endTime = 830;
+
+  // The backup refuses clients while the primary is alive
+  cout << "[REPLICATION TEST] Backup before takeover: "
+       << sendRequest(socket, request, backup_endpoint).message << endl;
+
+  // The reply only arrives once the backup has applied the booking
+  request.requestId = 6002;
+  ResponseMessage booked = sendRequest(socket, request, primary_endpoint);
+  cout << "[REPLICATION TEST] Primary: " << booked.message << endl;
+
+  smatch match;
+  uint32_t bookingId = 0;
+  if (regex_search(booked.message, match, regex(R"(Booking ID:\s*(\d+))"))) {
+    bookingId = stoi(match[1]);
+  }
+
+  // Kill the primary; the backup takes over with the booking already there
+  primary_context.stop();
+  primaryThread.join();
+  primary.stop();
+  this_thread::sleep_for(std::chrono::milliseconds(600));
+
+  request.requestId = 6003;
+  request.operation = Operation::CANCEL;
+  request.bookingId = bookingId;
+  cout << "[REPLICATION TEST] Backup after takeover: "
+       << sendRequest(socket, request, backup_endpoint).message << endl;
+
+  backup_context.stop();
+  backupThread.join();
+  cout << "[REPLICATION TEST] Replication test completed.\n";
+}
+
+// -----------------------------
+// FOLLOWER TEST
+// -----------------------------
+void followerTest() {
+  cout << "\n[FOLLOWER TEST]\n";
+
+  io_context primary_context, follower_context;
+  unordered_map<string, Facility> primaryFacilities, followerFacilities;
+  initFacility(primaryFacilities);
+  initFacility(followerFacilities);
+
+  UDPServer primary(primary_context, 9006, primaryFacilities, false);
+  primary.replicateTo({}, 9106);
+  UDPServer follower(follower_context, 9007, followerFacilities, false);
+  udp::endpoint primary_endpoint(ip::make_address("127.0.0.1"), 9006);
+  follower.runAsFollower(primary_endpoint,
+                         udp::endpoint(ip::make_address("127.0.0.1"), 9106));
+
+  thread primaryThread([&primary_context]() { primary_context.run(); });
+  thread followerThread([&follower_context]() { follower_context.run(); });
+
+  udp::socket socket(follower_context, udp::endpoint(udp::v4(), 0));
+  udp::endpoint follower_endpoint(ip::make_address("127.0.0.1"), 9007);
+
+  // Mutations sent to the follower are relayed to the primary
+  RequestMessage request;
+  request.requestId = 7001;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Gym";
+  request.day = Util::Day::Monday;
+  request.startTime = 1000;
+  request.endTime = 1030;
+  cout << "[FOLLOWER TEST] Book via follower: "
+       << sendRequest(socket, request, follower_endpoint).message << endl;
+
+  // The booking comes back through the stream; reads are answered locally
+  this_thread::sleep_for(std::chrono::milliseconds(200));
+  request.requestId = 7002;
+  request.operation = Operation::QUERY;
+  cout << "[FOLLOWER TEST] Query on follower: "
+       << sendRequest(socket, request, follower_endpoint).message << endl;
+
+  primary_context.stop();
+  follower_context.stop();
+  primaryThread.join();
+  followerThread.join();
+  cout << "[FOLLOWER TEST] Follower test completed.\n";
+}
+
+// -----------------------------
+// CATALOG TEST
+// -----------------------------
+void catalogTest() {
+  cout << "\n[CATALOG TEST]\n";
+
+  const string catalogPath = "server_test.catalog";
+  {
+    ofstream catalog(catalogPath);
+    catalog << "# test catalog\n"
+            << "Court 1|Mon-Wed 0900-1100,Sat 1000-1200\n"
+            << "Court 2|Sun 1600-1800\n";
+    for (int i = 3; i <= 100; ++i) {
+      catalog << "Court " << i << "|Mon-Fri 0800-1800\n";
+    }
+  }
+
+  auto facilities = FacilityCatalog::load(catalogPath, 4);
+  cout << "[CATALOG TEST] Loaded " << facilities.size() << " facilities\n";
+  cout << "[CATALOG TEST] Court 1 Tuesday: "
+       << facilities.at("Court 1").getAvailability(Util::Day::Tuesday) << endl;
+  cout << "[CATALOG TEST] Court 2 Sunday mask: 0x" << hex
+       << facilities.at("Court 2").getAvailabilityMask(Util::Day::Sunday) << dec
+       << endl;
+
+  {
+    ofstream catalog(catalogPath);
+    catalog << "Court 1|Mon 0900-1100,Mon 1030-1200\n";
+  }
+  try {
+    FacilityCatalog::load(catalogPath);
+  } catch (const exception &e) {
+    cout << "[CATALOG TEST] Rejected: " << e.what() << endl;
+  }
+
+  // Queries and bookings only cover OPENING..CLOSING, so hours past it are refused
+  {
+    ofstream catalog(catalogPath);
+    catalog << "Court 2|Sun 2200-2400\n";
+  }
+  try {
+    FacilityCatalog::load(catalogPath);
+  } catch (const exception &e) {
+    cout << "[CATALOG TEST] Rejected: " << e.what() << endl;
+  }
+
+  std::remove(catalogPath.c_str());
+  cout << "[CATALOG TEST] Catalog test completed.\n";
+}
+
+// -----------------------------
+// CATALOG RELOAD TEST
+// -----------------------------
+void catalogReloadTest() {
+  cout << "\n[CATALOG RELOAD TEST]\n";
+
+  const string catalogPath = "server_test_reload.catalog";
+  const string walPath = "server_test_reload.wal";
+  const string originalCatalog = "Court A|Mon 0900-1100\n"
+                                 "Court B|Tue 0900-1000\n"
+                                 "Court C|Wed 0900-1000\n";
+  {
+    ofstream catalog(catalogPath);
+    catalog << originalCatalog;
+  }
+  std::remove(walPath.c_str());
+
+  io_context server_context;
+  FacilityCatalog::Definition definition;
+  UDPServer server(server_context, 9008,
+                   FacilityCatalog::load(catalogPath, 1, &definition), false);
+  server.enableWriteAheadLog(walPath);
+  server.enableCatalogReload(catalogPath, 1, definition);
+  thread serverThread([&server_context]() { server_context.run(); });
+
+  udp::socket socket(server_context, udp::endpoint(udp::v4(), 0));
+  udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9008);
+
+  RequestMessage request;
+  request.requestId = 8001;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Court A";
+  request.day = Util::Day::Monday;
+  request.startTime = 900;
+  request.endTime = 930;
+  cout << "[CATALOG RELOAD TEST] "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  request.requestId = 8002;
+  request.facilityName = "Court B";
+  request.day = Util::Day::Tuesday;
+  cout << "[CATALOG RELOAD TEST] "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  request.requestId = 8010;
+  request.facilityName = "Court A";
+  request.day = Util::Day::Monday;
+  request.startTime = 1000;
+  request.endTime = 1100;
+  cout << "[CATALOG RELOAD TEST] "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  // A closes earlier, B gets longer hours, C closes, D opens
+  {
+    ofstream catalog(catalogPath);
+    catalog << "Court A|Mon 0900-1000\n"
+            << "Court B|Tue 0900-1200\n"
+            << "Court D|Thu 0900-1000\n";
+  }
+  post(server_context, [&server]() { server.reloadCatalog(); });
+  this_thread::sleep_for(std::chrono::milliseconds(300));
+
+  request.requestId = 8003;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Court B";
+  request.day = Util::Day::Tuesday;
+  request.startTime = 1100;
+  request.endTime = 1200;
+  cout << "[CATALOG RELOAD TEST] New hours: "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  request.requestId = 8004;
+  request.startTime = 900;
+  request.endTime = 930;
+  cout << "[CATALOG RELOAD TEST] Carried-over booking still holds: "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  request.requestId = 8005;
+  request.facilityName = "Court C";
+  request.day = Util::Day::Wednesday;
+  cout << "[CATALOG RELOAD TEST] Closed: "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  request.requestId = 8006;
+  request.facilityName = "Court D";
+  request.day = Util::Day::Thursday;
+  cout << "[CATALOG RELOAD TEST] Opened: "
+       << sendRequest(socket, request, server_endpoint).message << endl;
+
+  server_context.stop();
+  serverThread.join();
+  server.stop();
+
+  // A restart from the old catalog file gets the reload, and the booking it dropped, from the WAL
+  {
+    ofstream catalog(catalogPath);
+    catalog << originalCatalog;
+  }
+  io_context replay_context;
+  UDPServer replayed(replay_context, 9008, FacilityCatalog::load(catalogPath, 1), false);
+  replayed.enableWriteAheadLog(walPath);
+  thread replayThread([&replay_context]() { replay_context.run(); });
+  udp::socket replaySocket(replay_context, udp::endpoint(udp::v4(), 0));
+
+  request.requestId = 8011;
+  request.operation = Operation::QUERY;
+  request.facilityName = "Court A";
+  request.day = Util::Day::Monday;
+  cout << "[CATALOG RELOAD TEST] Replayed hours: "
+       << sendRequest(replaySocket, request, server_endpoint).message << endl;
+
+  request.requestId = 8012;
+  request.facilityName = "Court C";
+  request.day = Util::Day::Wednesday;
+  cout << "[CATALOG RELOAD TEST] Replayed closing: "
+       << sendRequest(replaySocket, request, server_endpoint).message << endl;
+
+  request.requestId = 8013;
+  request.facilityName = "Court D";
+  request.day = Util::Day::Thursday;
+  cout << "[CATALOG RELOAD TEST] Replayed opening: "
+       << sendRequest(replaySocket, request, server_endpoint).message << endl;
+
+  replay_context.stop();
+  replayThread.join();
+  std::remove(catalogPath.c_str());
+  std::remove(walPath.c_str());
+  cout << "[CATALOG RELOAD TEST] Catalog reload test completed.\n";
+}
+
+// -----------------------------
+// SNAPSHOT READ TEST
+// -----------------------------
+void snapshotReadTest() {
+  cout << "\n[SNAPSHOT READ TEST]\n";
+
+  Facility court("Court");
+  for (uint16_t start = 800; start < 1800; start += 100) {
+    court.addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Monday, start, start + 30));
+    court.addAvailability(Facility::TimeSlot::fromHHMM(Util::Day::Monday, start + 30, start + 100));
+  }
+  const uint64_t booked = Facility::slotMask(TimeOfDay::fromHHMM(900), TimeOfDay::fromHHMM(1000));
+  const uint32_t baseVersion = court.getDayVersion(Util::Day::Monday);
+
+  // Every odd version has 0900-1000 booked, every even one has it free
+  atomic<bool> done{false};
+  size_t reads = 0, inconsistent = 0, wentBack = 0;
+  thread reader([&]() {
+    uint32_t lastVersion = 0;
+    while (!done.load()) {
+      auto state = court.snapshot(Util::Day::Monday);
+      bool isBooked = (state->availableMask & booked) == 0;
+      if (isBooked != (((state->version - baseVersion) & 1) == 1)) ++inconsistent;
+      if (state->version < lastVersion) ++wentBack;
+      lastVersion = state->version;
+      ++reads;
+    }
+  });
+
+  for (int i = 0; i < 20000; ++i) {
+    uint32_t bookingId;
+    court.bookSlot(Facility::TimeSlot::fromHHMM(Util::Day::Monday, 900, 1000), bookingId);
+    court.cancelBooking(bookingId);
+  }
+  done = true;
+  reader.join();
+
+  cout << "[SNAPSHOT READ TEST] Final version "
+       << court.getDayVersion(Util::Day::Monday) - baseVersion << ", reader saw "
+       << (reads > 0 ? "some" : "no") << " snapshots, " << inconsistent
+       << " inconsistent, " << wentBack << " going backwards\n";
+}
+
+// -----------------------------
+// STATS TEST
+// -----------------------------
+void statsTest(io_context &io_context, const udp::endpoint &server_endpoint) {
+  cout << "\n[STATS TEST]\n";
+  udp::socket socket(io_context, udp::endpoint(udp::v4(), 0));
+
+  RequestMessage request;
+  request.day = Util::Day::Monday;
+  request.startTime = 0;
+  request.endTime = 0;
+
+  // The operations the earlier tests left out, so that every row shows up:
+  // an unknown one, a HELLO and a WAITLIST for an empty range
+  const uint8_t others[] = {42, static_cast<uint8_t>(Operation::HELLO),
+                            static_cast<uint8_t>(Operation::WAITLIST),
+                            static_cast<uint8_t>(Operation::STATS)};
+  request.requestId = 8990;
+  request.facilityName = "Gym";
+  for (uint8_t operation : others) {
+    request.operation = static_cast<Operation>(operation);
+    ++request.requestId;
+    sendRequest(socket, request, server_endpoint);
+  }
+
+  request.requestId = 9001;
+  request.operation = Operation::STATS;
+  ResponseMessage response = sendRequest(socket, request, server_endpoint);
+  cout << "[STATS TEST] Status " << int(response.status) << ", "
+       << response.message.size() << " bytes:\n"
+       << response.message;
+  size_t rows = 0;
+  for (size_t op = 0; op < ServerStats::OPERATIONS; ++op) {
+    rows += response.message.find(string("\n") + ServerStats::operationName(op) +
+                                  " ") != string::npos;
+  }
+  size_t facilityLines = 0;
+  for (size_t at = response.message.find("\n  "); at != string::npos;
+       at = response.message.find("\n  ", at + 1)) {
+    ++facilityLines;
+  }
+  cout << "[STATS TEST] " << rows << " operation rows and " << facilityLines
+       << " facilities in " << (response.message.size() <= 1024 ? "at most" : "OVER")
+       << " 1024 bytes\n";
+
+  // The same request again is answered from the duplicate filter
+  response = sendRequest(socket, request, server_endpoint);
+  request.requestId = 9002;
+  response = sendRequest(socket, request, server_endpoint);
+  smatch match;
+  regex_search(response.message, match, regex(R"(duplicates \d+ \(\d+ from cache\))"));
+  cout << "[STATS TEST] After a duplicate: " << match.str() << endl;
+
+  cout << "[STATS TEST] 1000 ns is counted up to "
+       << LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketOf(1000))
+       << " ns, 1000000 ns up to "
+       << LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketOf(1000000))
+       << " ns\n";
+}
+
+// -----------------------------
+// INVALID DAY TEST
+// -----------------------------
+void invalidDayTest(io_context &io_context, const udp::endpoint &server_endpoint) {
+  cout << "\n[INVALID DAY TEST]\n";
+  udp::socket socket(io_context, udp::endpoint(udp::v4(), 0));
+
+  // The day is one byte on the wire; anything past Sunday gets an error reply
+  RequestMessage request;
+  request.requestId = 9100;
+  request.facilityName = "Gym";
+  request.day = static_cast<Util::Day>(200);
+  request.startTime = 0;
+  request.endTime = 0;
+  request.operation = Operation::QUERY;
+  ResponseMessage response = sendRequest(socket, request, server_endpoint);
+  cout << "[INVALID DAY TEST] QUERY for day 200: status "
+       << int(response.status) << ", " << response.message << endl;
+
+  request.requestId = 9101;
+  request.operation = Operation::RESYNC;
+  response = sendRequest(socket, request, server_endpoint);
+  cout << "[INVALID DAY TEST] RESYNC for day 200: status "
+       << int(response.status) << ", " << response.message << endl;
+
+  request.requestId = 9102;
+  request.operation = Operation::WAITLIST;
+  request.startTime = 900;
+  request.endTime = 1000;
+  request.monitorInterval = 60;
+  response = sendRequest(socket, request, server_endpoint);
+  cout << "[INVALID DAY TEST] WAITLIST for day 200: status "
+       << int(response.status) << ", " << response.message << endl;
+
+  // ... and the server goes on answering
+  request.requestId = 9199;
+  request.day = Util::Day::Monday;
+  request.operation = Operation::QUERY;
+  response = sendRequest(socket, request, server_endpoint);
+  cout << "[INVALID DAY TEST] Server still answers: status "
+       << int(response.status) << endl;
+}
+
+// -----------------------------
+// LOGGER TEST
+// -----------------------------
+void loggerTest() {
+  Logger::instance().flush(); // let the server output so far come out first
+  cout << "\n[LOGGER TEST]\n";
+
+  vector<thread> threads;
+  for (int t = 0; t < 3; ++t) {
+    threads.emplace_back([t]() {
+      for (int i = 0; i < 2; ++i) {
+        Log::info("[LOGGER TEST] thread {} record {}: {} {} {}", t, i, "text",
+                  0.5, i == 0);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  Log::debug("[LOGGER TEST] below the level, never written");
+  Log::warn("[LOGGER TEST] missing argument: {}");
+  // Arguments that do not fit are cut short; the ones after them keep their places
+  Log::info("[LOGGER TEST] long: {} then {}", string(300, 'x'), 42);
+  Log::info("[LOGGER TEST] full: {} {} {} {}", string(200, 'y'), 1.5, string(40, 'z'), 7);
+
+  Logger::instance().flush();
+  cout << "[LOGGER TEST] Flushed.\n";
+}
+
+// -----------------------------
+// NETWORK EMULATOR TEST
+// -----------------------------
+void networkEmulatorTest() {
+  cout << "\n[NETWORK EMULATOR TEST]\n";
+  LinkPolicy policy = LinkPolicy::parse("drop=0.2,dup=0.1,delay=1,jitter=2,reorder=0.05");
+  cout << "[NETWORK EMULATOR TEST] Parsed delay " << policy.delay.count() << " us, jitter "
+       << policy.jitter.count() << " us\n";
+  try {
+    LinkPolicy::parse("drop=2");
+  } catch (const invalid_argument &e) {
+    cout << "[NETWORK EMULATOR TEST] Rejected: " << e.what() << endl;
+  }
+
+  // Same seed, same faults: count what two emulators let through
+  auto deliveries = [&](uint64_t seed) {
+    io_context context;
+    NetworkEmulator network(context, seed);
+    network.setPolicy(NetworkEmulator::Direction::Inbound, policy);
+    int delivered = 0, dropped = 0;
+    for (int i = 0; i < 1000; ++i) {
+      if (!network.transmit(NetworkEmulator::Direction::Inbound, 100,
+                            [&]() { ++delivered; })) {
+        ++dropped;
+      }
+    }
+    context.run(); // the delayed deliveries
+    return make_pair(delivered, dropped);
+  };
+  auto first = deliveries(42), second = deliveries(42), other = deliveries(43);
+  cout << "[NETWORK EMULATOR TEST] Seed 42 twice: "
+       << (first == second ? "identical" : "different") << ", seed 43: "
+       << (first == other ? "identical" : "different") << endl;
+  cout << "[NETWORK EMULATOR TEST] Drops within 15-25%: "
+       << (first.second >= 150 && first.second <= 250 ? "yes" : "no")
+       << ", every survivor delivered at least once: "
+       << (first.first >= 1000 - first.second ? "yes" : "no") << endl;
+}
+
+// -----------------------------
+// CAPTURE TEST
+// -----------------------------
+void captureTest() {
+  cout << "\n[CAPTURE TEST]\n";
+  const string tracePath = "server_test.trace";
+  {
+    io_context server_context;
+    unordered_map<string, Facility> facilities;
+    initFacility(facilities);
+    UDPServer server(server_context, 9009, facilities, false);
+    server.enableCapture(tracePath);
+    thread serverThread([&server_context]() { server_context.run(); });
+
+    udp::socket socket(server_context, udp::endpoint(udp::v4(), 0));
+    udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9009);
+    RequestMessage request;
+    request.requestId = 9100;
+    request.operation = Operation::BOOK;
+    request.facilityName = "Study Room";
+    request.day = Util::Day::Tuesday;
+    request.startTime = 800;
+    request.endTime = 830;
+    sendRequest(socket, request, server_endpoint);
+    sendRequest(socket, request, server_endpoint); // a retry
+
+    server_context.stop();
+    serverThread.join();
+  } // the server closes the trace
+
+  TraceReader reader(tracePath);
+  TraceRecord record;
+  while (reader.next(record)) {
+    cout << "[CAPTURE TEST] "
+         << (record.kind == TraceRecord::Kind::Request ? "Request " : "Reply   ")
+         << record.datagram.size() << " bytes, client on "
+         << record.client.address().to_string();
+    if (record.kind == TraceRecord::Kind::Reply) {
+      cout << ": " << ResponseMessage::unmarshal(record.datagram).message;
+    }
+    cout << endl;
+  }
+  std::remove(tracePath.c_str());
+}
+
+void simulationTest() {
+  cout << "\n[SIMULATION TEST]\n";
+  SimulationConfig config;
+  config.clients = 16;
+  config.requests = 20000;
+  config.toServer = LinkPolicy::parse("drop=0.1,dup=0.05,delay=2,jitter=1");
+  config.toClients = config.toServer;
+  Logger::instance().setLevel(LogLevel::Warn); // one line per replayed duplicate otherwise
+
+  SimulationReport first = Simulation::run(config), second = Simulation::run(config);
+  cout << "[SIMULATION TEST] " << first.requests << " requests, " << first.transmissions
+       << " transmissions, " << first.dropped << " dropped, " << first.duplicated
+       << " duplicated\n";
+  cout << "[SIMULATION TEST] Same seed twice: "
+       << (first.transmissions == second.transmissions && first.dropped == second.dropped
+               ? "identical"
+               : "different")
+       << endl;
+  cout << "[SIMULATION TEST] At-most-once: "
+       << (first.consistent() ? "consistent" : "INCONSISTENT") << endl;
+
+  // Without the reply cache, retransmits re-execute and the checks should notice
+  config.atLeastOnce = true;
+  SimulationReport unsafe = Simulation::run(config);
+  cout << "[SIMULATION TEST] At-least-once: "
+       << (unsafe.consistent() ? "consistent" : "inconsistent, as expected") << endl;
+  Logger::instance().setLevel(LogLevel::Info);
+}
+
+void compactProtocolTest() {
+  cout << "\n[COMPACT PROTOCOL TEST]\n";
+  io_context server_context;
+  unordered_map<string, Facility> facilities;
+  initFacility(facilities);
+  UDPServer server(server_context, 9010, facilities, false);
+  thread serverThread([&server_context]() { server_context.run(); });
+
+  udp::socket socket(server_context, udp::endpoint(udp::v4(), 0));
+  udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9010);
+  auto exchange = [&](udp::socket &from, const vector<uint8_t> &datagram) {
+    array<uint8_t, 1024> recv_buffer{};
+    udp::endpoint sender_endpoint;
+    from.send_to(buffer(datagram), server_endpoint);
+    size_t len = from.receive_from(buffer(recv_buffer), sender_endpoint);
+    return ResponseMessage::unmarshal(recv_buffer.data(), len);
+  };
+
+  RequestMessage hello;
+  hello.requestId = 9200;
+  hello.operation = Operation::HELLO;
+  hello.day = Util::Day::Monday;
+  hello.startTime = 0;
+  hello.endTime = 0;
+  hello.protocolVersion = PROTOCOL_COMPACT; // compact requests, replies as text
+  HelloReply reply = HelloReply::unmarshal(sendRequest(socket, hello, server_endpoint).message);
+  cout << "[COMPACT PROTOCOL TEST] Version " << int(reply.version) << ", "
+       << reply.facilities.size() << " facilities, Study Room is ID "
+       << reply.facilityId("Study Room") << endl;
+
+  RequestMessage book;
+  book.requestId = 9201;
+  book.operation = Operation::BOOK;
+  book.facilityName = "Study Room";
+  book.day = Util::Day::Tuesday;
+  book.startTime = 830;
+  book.endTime = 900;
+  vector<uint8_t> compact = CompactRequest::fromRequest(book, hello.requestId,
+                                                        reply.facilityId("Study Room"))
+                                .marshal();
+  cout << "[COMPACT PROTOCOL TEST] BOOK is " << compact.size() << " bytes, "
+       << book.marshal().size() << " in version 1" << endl;
+  ResponseMessage first = exchange(socket, compact);
+  ResponseMessage retry = exchange(socket, compact);
+  cout << "[COMPACT PROTOCOL TEST] Request " << first.requestId << ": " << first.message
+       << endl;
+  cout << "[COMPACT PROTOCOL TEST] Retry gets the same reply: "
+       << (retry.message == first.message ? "yes" : "no") << endl;
+
+  // A client that never said HELLO is told to
+  udp::socket stranger(server_context, udp::endpoint(udp::v4(), 0));
+  ResponseMessage refused = exchange(stranger, compact);
+  cout << "[COMPACT PROTOCOL TEST] Without a session: status " << int(refused.status) << ", "
+       << refused.message << endl;
+
+  // A version 1 client stays on version 1
+  hello.requestId = 1;
+  hello.protocolVersion = PROTOCOL_LEGACY;
+  reply = HelloReply::unmarshal(sendRequest(stranger, hello, server_endpoint).message);
+  cout << "[COMPACT PROTOCOL TEST] Legacy HELLO: version " << int(reply.version) << ", "
+       << reply.facilities.size() << " facilities" << endl;
+
+  // A reply claiming more facilities than its bytes can hold is refused up
+  // front
+  const string forged = {char(PROTOCOL_COMPACT), char(0xff), char(0xff), 'x'};
+  try {
+    HelloReply::unmarshal(forged);
+    cout << "[COMPACT PROTOCOL TEST] Forged facility count accepted\n";
+  } catch (const std::runtime_error &e) {
+    cout << "[COMPACT PROTOCOL TEST] Forged facility count: " << e.what()
+         << endl;
+  }
+
+  server_context.stop();
+  serverThread.join();
+}
+
+void binaryResultTest() {
+  cout << "\n[BINARY RESULT TEST]\n";
+  io_context server_context;
+  unordered_map<string, Facility> facilities;
+  initFacility(facilities);
+  UDPServer server(server_context, 9011, facilities, false);
+  thread serverThread([&server_context]() { server_context.run(); });
+
+  udp::socket socket(server_context, udp::endpoint(udp::v4(), 0));
+  udp::socket textSocket(server_context, udp::endpoint(udp::v4(), 0));
+  udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9011);
+
+  RequestMessage request;
+  request.requestId = 9300;
+  request.operation = Operation::HELLO;
+  request.day = Util::Day::Monday;
+  request.startTime = 0;
+  request.endTime = 0;
+  request.protocolVersion = 7; // newer than the server: it answers with its own
+  HelloReply hello = HelloReply::unmarshal(sendRequest(socket, request, server_endpoint).message);
+  cout << "[BINARY RESULT TEST] Version " << int(hello.version) << endl;
+
+  auto show = [](const string &label, const ResponseMessage &response) {
+    OpResult result = OpResult::unmarshal(response.message);
+    cout << "[BINARY RESULT TEST] " << label << ": status " << int(response.status) << ", "
+         << response.message.size() << " bytes, code " << int(result.code) << ", "
+         << result.toText("Study Room") << endl;
+    return result;
+  };
+
+  request = RequestMessage();
+  request.requestId = 9301;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Study Room";
+  request.day = Util::Day::Tuesday;
+  request.startTime = 900;
+  request.endTime = 930;
+  OpResult booked = show("BOOK", sendRequest(socket, request, server_endpoint));
+  request.requestId = 9302;
+  show("BOOK again", sendRequest(socket, request, server_endpoint));
+
+  // The same outcome as a version 1 client sees it
+  request.requestId = 9303;
+  ResponseMessage text = sendRequest(textSocket, request, server_endpoint);
+  cout << "[BINARY RESULT TEST] Version 1 client: status " << int(text.status) << ", "
+       << text.message << endl;
+
+  request.requestId = 9304;
+  request.operation = Operation::EXTEND;
+  request.bookingId = booked.bookingId;
+  request.offsetMinutes = 30;
+  show("EXTEND", sendRequest(socket, request, server_endpoint));
+  request.requestId = 9305;
+  request.operation = Operation::CHANGE;
+  request.bookingId = 1;
+  show("CHANGE unknown booking", sendRequest(socket, request, server_endpoint));
+  request.requestId = 9306;
+  request.operation = Operation::CANCEL;
+  request.bookingId = booked.bookingId;
+  show("CANCEL", sendRequest(socket, request, server_endpoint));
+
+  request.requestId = 9307;
+  request.operation = Operation::QUERY;
+  ResponseMessage query = sendRequest(socket, request, server_endpoint);
+  DeltaMessage day = DeltaMessage::unmarshal(query.message);
+  cout << "[BINARY RESULT TEST] QUERY: status " << int(query.status) << ", "
+       << int(day.slotCount) << " slots of " << day.facilityName << endl;
+
+  server_context.stop();
+  serverThread.join();
+}
+
+void sessionTokenTest() {
+  cout << "\n[SESSION TOKEN TEST]\n";
+  io_context server_context;
+  unordered_map<string, Facility> facilities;
+  initFacility(facilities);
+  UDPServer server(server_context, 9012, facilities, false);
+  thread serverThread([&server_context]() { server_context.run(); });
+
+  udp::socket socket(server_context, udp::endpoint(udp::v4(), 0));
+  udp::socket moved(server_context, udp::endpoint(udp::v4(), 0)); // same client, new port
+  udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9012);
+  auto receive = [](udp::socket &on) {
+    array<uint8_t, 1024> recv_buffer{};
+    udp::endpoint sender_endpoint;
+    size_t len = on.receive_from(buffer(recv_buffer), sender_endpoint);
+    return ResponseMessage::unmarshal(recv_buffer.data(), len);
+  };
+
+  RequestMessage request;
+  request.requestId = 9400;
+  request.operation = Operation::HELLO;
+  request.day = Util::Day::Monday;
+  request.startTime = 0;
+  request.endTime = 0;
+  request.protocolVersion = PROTOCOL_SESSION_TOKENS;
+  HelloReply hello = HelloReply::unmarshal(sendRequest(socket, request, server_endpoint).message);
+  uint32_t helloId = request.requestId;
+  uint64_t token = hello.sessionToken.value_or(0);
+  cout << "[SESSION TOKEN TEST] Version " << int(hello.version) << ", token issued: "
+       << (token != 0 ? "yes" : "no") << endl;
+  auto compact = [&](const RequestMessage &request) {
+    return CompactRequest::fromRequest(request, helloId, hello.facilityId(request.facilityName),
+                                       token)
+        .marshal();
+  };
+
+  // Watch Thursday from the first port
+  request = RequestMessage();
+  request.requestId = 9401;
+  request.operation = Operation::MONITOR;
+  request.facilityName = "Study Room";
+  request.day = Util::Day::Thursday;
+  request.startTime = 800;
+  request.endTime = 1800;
+  request.monitorInterval = 60;
+  request.monitorFlags = MONITOR_FLAG_DELTA;
+  socket.send_to(buffer(compact(request)), server_endpoint);
+  cout << "[SESSION TOKEN TEST] MONITOR: status " << int(receive(socket).status) << endl;
+
+  // Book from the second: the reply and the subscription's update both come there
+  request = RequestMessage();
+  request.requestId = 9402;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Study Room";
+  request.day = Util::Day::Thursday;
+  request.startTime = 1300;
+  request.endTime = 1500;
+  vector<uint8_t> book = compact(request);
+  cout << "[SESSION TOKEN TEST] BOOK is " << book.size() << " bytes" << endl;
+  moved.send_to(buffer(book), server_endpoint);
+  string booked;
+  for (int i = 0; i < 2; ++i) {
+    ResponseMessage response = receive(moved);
+    if (response.requestId == 0) {
+      printDelta("[SESSION TOKEN TEST] Update at the new port:", response);
+    } else {
+      booked = response.message;
+      cout << "[SESSION TOKEN TEST] BOOK at the new port: "
+           << OpResult::unmarshal(booked).toText(request.facilityName) << endl;
+    }
+  }
+
+  // A retry from the first port is still the same request
+  socket.send_to(buffer(book), server_endpoint);
+  cout << "[SESSION TOKEN TEST] Retry from the old port gets the same reply: "
+       << (receive(socket).message == booked ? "yes" : "no") << endl;
+
+  // A token the server never issued is refused
+  RequestMessage forged = request;
+  forged.requestId = 9403;
+  vector<uint8_t> unknown =
+      CompactRequest::fromRequest(forged, helloId, 1, token ^ 1).marshal();
+  moved.send_to(buffer(unknown), server_endpoint);
+  ResponseMessage refused = receive(moved);
+  cout << "[SESSION TOKEN TEST] Unknown token: status " << int(refused.status) << ", "
+       << refused.message << endl;
+
+  server_context.stop();
+  serverThread.join();
+}
+
+void clientLibraryTest() {
+  cout << "\n[CLIENT LIBRARY TEST]\n";
+  Logger::instance().setLevel(LogLevel::Warn); // every simulated loss is logged
+  io_context server_context;
+  unordered_map<string, Facility> facilities;
+  initFacility(facilities);
+  UDPServer server(server_context, 9013, facilities, false);
+  server.emulateNetwork(LinkPolicy::parse("drop=0.2"), LinkPolicy::parse("drop=0.2"), 7);
+  thread serverThread([&server_context]() { server_context.run(); });
+
+  // One socket, everything in flight at once, lossy both ways
+  io_context client_context;
+  BookingClient::Options options;
+  options.maxAttempts = 12;
+  options.seed = 1;
+  BookingClient client(client_context,
+                       udp::endpoint(ip::make_address("127.0.0.1"), 9013), options);
+  const int queries = 50;
+  int answered = 0, failed = 0, updates = 0;
+  bool watching = false;
+  string booked;
+  auto finishIfDone = [&]() {
+    bool expectUpdate = watching && booked.find("confirmed") != string::npos;
+    if (answered + failed == queries + 2 && (updates > 0 || !expectUpdate)) client.close();
+  };
+  auto count = [&](const boost::system::error_code &error) {
+    error ? ++failed : ++answered;
+  };
+  client.onNotification([&](const ResponseMessage &) {
+    ++updates;
+    finishIfDone();
+  });
+
+  RequestMessage monitor;
+  monitor.operation = Operation::MONITOR;
+  monitor.facilityName = "Study Room";
+  monitor.day = Util::Day::Tuesday;
+  monitor.startTime = 800;
+  monitor.endTime = 1200;
+  monitor.monitorInterval = 60;
+  client.request(monitor, [&](const boost::system::error_code &error,
+                              const ResponseMessage &) {
+    count(error);
+    watching = !error;
+    RequestMessage query;
+    query.operation = Operation::QUERY;
+    query.facilityName = "Gym";
+    query.day = Util::Day::Monday;
+    query.startTime = 0;
+    query.endTime = 0;
+    for (int i = 0; i < queries; ++i) {
+      client.request(query, [&](const boost::system::error_code &error,
+                                const ResponseMessage &) {
+        count(error);
+        finishIfDone();
+      });
+    }
+    RequestMessage book;
+    book.operation = Operation::BOOK;
+    book.facilityName = "Study Room";
+    book.day = Util::Day::Tuesday;
+    book.startTime = 800;
+    book.endTime = 830;
+    client.request(book, [&](const boost::system::error_code &error,
+                             const ResponseMessage &reply) {
+      count(error);
+      booked = reply.message;
+      finishIfDone();
+    });
+  });
+  client_context.run();
+
+  const BookingClient::Counters &counters = client.counters();
+  cout << "[CLIENT LIBRARY TEST] " << queries + 2 << " requests: " << answered
+       << " answered, " << failed << " failed" << endl;
+  cout << "[CLIENT LIBRARY TEST] Retransmitted some: "
+       << (counters.retransmitted > 0 ? "yes" : "no") << endl;
+  cout << "[CLIENT LIBRARY TEST] BOOK: " << booked << endl;
+  cout << "[CLIENT LIBRARY TEST] Update delivered to the callback: "
+       << (updates > 0 ? "yes" : "no") << endl;
+  cout << "[CLIENT LIBRARY TEST] Timeout adapted below the initial "
+       << options.initialTimeout.count() << " ms: "
+       << (client.timeout() < options.initialTimeout ? "yes" : "no") << endl;
+
+  server_context.stop();
+  serverThread.join();
+  Logger::instance().setLevel(LogLevel::Info);
+}
+
+void waitlistTest() {
+  cout << "\n[WAITLIST TEST]\n";
+  io_context server_context;
+  unordered_map<string, Facility> facilities;
+  initFacility(facilities);
+  UDPServer server(server_context, 9014, facilities, false);
+  thread serverThread([&server_context]() { server_context.run(); });
+
+  udp::socket holder(server_context, udp::endpoint(udp::v4(), 0));
+  udp::socket early(server_context, udp::endpoint(udp::v4(), 0));
+  udp::socket urgent(server_context, udp::endpoint(udp::v4(), 0));
+  udp::endpoint server_endpoint(ip::make_address("127.0.0.1"), 9014);
+  auto receive = [](udp::socket &on) {
+    array<uint8_t, 1024> recv_buffer{};
+    udp::endpoint sender_endpoint;
+    size_t len = on.receive_from(buffer(recv_buffer), sender_endpoint);
+    return ResponseMessage::unmarshal(recv_buffer.data(), len);
+  };
+  auto bookingIdIn = [](const string &message) {
+    return static_cast<uint32_t>(stoul(message.substr(message.find("Booking ID: ") + 12)));
+  };
+
+  // Thursday 13:00 to 15:00 is taken; two clients wait for it, the later one with priority
+  RequestMessage request;
+  request.requestId = 1;
+  request.operation = Operation::BOOK;
+  request.facilityName = "Study Room";
+  request.day = Util::Day::Thursday;
+  request.startTime = 1300;
+  request.endTime = 1500;
+  string held = sendRequest(holder, request, server_endpoint).message;
+  cout << "[WAITLIST TEST] BOOK: " << held << endl;
+
+  request.requestId = 10;
+  request.operation = Operation::WAITLIST;
+  request.monitorInterval = 60;
+  cout << "[WAITLIST TEST] WAITLIST: "
+       << sendRequest(early, request, server_endpoint).message << endl;
+  request.requestId = 11;
+  request.monitorFlags = 1;
+  cout << "[WAITLIST TEST] WAITLIST with priority 1: "
+       << sendRequest(urgent, request, server_endpoint).message << endl;
+
+  RequestMessage incomplete = request;
+  incomplete.requestId = 2;
+  incomplete.monitorInterval.reset();
+  incomplete.monitorFlags.reset();
+  cout << "[WAITLIST TEST] Without a waiting time: "
+       << sendRequest(urgent, incomplete, server_endpoint).message << endl;
+
+  // Thursday's hours end at 15:00, so nobody can wait for 15:00 to 16:00
+  RequestMessage closed = request;
+  closed.requestId = 12;
+  closed.startTime = 1500;
+  closed.endTime = 1600;
+  cout << "[WAITLIST TEST] Outside the opening hours: "
+       << sendRequest(early, closed, server_endpoint).message << endl;
+
+  // A range that is free is booked on the spot
+  RequestMessage free = request;
+  free.requestId = 3;
+  free.day = Util::Day::Tuesday;
+  free.startTime = 800;
+  free.endTime = 830;
+  cout << "[WAITLIST TEST] Free range: " << sendRequest(early, free, server_endpoint).message
+       << endl;
+
+  // Joining again with a higher priority moves the first waiter ahead
+  RequestMessage rejoin = request;
+  rejoin.requestId = 13;
+  rejoin.monitorFlags = 2;
+  cout << "[WAITLIST TEST] WAITLIST again with priority 2: "
+       << sendRequest(early, rejoin, server_endpoint).message << endl;
+
+  // Each cancellation hands the time to the next in line, pushed under the ID
+  // of their WAITLIST request
+  RequestMessage cancel;
+  cancel.requestId = 4;
+  cancel.operation = Operation::CANCEL;
+  cancel.facilityName = "Study Room";
+  cancel.day = Util::Day::Thursday;
+  cancel.startTime = 0;
+  cancel.endTime = 0;
+  cancel.bookingId = bookingIdIn(held);
+  cout << "[WAITLIST TEST] CANCEL: " << sendRequest(holder, cancel, server_endpoint).message
+       << endl;
+  ResponseMessage pushed = receive(early);
+  cout << "[WAITLIST TEST] Priority 2 waiter, request ID " << pushed.requestId << ": "
+       << pushed.message << endl;
+
+  cancel.requestId = 5;
+  cancel.bookingId = bookingIdIn(pushed.message);
+  cout << "[WAITLIST TEST] CANCEL: " << sendRequest(early, cancel, server_endpoint).message
+       << endl;
+  pushed = receive(urgent);
+  cout << "[WAITLIST TEST] Priority 1 waiter, request ID " << pushed.requestId << ": "
+       << pushed.message << endl;
+
+  server_context.stop();
+  serverThread.join();
+}
+
+// -----------------------------
+// DELTA MONITOR TEST
+// -----------------------------
+void printDelta(const string &label, const ResponseMessage &response) {
+  if (response.status != STATUS_DELTA) {
+    cerr << label << " Unexpected response: " << response.message << endl;
+    return;
+  }
+  DeltaMessage delta = DeltaMessage::unmarshal(response.message);
+  cout << label << " " << delta.facilityName << " "
+       << Util::dayToString(delta.day) << " version " << delta.version
+       << " slots " << int(delta.firstSlot) << "+" << int(delta.slotCount)
+       << " bits 0x" << hex << delta.bits << dec << endl;
+}
+
+void deltaMonitorTest(io_context &io_context,
+                      const udp::endpoint &server_endpoint) {
+  cout << "\n[DELTA TEST]\n";
+
+  udp::socket watcher(io_context, udp::endpoint(udp::v4(), 0));
+  udp::socket booker(io_context, udp::endpoint(udp::v4(), 0));
+  array<uint8_t, 1024> recv_buffer{};
+  udp::endpoint sender_endpoint;
+  vector<uint8_t> responseData;
+
+  auto receive = [&](udp::socket &socket) {
+    size_t len = socket.receive_from(buffer(recv_buffer), sender_endpoint);
+    responseData.assign(recv_buffer.begin(), recv_buffer.begin() + len);
+    return ResponseMessage::unmarshal(responseData);
+  };
+
+  // Step 1: watch Swimming Pool on Wednesday with binary deltas
+  RequestMessage monitorRequest;
+  monitorRequest.requestId = 4001;
+  monitorRequest.operation = Operation::MONITOR;
+  monitorRequest.facilityName = "Swimming Pool";
+  monitorRequest.day = Util::Day::Wednesday;
+  monitorRequest.startTime = 900;
+  monitorRequest.endTime = 1100;
+  monitorRequest.monitorInterval = 5;
+  monitorRequest.monitorFlags = MONITOR_FLAG_DELTA;
+
+  watcher.send_to(buffer(monitorRequest.marshal()), server_endpoint);
+  cout << "[DELTA TEST] Monitor Response: " << receive(watcher).message;
+
+  // Step 2: book 09:00-11:00 and cancel it; each change is one delta
+  RequestMessage bookRequest;
+  bookRequest.requestId = 4002;
+  bookRequest.operation = Operation::BOOK;
+  bookRequest.facilityName = "Swimming Pool";
+  bookRequest.day = Util::Day::Wednesday;
+  bookRequest.startTime = 900;
+  bookRequest.endTime = 1100;
+
+  booker.send_to(buffer(bookRequest.marshal()), server_endpoint);
+  ResponseMessage bookResponse = receive(booker);
+  cout << "[DELTA TEST] Book Response: " << bookResponse.message << endl;
+  printDelta("[DELTA TEST] Delta received:", receive(watcher));
+
+  smatch match;
+  string bookMessage = bookResponse.message;
+  if (!regex_search(bookMessage, match, regex(R"(Booking ID:\s*(\d+))"))) {
+    cerr << "[DELTA TEST] Failed to extract booking ID.\n";
+    return;
+  }
+
+  RequestMessage cancelRequest;
+  cancelRequest.requestId = 4003;
+  cancelRequest.operation = Operation::CANCEL;
+  cancelRequest.facilityName = "Swimming Pool";
+  cancelRequest.bookingId = stoi(match[1]);
+
+  booker.send_to(buffer(cancelRequest.marshal()), server_endpoint);
+  cout << "[DELTA TEST] Cancel Response: " << receive(booker).message << endl;
+  printDelta("[DELTA TEST] Delta received:", receive(watcher));
+
+  // Step 3: pretend the first delta was lost and resync from version 0
+  RequestMessage resyncRequest;
+  resyncRequest.requestId = 4004;
+  resyncRequest.operation = Operation::RESYNC;
+  resyncRequest.facilityName = "Swimming Pool";
+  resyncRequest.day = Util::Day::Wednesday;
+  resyncRequest.startTime = 0;
+  resyncRequest.endTime = 0;
+  resyncRequest.sinceVersion = 0;
+
+  watcher.send_to(buffer(resyncRequest.marshal()), server_endpoint);
+  printDelta("[DELTA TEST] Resync Response:", receive(watcher));
+
+  cout << "[DELTA TEST] Delta monitor test completed.\n\n";
+}
+
 // -----------------------------
 // MONITORING TEST
 // -----------------------------
 void monitorTest(io_context &io_context, const udp::endpoint &server_endpoint) {
   cout << "[MONITER TEST]";
   // Launch separate threads for each client
-  thread clientAThread(clientAMonitor, ref(io_context), ref(server_endpoint));
+  thread clientAThread(clientAMonitor, ref(server_endpoint));
   thread clientBThread(clientBMonitor, ref(io_context), ref(server_endpoint));
 
   // Wait for clients to finish
@@ -298,9 +1612,11 @@ void monitorTest(io_context &io_context, const udp::endpoint &server_endpoint) {
 }
 
 // Client A: Monitor Gym from 10:00 to 12:00
-void clientAMonitor(io_context &io_context,
-                    const udp::endpoint &server_endpoint) {
-  udp::socket socket(io_context, udp::endpoint(udp::v4(), 0));
+void clientAMonitor(const udp::endpoint &server_endpoint) {
+  // Client A reads on its own context so the notification timeout can cancel
+  // a pending receive (a blocking receive_from is not interruptible)
+  boost::asio::io_context client_context;
+  udp::socket socket(client_context, udp::endpoint(udp::v4(), 0));
   vector<uint8_t> responseData;
   ResponseMessage response;
 
@@ -334,34 +1650,31 @@ void clientAMonitor(io_context &io_context,
   {
     recv_buffer.fill(0);
 
-    // Create a deadline timer for 15 seconds
-    steady_timer timer(io_context);
-    timer.expires_after(std::chrono::seconds(20));
-
     bool notificationReceived = false;
-
-    // Start asynchronous wait for the timer
-    timer.async_wait([&](const boost::system::error_code &ec) {
-      if (!ec) {
-        cout << "[Client A] Timeout reached without notifications. Ending "
-                "thread.\n";
-        socket.cancel(); // Cancel the socket to break the blocking call
-      }
-    });
-
-    try {
-      // Blocking receive with timer running
-      len = socket.receive_from(buffer(recv_buffer), sender_endpoint);
-      timer.cancel(); // Cancel the timer if message received in time
-
-      responseData.assign(recv_buffer.begin(), recv_buffer.begin() + len);
-      response = ResponseMessage::unmarshal(responseData);
-      cout << "[Client A] Notification received: " << response.message << endl;
-      notificationReceived = true;
-    } catch (const boost::system::system_error &e) {
-      cout << "[Client A] Receive operation was canceled due to timeout.\n";
+    socket.async_receive_from(
+        buffer(recv_buffer), sender_endpoint,
+        [&](const boost::system::error_code &ec, size_t bytes) {
+          if (!ec) {
+            len = bytes;
+            notificationReceived = true;
+          }
+        });
+
+    client_context.restart();
+    client_context.run_for(std::chrono::seconds(20));
+
+    if (!notificationReceived) {
+      cout << "[Client A] Timeout reached without notifications. Ending "
+              "thread.\n";
+      socket.cancel();
+      client_context.restart();
+      client_context.run();
       break; // Exit the loop on timeout
     }
+
+    responseData.assign(recv_buffer.begin(), recv_buffer.begin() + len);
+    response = ResponseMessage::unmarshal(responseData);
+    cout << "[Client A] Notification received: " << response.message << endl;
   }
 
   cout << "[Client A] Monitoring ended.\n";